@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "rom_image.hpp"
+
+
+//---- battery-backed RAM ----
+// Cartridge RAM saved to a file (the .sav next to the ROM). Every
+// BatteryRam has its own RAM, started from the file contents: where mmap
+// is available (see ROM_MMAP_SUPPORTED) the file is mapped private,
+// copy-on-write, so pages are only read in when touched and only copied
+// when written; otherwise it is read into memory.
+// Only the first BatteryRam of a file in the process owns it and writes
+// its RAM back, on flush(); the others, e.g. more instances of the same
+// game, run on their copy without persisting it
+
+class BatteryRam
+{
+public:
+    // throws when the file exists but cannot be read
+    BatteryRam(const char* path, size_t size);
+    ~BatteryRam();
+    BatteryRam(const BatteryRam&) = delete;
+    BatteryRam& operator=(const BatteryRam&) = delete;
+
+    uint8_t* data() { return m_data; }
+    size_t size() { return m_size; }
+    bool isMapped() { return m_isMapped; }
+    bool isOwner() { return m_isOwner; }
+    const std::string& path() { return m_path; }
+
+    // writes the RAM to the file, when the owner; at checkpoints and at
+    // exit, also done by the destructor. False when the file could not be
+    // written, leaving the previous one in place
+    bool flush();
+
+private:
+    std::string m_path;
+    std::string m_ownerKey;
+    uint8_t* m_data = nullptr;
+    size_t m_size;
+    bool m_isMapped = false;
+    bool m_isOwner = false;
+    std::vector<uint8_t> m_buffer;     // when not mapped
+
+    bool map();
+    void read();
+};
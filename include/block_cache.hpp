@@ -0,0 +1,103 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "instructions.hpp"
+
+class Bus;
+class Cpu;
+
+using CpuMethod = uint8_t (Cpu::*)(void);
+
+
+//---- basic-block cache ----
+// PRG ROM code is decoded once into blocks of DecodedInstr, keyed by
+// the PC of their first instruction; a block ends at the first
+// instruction that can change the control flow.
+// Only ROM-resident code ($8000-$FFFF) is cached, code running from RAM
+// always goes through the regular fetch and decode;
+// invalidate() must be called whenever the ROM mapping changes (bank
+// switch), with the windows remapped: only the blocks overlapping them
+// are dropped, the code of the fixed banks stays decoded
+
+struct DecodedInstr
+{
+    CpuMethod addrMode;       // nullptr when targetAddress is resolved at decode time
+    CpuMethod operate;
+    uint16_t targetAddress;
+    uint8_t opcode;
+    Operation operation;
+    uint8_t nBytes;
+    uint8_t nCycles;
+    bool isBlockEnd;
+};
+
+
+// ROM code is dropped by 8KB window, the smallest PRG bank:
+// bit i of a mask is the window at $8000 + i * 8KB
+using CodeWindows = uint8_t;
+static const uint32_t CODE_WINDOW_SIZE = 0x2000;
+static const uint8_t N_CODE_WINDOWS = 4;
+static const CodeWindows ALL_CODE_WINDOWS = 0x0F;
+
+// windows of the ROM bytes from firstAddr to lastAddr, both included
+inline CodeWindows codeWindows(uint16_t firstAddr, uint16_t lastAddr)
+{
+    if (lastAddr < 0x8000)
+        return 0;
+
+    uint32_t iFirst = (std::max(firstAddr, (uint16_t)0x8000) - 0x8000) / CODE_WINDOW_SIZE;
+    uint32_t iLast = (lastAddr - 0x8000) / CODE_WINDOW_SIZE;
+    return (CodeWindows)((2 << iLast) - (1 << iFirst));
+}
+
+
+class BlockCache
+{
+public:
+    static const uint32_t START_ADDR = 0x8000;
+    static const uint32_t END_ADDR = 0x10000;
+    static const uint32_t MAX_BLOCK_LEN = 64;
+    // decoded instructions kept, dropped ones included, before starting over
+    static const uint32_t MAX_INSTRS = 0x8000;
+
+    BlockCache();
+    void connect(Bus* bus) { m_bus = bus; }
+
+    const DecodedInstr& fetch(uint16_t pc);
+    void invalidate(CodeWindows windows = ALL_CODE_WINDOWS);
+
+    static DecodedInstr decodeInstr(Bus* bus, uint16_t pc);
+
+    uint64_t nHits() { return m_nHits; }
+    uint64_t nMisses() { return m_nMisses; }
+    uint64_t nDecodedInstr() { return m_nDecodedInstr; }
+    uint32_t nInvalidations() { return m_nInvalidations; }
+    void resetStats();
+    void printStats();
+
+private:
+    static const int32_t NO_BLOCK = -1;
+
+    Bus* m_bus;
+    std::vector<DecodedInstr> m_instrs;
+    std::vector<int32_t> m_blockStarts;  // index in m_instrs of the block starting at each ROM address
+    std::vector<uint16_t> m_windowBlocks[N_CODE_WINDOWS];  // start PCs of the blocks overlapping each window
+
+    // next instruction of the current block, to skip the lookup while running straight-line code
+    int32_t m_nextInstr;
+    uint16_t m_nextPC;
+
+    uint64_t m_nHits;
+    uint64_t m_nMisses;
+    uint64_t m_nDecodedInstr;
+    uint32_t m_nInvalidations;
+
+    int32_t decodeBlock(uint16_t startPC);
+};
+
+
+// true for the instructions that can change the control flow
+bool endsBlock(Operation operation);
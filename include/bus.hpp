@@ -1,28 +1,144 @@
 #pragma once
 
 #include "cartridge.hpp"
+#include "controller.hpp"
 #include "cpu.hpp"
 #include "ppu.hpp"
+#include "scheduler.hpp"
+
+class Mapper;
+
+//---- CPU memory map ----
+// The 64KB address space is split in 256 pages of 256 bytes, with one
+// table per direction: a page is either backed by host memory (internal
+// RAM and its mirrors, PRG ROM), accessed with a single indexed load or
+// store, or by a handler (PPU, APU and I/O registers, unmapped areas).
+// Cartridge PRG RAM is host memory too, see BatteryRam when
+// battery-backed.
+// Bank switching only has to remap the pages of the bank.
+// Likewise the PPU pattern tables are 8 slots of 1KB pointing into the
+// cartridge CHR and its predecoded tiles, remapped by the Mapper
+
+class Bus;
+using BusReadHandler  = uint8_t (Bus::*)(uint16_t addr);
+using BusWriteHandler = void (Bus::*)(uint16_t addr, uint8_t value);
+
 
 class Bus
 {
 public:
     static const uint16_t INTERNAL_RAM_SIZE = 0x800;
+    static const uint16_t PAGE_SIZE = 0x100;
+    static const uint16_t N_PAGES = 0x100;
+    static const uint8_t N_CONTROLLERS = 2;
+    static const uint16_t CHR_SLOT_SIZE = 0x400;
+    static const uint8_t N_CHR_SLOTS = 8;
+
     Bus();
+    ~Bus();
     Cpu* cpu() { return m_cpu; }
     Ppu* ppu() { return m_ppu; }
+    Scheduler& scheduler() { return m_scheduler; }
+    Mapper* mapper() { return m_mapper; }
+    // at $4016 and $4017
+    Controller& controller(uint8_t iPort) { return m_controllers[iPort]; }
 
     void insertCartridge(Cartridge* cart);
     void reset(bool isAutoTest);
+    uint32_t runCycles(uint32_t nCycles);
+    void syncPpu();
+    void dispatchEvents();
+
+    // whole machine snapshots, see save_state.hpp; throw without a
+    // cartridge, and on an invalid snapshot or one of another version or
+    // cartridge, leaving the machine as it was
+    void saveState(std::vector<uint8_t>& buffer);
+    void loadState(const uint8_t* data, size_t size);
+    void saveStateFile(const char* path);
+    void loadStateFile(const char* path);
+
+    uint8_t read(uint16_t addr)
+    {
+        const uint8_t* page = m_readPages[addr >> 8];
+        if (page != nullptr)
+            return page[addr & 0xFF];
+
+        return (this->*m_readHandlers[addr >> 8])(addr);
+    }
+
+    void write(uint16_t addr, uint8_t value)
+    {
+        uint8_t* page = m_writePages[addr >> 8];
+        if (page != nullptr)
+        {
+            page[addr & 0xFF] = value;
+            return;
+        }
 
-    uint8_t read(uint16_t addr);
-    void write(uint16_t addr, uint8_t data);
-    uint8_t readChr(uint16_t addr);
+        (this->*m_writeHandlers[addr >> 8])(addr, value);
+    }
+
+    // read without side effects, for tracing and debugging:
+    // registers behind a handler read as zero
+    uint8_t peek(uint16_t addr)
+    {
+        const uint8_t* page = m_readPages[addr >> 8];
+        return (page != nullptr ? page[addr & 0xFF] : 0x00);
+    }
+
+    // host memory behind a whole page, nullptr when it goes through a handler
+    const uint8_t* readPage(uint8_t page) { return m_readPages[page]; }
+    // the tables of all pages, for native code
+    const uint8_t* const* readPages() { return m_readPages; }
+    uint8_t* const* writePages() { return m_writePages; }
+
+    // PPU pattern tables, $0000-$1FFF
+    uint8_t readChr(uint16_t addr) { return m_chrSlots[addr >> 10][addr & 0x03FF]; }
+    void writeChr(uint16_t addr, uint8_t value);
+    // predecoded row of the tile at addr, see Cartridge::chrTileRow()
+    uint64_t chrTileRow(uint16_t addr, bool isFlipped=false)
+    {
+        const uint64_t* rows = (isFlipped ? m_chrRowSlotsFlipped : m_chrRowSlots)[addr >> 10];
+        return rows[((addr & 0x03F0) >> 1) | (addr & 0x07)];
+    }
+    // the PPU counts its lines for the mapper, see Ppu::SCANLINE_COUNTER_DOT
+    void clockScanlineCounter();
+
+    void mapPrgRom(uint16_t startAddr, uint32_t size, const uint8_t* data);
+    void mapChr(uint16_t startAddr, uint32_t size, uint32_t chrOffset);
 
     
 private:
     Cartridge* m_cart;
+    Mapper* m_mapper;
     Cpu* m_cpu;
     Ppu* m_ppu;
-    uint8_t m_internalRam[INTERNAL_RAM_SIZE];
+    Scheduler m_scheduler;
+    Controller m_controllers[N_CONTROLLERS];
+    uint8_t m_internalRam[INTERNAL_RAM_SIZE] {};
+    // the state before loading one, see loadState()
+    std::vector<uint8_t> m_stateBackup;
+
+    // nullptr when the page goes through its handler
+    const uint8_t* m_readPages[N_PAGES];
+    uint8_t* m_writePages[N_PAGES];
+    BusReadHandler m_readHandlers[N_PAGES];
+    BusWriteHandler m_writeHandlers[N_PAGES];
+
+    // CHR offset, bytes and decoded tile rows behind each 1KB slot
+    uint32_t m_chrOffsets[N_CHR_SLOTS];
+    const uint8_t* m_chrSlots[N_CHR_SLOTS];
+    const uint64_t* m_chrRowSlots[N_CHR_SLOTS];
+    const uint64_t* m_chrRowSlotsFlipped[N_CHR_SLOTS];
+
+    void readState(StateReader& reader);
+    void mapPages(uint16_t startAddr, uint16_t endAddr, BusReadHandler readHandler, BusWriteHandler writeHandler);
+
+    uint8_t readPpuRegister(uint16_t addr);
+    void writePpuRegister(uint16_t addr, uint8_t value);
+    uint8_t readApuIo(uint16_t addr);
+    void writeApuIo(uint16_t addr, uint8_t value);
+    uint8_t readUnmapped(uint16_t addr);
+    void writeUnmapped(uint16_t addr, uint8_t value);
+    void writeMapper(uint16_t addr, uint8_t value);
 };
@@ -3,31 +3,113 @@
 #include <cstdint>
 #include <string>
 #include <bitset>
+#include <memory>
+#include <vector>
+
+#include "battery_ram.hpp"
+#include "rom_image.hpp"
+
+class StateWriter;
+class StateReader;
+
+
+//---- predecoded CHR tiles ----
+// Every row of every 8x8 tile is decoded at load time into 8 2-bit
+// pixels, one per byte, the leftmost pixel in the lowest byte, so that
+// renderers fetch a tile row with a single lookup instead of combining
+// the two bitplanes pixel by pixel.
+// Rows are also kept horizontally flipped, for sprites.
+// PRG and CHR data are not copied: they point into the shared RomImage
+// of the file, and CHR ROM tiles are decoded once per image, shared too.
+// Cartridges without CHR ROM get 8KB of CHR RAM instead, with private
+// tiles decoded again row by row as they are written.
+// All cartridges get 8KB of PRG RAM at $6000-$7FFF; with a battery it is
+// kept in the .sav file next to the ROM, see BatteryRam
+
+// 8 rows per tile, plain and flipped
+struct ChrTileRows
+{
+    std::vector<uint64_t> rows;
+    std::vector<uint64_t> flipped;
+};
+
 
 class Cartridge
 {
 public:
-    static const uint32_t MAX_SIZE = 1024*1024;
+    static const uint16_t HEADER_SIZE = 16;
+    static const uint16_t TRAINER_SIZE = 512;
+    static const uint16_t PRG_RAM_SIZE = 0x2000;
+    static const uint16_t TRAINER_PRG_RAM_OFFSET = 0x1000;    // at $7000
+    static const uint16_t CHR_BLOCK_SIZE = 0x2000;
+    static const uint16_t TILE_SIZE = 16;       // bytes, the two bitplanes
+    static const uint16_t N_TILE_ROWS = 8;
 
     Cartridge(const char* romPath);
 
     std::string const filename() { return m_filename; };
     uint8_t nProgBlocks();
     uint8_t nCharBlocks();
+    // iNES mapper number, see mapper.hpp
+    uint8_t mapperNumber();
+    bool hasVerticalMirroring();
+    bool hasFourScreenVram();
+    bool hasBattery();
     const uint8_t prgData(uint8_t iBlock, uint16_t addr);
+    const uint8_t* prgRom() { return m_progData; }
+    uint32_t prgRomSize();
+    // PRG_RAM_SIZE bytes
+    uint8_t* prgRam() { return (m_batteryRam ? m_batteryRam->data() : m_prgRam.data()); }
+    // writes battery-backed PRG RAM back to the save file, false on failure
+    bool flushPrgRam();
     const uint8_t chrData(uint8_t iBlock, uint16_t addr);
+    // CHR ROM, or CHR RAM when there is none
+    uint32_t chrSize();
+    bool hasChrRam() { return !m_chrRam.empty(); }
+    // ignored for CHR ROM
+    void writeChrRam(uint32_t offset, uint8_t value);
+
+    // PRG RAM and CHR RAM, see save_state.hpp
+    void saveState(StateWriter& writer);
+    void loadState(StateReader& reader);
+
+    // from offset (a multiple of the tile size) in CHR, for bank switching
+    const uint8_t* chrBank(uint32_t offset) { return m_charData + offset; }
+    const uint64_t* chrTileRows(uint32_t offset, bool isFlipped)
+    {
+        uint32_t iRow = (offset / TILE_SIZE) * N_TILE_ROWS;
+        return (isFlipped ? &m_chrTileRows->flipped[iRow] : &m_chrTileRows->rows[iRow]);
+    }
+
+    // row (addr & 0x07) of the tile at (addr & ~0x0F), decoded as by decodeTileRow()
+    uint64_t chrTileRow(uint8_t iBlock, uint16_t addr, bool isFlipped=false)
+    {
+        uint32_t iRow = ((iBlock * CHR_BLOCK_SIZE + addr) >> 4) * N_TILE_ROWS + (addr & 0x07);
+        return (isFlipped ? m_chrTileRows->flipped[iRow] : m_chrTileRows->rows[iRow]);
+    }
 
     void printDiagnostics();
     
 private:
     std::string m_filename;
 
-    uint8_t* m_progData;
-    uint8_t* m_charData;
+    std::shared_ptr<const RomImage> m_image;
+    const uint8_t* m_rawData;
+    const uint8_t* m_progData;
+    const uint8_t* m_charData;
     size_t m_rawDataSize;
-    uint8_t m_rawData[MAX_SIZE] {};
+    std::vector<uint8_t> m_chrRam;
+    std::vector<uint8_t> m_prgRam;
+    std::unique_ptr<BatteryRam> m_batteryRam;
+
+    // released before m_image, see sharedChrTileRows()
+    std::shared_ptr<ChrTileRows> m_chrTileRows;
 
     bool load(const char* romPath);
+    void decodeChrTiles();
+    std::shared_ptr<ChrTileRows> sharedChrTileRows();
+    static std::shared_ptr<ChrTileRows> decodeChrTileRows(const uint8_t* chrData, uint32_t size);
+    void decodeChrRow(uint32_t iTile, uint8_t dy);
     std::bitset<8> flags6();
     std::bitset<8> flags7();
     bool hasTrainer();
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+class StateWriter;
+class StateReader;
+
+
+//---- standard controller ----
+// The host side (see Keyboard) publishes the buttons held as a snapshot,
+// one bit per Button, from whichever thread pumps the input events.
+// The emulated side is the 8-bit shift register read through $4016 or
+// $4017: writing 1 then 0 to bit 0 of $4016 latches the snapshot, which
+// is then read out one button per read, A first; further reads return 1
+
+enum class Button : uint8_t
+{
+    A,
+    B,
+    Select,
+    Start,
+    Up,
+    Down,
+    Left,
+    Right,
+
+    N_BUTTONS
+};
+
+
+class Controller
+{
+public:
+    static uint8_t buttonBit(Button button) { return 1 << (int)button; }
+
+    // host side
+    void setButtons(uint8_t buttons) { m_buttons.store(buttons, std::memory_order_relaxed); }
+    uint8_t buttons() { return m_buttons.load(std::memory_order_relaxed); }
+
+    // emulated side
+    void reset();
+    void writeStrobe(uint8_t value);
+    uint8_t read();
+
+    // the shift register, not the buttons held
+    void saveState(StateWriter& writer);
+    void loadState(StateReader& reader);
+
+private:
+    std::atomic<uint8_t> m_buttons { 0 };
+    uint8_t m_shiftRegister = 0;
+    bool m_strobe = false;
+};
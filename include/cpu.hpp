@@ -1,10 +1,17 @@
 #pragma once
 
 #include <cstdint>
+#include <utility>
 
 #include "instructions.hpp"
+#include "block_cache.hpp"
+#include "jit.hpp"
+#include "trace.hpp"
+#include "profiler.hpp"
 
 class Bus;
+class StateWriter;
+class StateReader;
 
 
 enum FlagIndex {
@@ -29,33 +36,86 @@ enum FlagIndex {
 };
 
 
-enum OAMState
+static const int N_OAMDMA_VALUES = 256;
+static const int N_OAMDMA_CYCLES = 2 * N_OAMDMA_VALUES;
+
+
+enum class CpuCore
 {
-    READ,
-    WRITE,
-    INACTIVE
+    Table,  // dispatch through the cpuAddrModes/cpuOpcodeOperations member pointers
+    Switch, // fused per-opcode switch, see cpu_switch_core.cpp
+    Cached, // table core running PRG ROM code from the BlockCache
+    Jit     // native code for hot PRG ROM blocks, falling back to the cached core
 };
 
-static const int N_OAMDMA_VALUES = 256;
+
+struct CpuRegisters
+{
+    uint8_t   A;
+    uint8_t   X;
+    uint8_t   Y;
+    uint8_t  SP;
+    uint16_t PC;
+    uint8_t   P;
+
+    bool operator==(const CpuRegisters&) const = default;
+};
 
 
 bool isPageBreak(uint16_t addr1, uint16_t addr2);
 
-class Cpu
+
+// short loop the CPU may be spinning in, waiting for the PPU or an NMI;
+// see cpu_idle_loop.cpp
+struct IdleLoop
 {
-    friend struct Instruction; 
+    uint16_t startPC;   // target of the backward jump
+    uint16_t endPC;     // the backward jump itself
+    bool isPure;        // only reads RAM, ROM or PPUSTATUS and writes nothing
+    bool isInLoop;      // the PC has not left the loop since the last iteration
+
+    // state at the end of the last iteration
+    CpuRegisters regs;
+    uint64_t nTotCycles;
+    uint32_t nProcessedInstr;
+    int32_t nDotsLeft;  // before the next PPU frame event
+};
 
+
+class Cpu
+{
     static const uint16_t STACK_START = 0x100;
 
 public:
-    Cpu() { initInstrLookupTable(); };
+    Cpu() {};
+    ~Cpu();
     void setTracing(bool value) { m_tracing = value; }
+    void setTraceWriter(TraceWriter* writer) { m_traceWriter = writer; m_tracing = (writer != nullptr); }
     void setPC(uint16_t value) { PC = value; }
+    void setCore(CpuCore core) { m_core = core; }
+    void setIdleLoopSkipping(bool value) { m_idleLoopSkipping = value; }
+    void setProfiler(Profiler* profiler) { m_profiler = profiler; }
+    CpuCore core() { return m_core; }
+    uint32_t nProcessedInstr() { return m_nProcessedInstr; }
+    uint64_t nTotCycles() { return m_nTotCycles; }
+    uint64_t nIdleCyclesSkipped() { return m_nIdleCyclesSkipped; }
+    CpuRegisters registers() { return { A, X, Y, SP, PC, status() }; }
+    BlockCache& blockCache() { return m_blockCache; }
+    Jit* jit() { return m_jit; }
+    void invalidateCode(CodeWindows windows = ALL_CODE_WINDOWS);
 
-    void connect(Bus* bus) { m_bus = bus; }
+    void connect(Bus* bus) { m_bus = bus; m_blockCache.connect(bus); }
     void reset(bool isAutoTest);
     void clock();
+    uint32_t step();
     void requestNMI();
+    // level-triggered IRQ line, taken while the I flag is clear
+    void setIrqLine(bool isAsserted) { m_irqLine = isAsserted; }
+    void completeOAMDMA();
+
+    // see save_state.hpp
+    void saveState(StateWriter& writer);
+    void loadState(StateReader& reader);
     
     //addressing modes
     uint8_t AddrABS();
@@ -75,7 +135,7 @@ public:
     //opcodes
     uint8_t OpADC();
     uint8_t OpAND();
-    uint8_t OpASL();
+    template<AddrMode mode> uint8_t OpASL();
     uint8_t OpBCC();
     uint8_t OpBCS();
     uint8_t OpBEQ();
@@ -105,15 +165,15 @@ public:
     uint8_t OpLDA();
     uint8_t OpLDX();
     uint8_t OpLDY();
-    uint8_t OpLSR();
+    template<AddrMode mode> uint8_t OpLSR();
     uint8_t OpNOP();
     uint8_t OpORA();
     uint8_t OpPHA();
     uint8_t OpPHP();
     uint8_t OpPLA();
     uint8_t OpPLP();
-    uint8_t OpROL();
-    uint8_t OpROR();
+    template<AddrMode mode> uint8_t OpROL();
+    template<AddrMode mode> uint8_t OpROR();
     uint8_t OpRTI();
     uint8_t OpRTS();
     uint8_t OpSBC();
@@ -150,30 +210,48 @@ private:
     uint8_t  SP;  // Stack Pointer: 8-bit offset to be added to $0100
     uint16_t PC;  // Program Counter
     uint8_t   P;  // Processor status
+#ifdef LAZY_FLAGS
+    // with lazy flags N, Z, C and V are kept apart from P,
+    // which is only assembled by status() when actually needed
+    uint8_t m_nValue;  // N is bit 7 of the last result
+    uint8_t m_zValue;  // Z is set when the last result is zero
+    bool m_carry;
+    bool m_overflow;
+#endif
     
     // other state
     bool m_nmiPending;
+    bool m_irqLine;
     
-    uint8_t m_nWaitCycles;
+    uint16_t m_nWaitCycles;
     uint16_t m_targetAddress;
     uint32_t m_nProcessedInstr;
-    uint32_t m_nTotCycles;
-    uint8_t (Cpu::*m_currAddrMode)(void);
+    uint64_t m_nTotCycles;
 
+    CpuCore m_core = CpuCore::Table;
+    BlockCache m_blockCache;
+    Jit* m_jit = nullptr;
+    uint32_t m_jitCycles;
+    bool m_jitBailout;
+    bool m_idleLoopSkipping = false;
+    IdleLoop m_idleLoop;
+    uint64_t m_nIdleCyclesSkipped;
     bool m_tracing = false;
+    TraceWriter* m_traceWriter = nullptr;  // text on stdout when tracing without a writer
+    Profiler* m_profiler = nullptr;        // only fed when built with CPU_PROFILER
 
     //DEBUG PPU
     uint8_t m_scrollX;
     uint8_t m_scrollY;
 
     //OAM
-    OAMState m_oamState;
-    uint8_t m_currOAMValue;
-    uint16_t m_nextOAMAddr;
-    int m_nOAMPerformed;
+    uint16_t m_oamDmaAddr;
 
     bool hasFlag(FlagIndex flagIndex);
     void setFlag(FlagIndex flagIndex, bool value);
+    void setNZ(uint8_t result);
+    uint8_t status();
+    void setStatus(uint8_t value);
 
     
     uint8_t read(uint16_t addr);
@@ -182,8 +260,91 @@ private:
     uint8_t popStack();
 
     void logInstruction(uint16_t pc);
+    // every instruction must go through the interpreter:
+    // no JIT runs, no idle loop skipping
+    bool isInstrumented() { return m_tracing || m_profiler != nullptr; }
 
     void startOAMDMA(uint16_t startAddr);
     void executeNMI();
+    void executeIRQ();
+    bool isInterruptPending() { return m_nmiPending || (m_irqLine && !hasFlag(FlagIndex::InterruptDisable)); }
+    void executeInstruction();
+
+    void executeCached();
+    bool executeJit();
+    void executeSwitch(uint8_t opcode);
+    void resetIdleLoop();
+    uint32_t skipIdleLoop(uint16_t startPC, uint32_t nInstr);
+    template<uint8_t opcode>
+    void fused();
+
+public:
+    template<uint8_t opcode>
+    static bool jitStep(Cpu* cpu, uint32_t targetAddress, uint32_t pc);
+    static JitThunk jitThunk(uint8_t opcode);
+    JitCpuLayout jitLayout();
+    // P as status() assembles it, for native code built with LAZY_FLAGS
+    static uint32_t jitStatus(Cpu* cpu);
+    static void jitSetStatus(Cpu* cpu, uint32_t value);
 
 };
+
+
+// dispatch tables of the table core, indexed by AddrMode and Operation
+inline constexpr CpuMethod cpuAddrModes[] = {
+    &Cpu::AddrABS, &Cpu::AddrABX, &Cpu::AddrABY, &Cpu::AddrACC, &Cpu::AddrIMM, &Cpu::AddrIMP, &Cpu::AddrIND,
+    &Cpu::AddrIZX, &Cpu::AddrIZY, &Cpu::AddrREL, &Cpu::AddrZP0, &Cpu::AddrZPX, &Cpu::AddrZPY,
+};
+
+// read-modify-write operations are specialized on the addressing mode,
+// so their slots are left empty here and filled per opcode below
+inline constexpr CpuMethod cpuOperations[] = {
+    &Cpu::OpADC, &Cpu::OpAND, nullptr,     &Cpu::OpBCC, &Cpu::OpBCS, &Cpu::OpBEQ, &Cpu::OpBIT, &Cpu::OpBMI,
+    &Cpu::OpBNE, &Cpu::OpBPL, &Cpu::OpBRK, &Cpu::OpBVC, &Cpu::OpBVS, &Cpu::OpCLC, &Cpu::OpCLD, &Cpu::OpCLI,
+    &Cpu::OpCLV, &Cpu::OpCMP, &Cpu::OpCPX, &Cpu::OpCPY, &Cpu::OpDEC, &Cpu::OpDEX, &Cpu::OpDEY, &Cpu::OpEOR,
+    &Cpu::OpINC, &Cpu::OpINX, &Cpu::OpINY, &Cpu::OpJMP, &Cpu::OpJSR, &Cpu::OpLDA, &Cpu::OpLDX, &Cpu::OpLDY,
+    nullptr,     &Cpu::OpNOP, &Cpu::OpORA, &Cpu::OpPHA, &Cpu::OpPHP, &Cpu::OpPLA, &Cpu::OpPLP, nullptr,
+    nullptr,     &Cpu::OpRTI, &Cpu::OpRTS, &Cpu::OpSBC, &Cpu::OpSEC, &Cpu::OpSED, &Cpu::OpSEI, &Cpu::OpSTA,
+    &Cpu::OpSTX, &Cpu::OpSTY, &Cpu::OpTAX, &Cpu::OpTAY, &Cpu::OpTSX, &Cpu::OpTXA, &Cpu::OpTXS, &Cpu::OpTYA,
+
+    &Cpu::OpLAX, &Cpu::OpSAX, &Cpu::OpDCP, &Cpu::OpISB, &Cpu::OpSLO, &Cpu::OpRLA, &Cpu::OpSRE, &Cpu::OpRRA,
+
+    &Cpu::OpNOP, //Unknown
+};
+
+static_assert(std::size(cpuAddrModes)  == (std::size_t)AddrMode::N_ADDR_MODES);
+static_assert(std::size(cpuOperations) == (std::size_t)Operation::N_OPERATIONS);
+
+
+template<uint8_t opcode>
+constexpr CpuMethod opcodeOperation()
+{
+    constexpr Instruction instr = instructionLookupTable[opcode];
+
+    if constexpr (instr.operation == Operation::ASL)
+        return &Cpu::OpASL<instr.addrMode>;
+    else if constexpr (instr.operation == Operation::LSR)
+        return &Cpu::OpLSR<instr.addrMode>;
+    else if constexpr (instr.operation == Operation::ROL)
+        return &Cpu::OpROL<instr.addrMode>;
+    else if constexpr (instr.operation == Operation::ROR)
+        return &Cpu::OpROR<instr.addrMode>;
+    else
+        return cpuOperations[(int)instr.operation];
+}
+
+template<std::size_t... opcodes>
+constexpr std::array<CpuMethod, 256> makeOpcodeOperations(std::index_sequence<opcodes...>)
+{
+    return { opcodeOperation<opcodes>()... };
+}
+
+// operation of each opcode, indexed by opcode
+inline constexpr std::array<CpuMethod, 256> cpuOpcodeOperations = makeOpcodeOperations(std::make_index_sequence<256>{});
+
+static_assert([] {
+    for (auto operate: cpuOpcodeOperations)
+        if (operate == nullptr)
+            return false;
+    return true;
+}());
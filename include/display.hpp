@@ -2,6 +2,8 @@
 
 #include <SDL.h>
 
+#include <cstdint>
+
 class Display {
     public:
         static const int SCALE_FACTOR = 4;
@@ -12,18 +14,32 @@ class Display {
         void shutdownSdl();
 
         bool initSystemPalette(const char* palFile);
+        // the 64 system colors as RGBA8888, see Ppu::setRgbaPalette()
+        const uint32_t* rgbaPalette() { return m_rgbaPalette; }
 
         void clear();
-        void render(const uint8_t *pixels);
+        // a row-major RGBA8888 frame, see Ppu::rgbaFrameBuffer(),
+        // copied into a streaming texture and scaled to the window
+        void render(const uint32_t *pixels);
         void refresh();
 
+        // time spent in the last render(), and on average
+        uint64_t lastRenderMicros() { return m_lastRenderMicros; }
+        void printStats();
+
         void dumpSystemPaletteEntry(uint8_t paletteIndex);
 
         
     private:
         uint8_t m_systemPalette[64*3];
+        uint32_t m_rgbaPalette[64];
 
         bool sdlInited = false;
-        SDL_Window* window;
-        SDL_Renderer* renderer;
+        SDL_Window* window = nullptr;
+        SDL_Renderer* renderer = nullptr;
+        SDL_Texture* texture = nullptr;
+
+        uint64_t m_lastRenderMicros = 0;
+        uint64_t m_totRenderMicros = 0;
+        uint64_t m_nRenderedFrames = 0;
 };
@@ -1,20 +1,346 @@
 #pragma once
 
 
+#include <array>
 #include <cstdint>
-#include <string>
 
-class Cpu;
 
+enum class Operation : uint8_t
+{
+    ADC, AND, ASL, BCC, BCS, BEQ, BIT, BMI, BNE, BPL, BRK, BVC, BVS, CLC,
+    CLD, CLI, CLV, CMP, CPX, CPY, DEC, DEX, DEY, EOR, INC, INX, INY, JMP,
+    JSR, LDA, LDX, LDY, LSR, NOP, ORA, PHA, PHP, PLA, PLP, ROL, ROR, RTI,
+    RTS, SBC, SEC, SED, SEI, STA, STX, STY, TAX, TAY, TSX, TXA, TXS, TYA,
+
+    //illegal opcodes
+    LAX, SAX, DCP, ISB, SLO, RLA, SRE, RRA,
+
+    Unknown, //executed as NOP, traced as "???"
+
+    N_OPERATIONS
+};
+
+enum class AddrMode : uint8_t
+{
+    ABS, ABX, ABY, ACC, IMM, IMP, IND, IZX, IZY, REL, ZP0, ZPX, ZPY,
+
+    N_ADDR_MODES
+};
+
+
+// hot data only, packed to 4 bytes;
+// names for disassembly are in the cold operationName() table
 struct Instruction
 {
-    std::string name;
-    uint8_t (Cpu::*operate)(void) = nullptr;
-    uint8_t (Cpu::*addrmode)(void) = nullptr;
-    uint8_t nBytes = 0;
+    Operation operation = Operation::Unknown;
+    AddrMode addrMode = AddrMode::IMP;
+    uint8_t nBytes = 2;
     uint8_t nCycles = 0;
 };
 
-extern struct Instruction instructionLookupTable[256];
+static_assert(sizeof(Instruction) == 4);
+
+
+// length of opcode plus operand as fetched by the addressing mode;
+// unlike Instruction::nBytes it is also right for the illegal NOPs
+constexpr uint8_t addrModeBytes(AddrMode addrMode)
+{
+    switch (addrMode)
+    {
+        case AddrMode::IMP:
+        case AddrMode::ACC:
+            return 1;
+        case AddrMode::ABS:
+        case AddrMode::ABX:
+        case AddrMode::ABY:
+        case AddrMode::IND:
+            return 3;
+        default:
+            return 2;
+    }
+}
+
+
+const char* operationName(Operation operation);
+
+
+// the table rows can be regenerated from instruction_list.txt
+// with scripts/write_instruction_table.py
+constexpr std::array<Instruction, 256> makeInstrLookupTable()
+{
+    std::array<Instruction, 256> table {};
+
+    //standard opcodes
+    table[0x69] = { Operation::ADC, AddrMode::IMM, 2, 2 };
+    table[0x65] = { Operation::ADC, AddrMode::ZP0, 2, 3 };
+    table[0x75] = { Operation::ADC, AddrMode::ZPX, 2, 4 };
+    table[0x6D] = { Operation::ADC, AddrMode::ABS, 3, 4 };
+    table[0x7D] = { Operation::ADC, AddrMode::ABX, 3, 4 };
+    table[0x79] = { Operation::ADC, AddrMode::ABY, 3, 4 };
+    table[0x61] = { Operation::ADC, AddrMode::IZX, 2, 6 };
+    table[0x71] = { Operation::ADC, AddrMode::IZY, 2, 5 };
+    table[0x29] = { Operation::AND, AddrMode::IMM, 2, 2 };
+    table[0x25] = { Operation::AND, AddrMode::ZP0, 2, 3 };
+    table[0x35] = { Operation::AND, AddrMode::ZPX, 2, 4 };
+    table[0x2D] = { Operation::AND, AddrMode::ABS, 3, 4 };
+    table[0x3D] = { Operation::AND, AddrMode::ABX, 3, 4 };
+    table[0x39] = { Operation::AND, AddrMode::ABY, 3, 4 };
+    table[0x21] = { Operation::AND, AddrMode::IZX, 2, 6 };
+    table[0x31] = { Operation::AND, AddrMode::IZY, 2, 5 };
+    table[0x0A] = { Operation::ASL, AddrMode::ACC, 1, 2 };
+    table[0x06] = { Operation::ASL, AddrMode::ZP0, 2, 5 };
+    table[0x16] = { Operation::ASL, AddrMode::ZPX, 2, 6 };
+    table[0x0E] = { Operation::ASL, AddrMode::ABS, 3, 6 };
+    table[0x1E] = { Operation::ASL, AddrMode::ABX, 3, 7 };
+    table[0x24] = { Operation::BIT, AddrMode::ZP0, 2, 3 };
+    table[0x2C] = { Operation::BIT, AddrMode::ABS, 3, 4 };
+    table[0x00] = { Operation::BRK, AddrMode::IMP, 1, 7 };
+    table[0xC9] = { Operation::CMP, AddrMode::IMM, 2, 2 };
+    table[0xC5] = { Operation::CMP, AddrMode::ZP0, 2, 3 };
+    table[0xD5] = { Operation::CMP, AddrMode::ZPX, 2, 4 };
+    table[0xCD] = { Operation::CMP, AddrMode::ABS, 3, 4 };
+    table[0xDD] = { Operation::CMP, AddrMode::ABX, 3, 4 };
+    table[0xD9] = { Operation::CMP, AddrMode::ABY, 3, 4 };
+    table[0xC1] = { Operation::CMP, AddrMode::IZX, 2, 6 };
+    table[0xD1] = { Operation::CMP, AddrMode::IZY, 2, 5 };
+    table[0xE0] = { Operation::CPX, AddrMode::IMM, 2, 2 };
+    table[0xE4] = { Operation::CPX, AddrMode::ZP0, 2, 3 };
+    table[0xEC] = { Operation::CPX, AddrMode::ABS, 3, 4 };
+    table[0xC0] = { Operation::CPY, AddrMode::IMM, 2, 2 };
+    table[0xC4] = { Operation::CPY, AddrMode::ZP0, 2, 3 };
+    table[0xCC] = { Operation::CPY, AddrMode::ABS, 3, 4 };
+    table[0xC6] = { Operation::DEC, AddrMode::ZP0, 2, 5 };
+    table[0xD6] = { Operation::DEC, AddrMode::ZPX, 2, 6 };
+    table[0xCE] = { Operation::DEC, AddrMode::ABS, 3, 6 };
+    table[0xDE] = { Operation::DEC, AddrMode::ABX, 3, 7 };
+    table[0x49] = { Operation::EOR, AddrMode::IMM, 2, 2 };
+    table[0x45] = { Operation::EOR, AddrMode::ZP0, 2, 3 };
+    table[0x55] = { Operation::EOR, AddrMode::ZPX, 2, 4 };
+    table[0x4D] = { Operation::EOR, AddrMode::ABS, 3, 4 };
+    table[0x5D] = { Operation::EOR, AddrMode::ABX, 3, 4 };
+    table[0x59] = { Operation::EOR, AddrMode::ABY, 3, 4 };
+    table[0x41] = { Operation::EOR, AddrMode::IZX, 2, 6 };
+    table[0x51] = { Operation::EOR, AddrMode::IZY, 2, 5 };
+    table[0xE6] = { Operation::INC, AddrMode::ZP0, 2, 5 };
+    table[0xF6] = { Operation::INC, AddrMode::ZPX, 2, 6 };
+    table[0xEE] = { Operation::INC, AddrMode::ABS, 3, 6 };
+    table[0xFE] = { Operation::INC, AddrMode::ABX, 3, 7 };
+    table[0x4C] = { Operation::JMP, AddrMode::ABS, 3, 3 };
+    table[0x6C] = { Operation::JMP, AddrMode::IND, 3, 5 };
+    table[0x20] = { Operation::JSR, AddrMode::ABS, 3, 6 };
+    table[0xA9] = { Operation::LDA, AddrMode::IMM, 2, 2 };
+    table[0xA5] = { Operation::LDA, AddrMode::ZP0, 2, 3 };
+    table[0xB5] = { Operation::LDA, AddrMode::ZPX, 2, 4 };
+    table[0xAD] = { Operation::LDA, AddrMode::ABS, 3, 4 };
+    table[0xBD] = { Operation::LDA, AddrMode::ABX, 3, 4 };
+    table[0xB9] = { Operation::LDA, AddrMode::ABY, 3, 4 };
+    table[0xA1] = { Operation::LDA, AddrMode::IZX, 2, 6 };
+    table[0xB1] = { Operation::LDA, AddrMode::IZY, 2, 5 };
+    table[0xA2] = { Operation::LDX, AddrMode::IMM, 2, 2 };
+    table[0xA6] = { Operation::LDX, AddrMode::ZP0, 2, 3 };
+    table[0xB6] = { Operation::LDX, AddrMode::ZPY, 2, 4 };
+    table[0xAE] = { Operation::LDX, AddrMode::ABS, 3, 4 };
+    table[0xBE] = { Operation::LDX, AddrMode::ABY, 3, 4 };
+    table[0xA0] = { Operation::LDY, AddrMode::IMM, 2, 2 };
+    table[0xA4] = { Operation::LDY, AddrMode::ZP0, 2, 3 };
+    table[0xB4] = { Operation::LDY, AddrMode::ZPX, 2, 4 };
+    table[0xAC] = { Operation::LDY, AddrMode::ABS, 3, 4 };
+    table[0xBC] = { Operation::LDY, AddrMode::ABX, 3, 4 };
+    table[0x4A] = { Operation::LSR, AddrMode::ACC, 1, 2 };
+    table[0x46] = { Operation::LSR, AddrMode::ZP0, 2, 5 };
+    table[0x56] = { Operation::LSR, AddrMode::ZPX, 2, 6 };
+    table[0x4E] = { Operation::LSR, AddrMode::ABS, 3, 6 };
+    table[0x5E] = { Operation::LSR, AddrMode::ABX, 3, 7 };
+    table[0xEA] = { Operation::NOP, AddrMode::IMP, 1, 2 };
+    table[0x09] = { Operation::ORA, AddrMode::IMM, 2, 2 };
+    table[0x05] = { Operation::ORA, AddrMode::ZP0, 2, 3 };
+    table[0x15] = { Operation::ORA, AddrMode::ZPX, 2, 4 };
+    table[0x0D] = { Operation::ORA, AddrMode::ABS, 3, 4 };
+    table[0x1D] = { Operation::ORA, AddrMode::ABX, 3, 4 };
+    table[0x19] = { Operation::ORA, AddrMode::ABY, 3, 4 };
+    table[0x01] = { Operation::ORA, AddrMode::IZX, 2, 6 };
+    table[0x11] = { Operation::ORA, AddrMode::IZY, 2, 5 };
+    table[0x2A] = { Operation::ROL, AddrMode::ACC, 1, 2 };
+    table[0x26] = { Operation::ROL, AddrMode::ZP0, 2, 5 };
+    table[0x36] = { Operation::ROL, AddrMode::ZPX, 2, 6 };
+    table[0x2E] = { Operation::ROL, AddrMode::ABS, 3, 6 };
+    table[0x3E] = { Operation::ROL, AddrMode::ABX, 3, 7 };
+    table[0x6A] = { Operation::ROR, AddrMode::ACC, 1, 2 };
+    table[0x66] = { Operation::ROR, AddrMode::ZP0, 2, 5 };
+    table[0x76] = { Operation::ROR, AddrMode::ZPX, 2, 6 };
+    table[0x6E] = { Operation::ROR, AddrMode::ABS, 3, 6 };
+    table[0x7E] = { Operation::ROR, AddrMode::ABX, 3, 7 };
+    table[0x40] = { Operation::RTI, AddrMode::IMP, 1, 6 };
+    table[0x60] = { Operation::RTS, AddrMode::IMP, 1, 6 };
+    table[0xE9] = { Operation::SBC, AddrMode::IMM, 2, 2 };
+    table[0xEB] = { Operation::SBC, AddrMode::IMM, 2, 2 };
+    table[0xE5] = { Operation::SBC, AddrMode::ZP0, 2, 3 };
+    table[0xF5] = { Operation::SBC, AddrMode::ZPX, 2, 4 };
+    table[0xED] = { Operation::SBC, AddrMode::ABS, 3, 4 };
+    table[0xFD] = { Operation::SBC, AddrMode::ABX, 3, 4 };
+    table[0xF9] = { Operation::SBC, AddrMode::ABY, 3, 4 };
+    table[0xE1] = { Operation::SBC, AddrMode::IZX, 2, 6 };
+    table[0xF1] = { Operation::SBC, AddrMode::IZY, 2, 5 };
+    table[0x85] = { Operation::STA, AddrMode::ZP0, 2, 3 };
+    table[0x95] = { Operation::STA, AddrMode::ZPX, 2, 4 };
+    table[0x8D] = { Operation::STA, AddrMode::ABS, 3, 4 };
+    table[0x9D] = { Operation::STA, AddrMode::ABX, 3, 5 };
+    table[0x99] = { Operation::STA, AddrMode::ABY, 3, 5 };
+    table[0x81] = { Operation::STA, AddrMode::IZX, 2, 6 };
+    table[0x91] = { Operation::STA, AddrMode::IZY, 2, 6 };
+    table[0x86] = { Operation::STX, AddrMode::ZP0, 2, 3 };
+    table[0x96] = { Operation::STX, AddrMode::ZPY, 2, 4 };
+    table[0x8E] = { Operation::STX, AddrMode::ABS, 3, 4 };
+    table[0x84] = { Operation::STY, AddrMode::ZP0, 2, 3 };
+    table[0x94] = { Operation::STY, AddrMode::ZPX, 2, 4 };
+    table[0x8C] = { Operation::STY, AddrMode::ABS, 3, 4 };
+    table[0x10] = { Operation::BPL, AddrMode::REL, 2, 2 };
+    table[0x30] = { Operation::BMI, AddrMode::REL, 2, 2 };
+    table[0x50] = { Operation::BVC, AddrMode::REL, 2, 2 };
+    table[0x70] = { Operation::BVS, AddrMode::REL, 2, 2 };
+    table[0x90] = { Operation::BCC, AddrMode::REL, 2, 2 };
+    table[0xB0] = { Operation::BCS, AddrMode::REL, 2, 2 };
+    table[0xD0] = { Operation::BNE, AddrMode::REL, 2, 2 };
+    table[0xF0] = { Operation::BEQ, AddrMode::REL, 2, 2 };
+    table[0x18] = { Operation::CLC, AddrMode::IMP, 1, 2 };
+    table[0x38] = { Operation::SEC, AddrMode::IMP, 1, 2 };
+    table[0x58] = { Operation::CLI, AddrMode::IMP, 1, 2 };
+    table[0x78] = { Operation::SEI, AddrMode::IMP, 1, 2 };
+    table[0xB8] = { Operation::CLV, AddrMode::IMP, 1, 2 };
+    table[0xD8] = { Operation::CLD, AddrMode::IMP, 1, 2 };
+    table[0xF8] = { Operation::SED, AddrMode::IMP, 1, 2 };
+    table[0xAA] = { Operation::TAX, AddrMode::IMP, 1, 2 };
+    table[0x8A] = { Operation::TXA, AddrMode::IMP, 1, 2 };
+    table[0xCA] = { Operation::DEX, AddrMode::IMP, 1, 2 };
+    table[0xE8] = { Operation::INX, AddrMode::IMP, 1, 2 };
+    table[0xA8] = { Operation::TAY, AddrMode::IMP, 1, 2 };
+    table[0x98] = { Operation::TYA, AddrMode::IMP, 1, 2 };
+    table[0x88] = { Operation::DEY, AddrMode::IMP, 1, 2 };
+    table[0xC8] = { Operation::INY, AddrMode::IMP, 1, 2 };
+    table[0x9A] = { Operation::TXS, AddrMode::IMP, 1, 2 };
+    table[0xBA] = { Operation::TSX, AddrMode::IMP, 1, 2 };
+    table[0x48] = { Operation::PHA, AddrMode::IMP, 1, 3 };
+    table[0x68] = { Operation::PLA, AddrMode::IMP, 1, 4 };
+    table[0x08] = { Operation::PHP, AddrMode::IMP, 1, 3 };
+    table[0x28] = { Operation::PLP, AddrMode::IMP, 1, 4 };
+
+    
+    //illegal opcodes
+    // table[0x4B] = { Operation::ALR, AddrMode::IMM, 2, 2 };
+    // table[0x0B] = { Operation::ANC, AddrMode::IMM, 2, 2 };
+    // table[0x2B] = { Operation::ANC, AddrMode::IMM, 2, 2 };
+    // table[0x8B] = { Operation::ANE, AddrMode::IMM, 2, 2 };
+    // table[0x6B] = { Operation::ARR, AddrMode::IMM, 2, 2 };
+    table[0xC7] = { Operation::DCP, AddrMode::ZP0, 2, 5 };
+    table[0xD7] = { Operation::DCP, AddrMode::ZPX, 2, 6 };
+    table[0xCF] = { Operation::DCP, AddrMode::ABS, 3, 6 };
+    table[0xDF] = { Operation::DCP, AddrMode::ABX, 3, 7 };
+    table[0xDB] = { Operation::DCP, AddrMode::ABY, 3, 7 };
+    table[0xC3] = { Operation::DCP, AddrMode::IZX, 2, 8 };
+    table[0xD3] = { Operation::DCP, AddrMode::IZY, 2, 8 };
+    table[0xE7] = { Operation::ISB, AddrMode::ZP0, 2, 5 };
+    table[0xF7] = { Operation::ISB, AddrMode::ZPX, 2, 6 };
+    table[0xEF] = { Operation::ISB, AddrMode::ABS, 3, 6 };
+    table[0xFF] = { Operation::ISB, AddrMode::ABX, 3, 7 };
+    table[0xFB] = { Operation::ISB, AddrMode::ABY, 3, 7 };
+    table[0xE3] = { Operation::ISB, AddrMode::IZX, 2, 8 };
+    table[0xF3] = { Operation::ISB, AddrMode::IZY, 2, 8 };
+    // table[0xBB] = { Operation::LAS, AddrMode::ABY, 3, 4 };
+    table[0xA7] = { Operation::LAX, AddrMode::ZP0, 2, 3 };
+    table[0xB7] = { Operation::LAX, AddrMode::ZPY, 2, 4 };
+    table[0xAF] = { Operation::LAX, AddrMode::ABS, 3, 4 };
+    table[0xBF] = { Operation::LAX, AddrMode::ABY, 3, 4 };
+    table[0xA3] = { Operation::LAX, AddrMode::IZX, 2, 6 };
+    table[0xB3] = { Operation::LAX, AddrMode::IZY, 2, 5 };
+    // table[0xAB] = { Operation::LXA, AddrMode::IMM, 2, 2 };
+    table[0x27] = { Operation::RLA, AddrMode::ZP0, 2, 5 };
+    table[0x37] = { Operation::RLA, AddrMode::ZPX, 2, 6 };
+    table[0x2F] = { Operation::RLA, AddrMode::ABS, 3, 6 };
+    table[0x3F] = { Operation::RLA, AddrMode::ABX, 3, 7 };
+    table[0x3B] = { Operation::RLA, AddrMode::ABY, 3, 7 };
+    table[0x23] = { Operation::RLA, AddrMode::IZX, 2, 8 };
+    table[0x33] = { Operation::RLA, AddrMode::IZY, 2, 8 };
+    table[0x67] = { Operation::RRA, AddrMode::ZP0, 2, 5 };
+    table[0x77] = { Operation::RRA, AddrMode::ZPX, 2, 6 };
+    table[0x6F] = { Operation::RRA, AddrMode::ABS, 3, 6 };
+    table[0x7F] = { Operation::RRA, AddrMode::ABX, 3, 7 };
+    table[0x7B] = { Operation::RRA, AddrMode::ABY, 3, 7 };
+    table[0x63] = { Operation::RRA, AddrMode::IZX, 2, 8 };
+    table[0x73] = { Operation::RRA, AddrMode::IZY, 2, 8 };
+    table[0x87] = { Operation::SAX, AddrMode::ZP0, 2, 3 };
+    table[0x97] = { Operation::SAX, AddrMode::ZPY, 2, 4 };
+    table[0x8F] = { Operation::SAX, AddrMode::ABS, 3, 4 };
+    table[0x83] = { Operation::SAX, AddrMode::IZX, 2, 6 };
+    // table[0xCB] = { Operation::SBX, AddrMode::IMM, 2, 2 };
+    // table[0x9F] = { Operation::SHA, AddrMode::ABY, 3, 5 };
+    // table[0x93] = { Operation::SHA, AddrMode::IZY, 2, 6 };
+    // table[0x9E] = { Operation::SHX, AddrMode::ABY, 3, 5 };
+    // table[0x9C] = { Operation::SHY, AddrMode::ABX, 3, 5 };
+    table[0x07] = { Operation::SLO, AddrMode::ZP0, 2, 5 };
+    table[0x17] = { Operation::SLO, AddrMode::ZPX, 2, 6 };
+    table[0x0F] = { Operation::SLO, AddrMode::ABS, 3, 6 };
+    table[0x1F] = { Operation::SLO, AddrMode::ABX, 3, 7 };
+    table[0x1B] = { Operation::SLO, AddrMode::ABY, 3, 7 };
+    table[0x03] = { Operation::SLO, AddrMode::IZX, 2, 8 };
+    table[0x13] = { Operation::SLO, AddrMode::IZY, 2, 8 };
+    table[0x47] = { Operation::SRE, AddrMode::ZP0, 2, 5 };
+    table[0x57] = { Operation::SRE, AddrMode::ZPX, 2, 6 };
+    table[0x4F] = { Operation::SRE, AddrMode::ABS, 3, 6 };
+    table[0x5F] = { Operation::SRE, AddrMode::ABX, 3, 7 };
+    table[0x5B] = { Operation::SRE, AddrMode::ABY, 3, 7 };
+    table[0x43] = { Operation::SRE, AddrMode::IZX, 2, 8 };
+    table[0x53] = { Operation::SRE, AddrMode::IZY, 2, 8 };
+    // table[0x9B] = { Operation::TAS, AddrMode::ABY, 3, 5 };
+    table[0x6A] = { Operation::ROR, AddrMode::ACC, 1, 2 };
+    table[0x66] = { Operation::ROR, AddrMode::ZP0, 2, 5 };
+    table[0x76] = { Operation::ROR, AddrMode::ZPX, 2, 6 };
+    table[0x6E] = { Operation::ROR, AddrMode::ABS, 3, 6 };
+    table[0x7E] = { Operation::ROR, AddrMode::ABX, 3, 7 };
+    // table[0x80] = { Operation::BRA, AddrMode::REL, 2, 3 };
+    table[0xFA] = { Operation::PLA, AddrMode::IMP, 1, 4 };
+    table[0x7A] = { Operation::PLA, AddrMode::IMP, 1, 4 };
+    // table[0xDB] = { Operation::STP, AddrMode::IMP, 1, 3 };
+    // table[0x64] = { Operation::STZ, AddrMode::ZP0, 2, 3 };
+    // table[0x74] = { Operation::STZ, AddrMode::ZPX, 2, 4 };
+    // table[0x9C] = { Operation::STZ, AddrMode::ABS, 3, 4 };
+    // table[0x9E] = { Operation::STZ, AddrMode::ABX, 3, 4 };
+    // table[0x1C] = { Operation::TRB, AddrMode::ABS, 3, 6 };
+    // table[0x14] = { Operation::TRB, AddrMode::ZP0, 2, 5 };
+    // table[0x0C] = { Operation::TRB, AddrMode::ABS, 3, 6 };
+    // table[0x04] = { Operation::TRB, AddrMode::ZP0, 2, 5 };
+    // table[0xCB] = { Operation::WAI, AddrMode::IMP, 1, 3 };
+
+
+    //nops
+    table[0x04] = { Operation::NOP, AddrMode::ZP0, 2, 3 };
+    table[0x0C] = { Operation::NOP, AddrMode::ABS, 3, 4 };
+    table[0x14] = { Operation::NOP, AddrMode::ZPX, 2, 4 };
+    table[0x1A] = { Operation::NOP, AddrMode::IMP, 1, 2 };
+    table[0x1C] = { Operation::NOP, AddrMode::ABX, 3, 4 };
+    table[0x34] = { Operation::NOP, AddrMode::ZPX, 3, 4 };
+    table[0x3A] = { Operation::NOP, AddrMode::IMP, 1, 2 };
+    table[0x3C] = { Operation::NOP, AddrMode::ABX, 3, 4 };
+    table[0x44] = { Operation::NOP, AddrMode::ZP0, 2, 3 };
+    table[0x54] = { Operation::NOP, AddrMode::ZPX, 3, 4 };
+    table[0x5A] = { Operation::NOP, AddrMode::IMP, 1, 2 };
+    table[0x5C] = { Operation::NOP, AddrMode::ABX, 3, 4 };
+    table[0x64] = { Operation::NOP, AddrMode::ZP0, 2, 3 };
+    table[0x74] = { Operation::NOP, AddrMode::ZPX, 3, 4 };
+    table[0x7A] = { Operation::NOP, AddrMode::IMP, 1, 2 };
+    table[0x7C] = { Operation::NOP, AddrMode::ABX, 3, 4 };
+    table[0x80] = { Operation::NOP, AddrMode::IMM, 1, 2 };
+    table[0x82] = { Operation::NOP, AddrMode::IMM, 1, 2 };
+    table[0x89] = { Operation::NOP, AddrMode::IMM, 1, 2 };
+    table[0xC2] = { Operation::NOP, AddrMode::IMM, 1, 2 };
+    table[0xD4] = { Operation::NOP, AddrMode::ZPX, 3, 4 };
+    table[0xDA] = { Operation::NOP, AddrMode::IMP, 1, 2 };
+    table[0xDC] = { Operation::NOP, AddrMode::ABX, 3, 4 };
+    table[0xE2] = { Operation::NOP, AddrMode::IMM, 1, 2 };
+    table[0xF4] = { Operation::NOP, AddrMode::ZPX, 3, 4 };
+    table[0xFA] = { Operation::NOP, AddrMode::IMP, 1, 2 };
+    table[0xFC] = { Operation::NOP, AddrMode::ABX, 3, 4 };
+
+    return table;
+}
 
-void initInstrLookupTable();
+inline constexpr std::array<Instruction, 256> instructionLookupTable = makeInstrLookupTable();
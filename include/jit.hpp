@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "block_cache.hpp"
+#include "instructions.hpp"
+
+class Bus;
+class Cpu;
+
+
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT_SUPPORTED
+#endif
+
+
+//---- x86-64 dynamic recompiler ----
+// Hot PRG ROM blocks are translated into native code working on the 6502
+// registers held in host registers: loads, stores, ALU operations,
+// shifts, flags, transfers, stack operations and branches are emitted
+// inline. The other instructions call a thunk specialized on the opcode
+// (see cpu_jit.cpp), with the operand resolved at compile time passed as
+// an immediate; the block exits as soon as a thunk returns false.
+// Blocks are superblocks: conditional branches are side exits taken only
+// when the branch is, and JMP/JSR to ROM are followed at compile time.
+//
+// A block never touches I/O: instructions whose static address can reach
+// PPU/APU registers or cartridge space end the block at compile time,
+// while run-time addresses go through the page tables of the bus, and
+// pages behind a handler take a slow path calling the thunk, which falls
+// back to the interpreter before executing anything.
+// Only ROM code is compiled, RAM code always runs in the interpreter.
+
+// native code of a compiled block, run with the Cpu as its only argument
+using JitCode = void (*)(Cpu* cpu);
+
+// thunk called by the native code for the instructions not emitted inline;
+// returns false to leave the block
+using JitThunk = bool (*)(Cpu* cpu, uint32_t targetAddress, uint32_t pc);
+
+
+// offsets in Cpu of the fields native code works on, see Cpu::jitLayout()
+struct JitCpuLayout
+{
+    int32_t A, X, Y, SP, P, PC;
+    int32_t jitCycles;
+    int32_t nProcessedInstr;
+};
+
+
+struct JitBlock
+{
+    JitCode code;
+    uint16_t nInstr;
+    uint16_t maxCycles;  // upper bound including page crossings and branches taken
+};
+
+
+class Jit
+{
+public:
+    static const uint32_t START_ADDR = 0x8000;
+    static const uint32_t END_ADDR = 0x10000;
+    static const uint32_t CODE_BUFFER_SIZE = 4 * 1024 * 1024;
+    static const uint32_t PAGE_SIZE = 4096;
+    static const uint32_t MAX_BLOCK_LEN = 64;
+    static const uint32_t MAX_BLOCK_CYCLES = 200;
+    static const uint32_t MAX_RUN_CYCLES = 2000;   // for chained blocks, must fit Cpu::m_nWaitCycles
+    static const uint8_t HOT_THRESHOLD = 8;
+    // blocks kept, dropped ones included, before starting over
+    static const uint32_t MAX_BLOCKS = 0x4000;
+
+    Jit(Bus* bus);
+    ~Jit();
+
+    static bool isSupported();
+
+    const JitBlock* lookup(uint16_t pc)
+    {
+        if (pc < START_ADDR)
+            return nullptr;
+
+        if (m_blockStarts[pc - START_ADDR] >= 0)
+            return &m_blocks[m_blockStarts[pc - START_ADDR]];
+
+        return compileIfHot(pc);
+    }
+    // see BlockCache::invalidate()
+    void invalidate(CodeWindows windows = ALL_CODE_WINDOWS);
+
+    void countRun(bool isComplete) { if (isComplete) m_nRuns++; else m_nBailouts++; }
+    void countFallback() { m_nFallbacks ++; }
+    uint64_t nRuns() { return m_nRuns; }
+    void printStats();
+
+private:
+    static const int32_t NO_BLOCK = -1;
+    static const int32_t NOT_COMPILABLE = -2;
+
+    Bus* m_bus;
+    JitCpuLayout m_layout;
+
+    uint8_t* m_codeBuffer;
+    size_t m_codeSize;
+
+    std::vector<JitBlock> m_blocks;
+    std::vector<int32_t> m_blockStarts;  // index in m_blocks of the block starting at each ROM address
+    std::vector<uint8_t> m_hotness;
+    std::vector<uint16_t> m_windowBlocks[N_CODE_WINDOWS];  // start PCs of the blocks overlapping each window
+
+    uint64_t m_nCompiledInstr;
+    uint64_t m_nRuns;
+    uint64_t m_nBailouts;
+    uint64_t m_nFallbacks;
+
+    const JitBlock* compileIfHot(uint16_t pc);
+    int32_t compile(uint16_t startPC);
+    void addToWindows(uint16_t startPC, CodeWindows windows);
+    JitCode emit(const std::vector<uint8_t>& code);
+};
+
+
+// true when an instruction can access addr without reaching I/O or
+// mapper registers: internal RAM, or ROM for operations that only read
+bool isJitSafeAccess(Operation operation, uint16_t addr);
@@ -1,7 +1,17 @@
 #pragma once
 
+#include "controller.hpp"
+
+// Host keyboard as the controller on port 1:
+// arrows, X = A, Z = B, right shift = Select, return = Start
 class Keyboard {
     public:
+        Keyboard(Controller* controller) : m_controller(controller) {}
+
+        // drains the pending SDL events, once per frame; false on quit
         bool handleEvents();
 
+    private:
+        Controller* m_controller;
+        uint8_t m_buttons = 0;
 };
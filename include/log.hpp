@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+#include "spsc_ring.hpp"
+
+
+//---- categorized logging ----
+// Messages below LOG_MIN_LEVEL (cmake -DLOG_MIN_LEVEL=<n>) are compiled
+// out; the others only cost a test of the runtime category mask when
+// their category is disabled.
+// Enabled messages are not formatted where they are logged: the format
+// string (a literal) and up to three integer arguments are pushed into
+// a lock-free ring, and formatted when the consumer drains it, e.g. the
+// emulator once per frame. Messages are dropped, never waited for,
+// when the ring is full
+
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0
+#endif
+
+enum class LogLevel : uint8_t
+{
+    Debug,
+    Info,
+    Warning,
+    Error
+};
+
+enum class LogCategory : uint8_t
+{
+    Cpu,
+    PpuReg,     // PPU register writes
+    Vram,       // nametable and palette writes
+    Dma,
+    Nmi,
+    Irq,        // IRQs taken, and mapper IRQ counter writes
+
+    N_CATEGORIES
+};
+
+const char* logCategoryName(LogCategory category);
+// category named as on the command line, e.g. "ppu-reg"; false if unknown
+bool parseLogCategory(const char* name, LogCategory& category);
+
+
+struct LogRecord
+{
+    const char* format;     // std::format syntax, with the arguments as {0} to {2}
+    uint32_t args[3];
+    LogCategory category;
+    LogLevel level;
+};
+
+
+class Log
+{
+public:
+    static const size_t RING_CAPACITY = 1 << 14;
+
+    static void setCategoryMask(uint32_t mask) { s_categoryMask = mask; }
+    static void enableCategory(LogCategory category) { s_categoryMask |= (1 << (int)category); }
+    static bool isEnabled(LogCategory category) { return (s_categoryMask & (1 << (int)category)) != 0; }
+
+    // producer side, the emulation thread
+    static void push(const LogRecord& record)
+    {
+        if (!s_ring.tryPush(record))
+            s_nDropped ++;
+    }
+
+    // consumer side: formats the pending records to file, returns how many
+    static size_t drain(FILE* file);
+
+    static uint64_t nDropped() { return s_nDropped; }
+
+private:
+    static inline uint32_t s_categoryMask = 0;
+    static inline SpscRing<LogRecord, RING_CAPACITY> s_ring;
+    static inline uint64_t s_nDropped = 0;
+};
+
+
+template<LogLevel level>
+inline void logMessage(LogCategory category, const char* format, uint32_t arg0 = 0, uint32_t arg1 = 0, uint32_t arg2 = 0)
+{
+    if constexpr ((int)level >= LOG_MIN_LEVEL)
+    {
+        if (Log::isEnabled(category))
+            Log::push({ format, { arg0, arg1, arg2 }, category, level });
+    }
+}
+
+inline void logDebug(LogCategory category, const char* format, uint32_t arg0 = 0, uint32_t arg1 = 0, uint32_t arg2 = 0)
+{
+    logMessage<LogLevel::Debug>(category, format, arg0, arg1, arg2);
+}
+
+inline void logInfo(LogCategory category, const char* format, uint32_t arg0 = 0, uint32_t arg1 = 0, uint32_t arg2 = 0)
+{
+    logMessage<LogLevel::Info>(category, format, arg0, arg1, arg2);
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cstdint>
+
+#include "ppu.hpp"
+
+class Bus;
+class Cartridge;
+class StateWriter;
+class StateReader;
+
+
+//---- cartridge mappers ----
+// A Mapper holds the bank registers of the cartridge and applies them
+// to the Bus as mappings: PRG banks are pages of the CPU memory map
+// (Bus::mapPrgRom()), CHR banks 1KB slots of the pattern tables
+// (Bus::mapChr()). A bank switch only swaps pointers when its register is
+// written, reads and tile fetches never look at the bank registers.
+// Writes to $8000-$FFFF reach writeRegister() with the PPU in sync with
+// the CPU, so that CHR and mirroring changes apply from the right dot.
+//
+// Supported iNES mappers: NROM (0), MMC1 (1), UxROM (2), CNROM (3)
+// and MMC3 (4), with its scanline IRQ
+
+class Mapper
+{
+public:
+    static const uint16_t NROM = 0;
+    static const uint16_t MMC1 = 1;
+    static const uint16_t UXROM = 2;
+    static const uint16_t CNROM = 3;
+    static const uint16_t MMC3 = 4;
+
+    // throws for unsupported mappers
+    static Mapper* create(Cartridge* cart, Bus* bus);
+
+    Mapper(Cartridge* cart, Bus* bus) : m_cart(cart), m_bus(bus) {}
+    virtual ~Mapper() {}
+
+    virtual const char* name() = 0;
+    // power-on banks
+    virtual void reset() = 0;
+    virtual void writeRegister(uint16_t, uint8_t) {}
+
+    // see Bus::clockScanlineCounter()
+    virtual void clockScanline() {}
+    // Event::ScanlineIrq
+    virtual void handleScanlineIrq() {}
+
+    // the registers; loading maps their banks again
+    virtual void saveState(StateWriter&) {}
+    virtual void loadState(StateReader&) {}
+
+protected:
+    Cartridge* m_cart;
+    Bus* m_bus;
+
+    // bank iBank of size bytes, wrapping around the ROM size;
+    // a negative iBank counts from the last bank
+    void mapPrg(uint16_t addr, uint32_t size, int32_t iBank);
+    void mapChr(uint16_t addr, uint32_t size, int32_t iBank);
+    void setMirroring(Mirroring mirroring);
+    // from the iNES header
+    Mirroring headerMirroring();
+};
+
+
+// fixed 16KB or 32KB of PRG ROM, 8KB of CHR
+class NromMapper : public Mapper
+{
+public:
+    using Mapper::Mapper;
+
+    const char* name() override { return "NROM"; }
+    void reset() override;
+};
+
+
+// serial port, 5 writes to $8000-$FFFF loading one register
+class Mmc1Mapper : public Mapper
+{
+public:
+    using Mapper::Mapper;
+
+    const char* name() override { return "MMC1"; }
+    void reset() override;
+    void writeRegister(uint16_t addr, uint8_t value) override;
+    void saveState(StateWriter& writer) override;
+    void loadState(StateReader& reader) override;
+
+private:
+    uint8_t m_shiftRegister;
+    uint8_t m_nShifts;
+    uint8_t m_control;
+    uint8_t m_chrBanks[2];
+    uint8_t m_prgBank;
+
+    void updateBanks();
+};
+
+
+// 16KB switchable at $8000, the last bank fixed at $C000
+class UxromMapper : public Mapper
+{
+public:
+    using Mapper::Mapper;
+
+    const char* name() override { return "UxROM"; }
+    void reset() override;
+    void writeRegister(uint16_t addr, uint8_t value) override;
+    void saveState(StateWriter& writer) override;
+    void loadState(StateReader& reader) override;
+
+private:
+    uint8_t m_prgBank;
+};
+
+
+// 8KB of CHR switchable
+class CnromMapper : public Mapper
+{
+public:
+    using Mapper::Mapper;
+
+    const char* name() override { return "CNROM"; }
+    void reset() override;
+    void writeRegister(uint16_t addr, uint8_t value) override;
+    void saveState(StateWriter& writer) override;
+    void loadState(StateReader& reader) override;
+
+private:
+    uint8_t m_chrBank;
+};
+
+
+// 8KB PRG and 1KB/2KB CHR banks, scanline counter IRQ, see mapper_mmc3.cpp
+class Mmc3Mapper : public Mapper
+{
+public:
+    using Mapper::Mapper;
+
+    const char* name() override { return "MMC3"; }
+    void reset() override;
+    void writeRegister(uint16_t addr, uint8_t value) override;
+    void clockScanline() override;
+    void handleScanlineIrq() override;
+    void saveState(StateWriter& writer) override;
+    void loadState(StateReader& reader) override;
+
+private:
+    uint8_t m_bankSelect;
+    uint8_t m_banks[8];
+
+    uint8_t m_irqLatch;
+    uint8_t m_irqCounter;
+    bool m_isIrqReload;
+    bool m_isIrqEnabled;
+
+    void updateBanks();
+    void scheduleIrq();
+};
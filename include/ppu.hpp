@@ -3,8 +3,20 @@
 #include <cstdint>
 
 class Bus;
+class StateWriter;
+class StateReader;
 
 
+// nametable layout of the 4 logical nametables, set by the cartridge
+enum class Mirroring
+{
+    Horizontal,         // $2000 = $2400, $2800 = $2C00
+    Vertical,           // $2000 = $2800, $2400 = $2C00
+    SingleScreenLow,
+    SingleScreenHigh,
+    FourScreen          // extra VRAM on the cartridge
+};
+
 
 class Ppu
 {
@@ -33,20 +45,62 @@ public:
     static const int SCREEN_HEIGHT = 240;
     static const uint16_t INTERNAL_RAM_SIZE = 0x1000;
     static const uint16_t PALETTE_RAM_SIZE = 0x20;
+    static const uint16_t DOTS_PER_SCANLINE = 341;
+    static const uint16_t SCANLINES_PER_FRAME = 262;
+    static const uint16_t VBLANK_SCANLINE = 241;
+    static const uint16_t PRE_RENDER_SCANLINE = 261;
+    static const uint32_t DOTS_PER_FRAME = DOTS_PER_SCANLINE * SCANLINES_PER_FRAME;
+    static const uint16_t N_SYSTEM_COLORS = 64;
+    static const uint8_t N_SPRITES = 64;
+    static const uint8_t MAX_LINE_SPRITES = 8;
+    // the dot at which the MMC3 scanline counter sees PPU A12 rise
+    static const uint16_t SCANLINE_COUNTER_DOT = 260;
 
     Ppu() { };
     uint16_t dot() { return m_dot; }
     uint16_t scanline() { return m_scanline; }
+    // palette indices, row-major: pixel (x, y) at SCREEN_WIDTH*y + x
     const uint8_t *frameBuffer() { return m_frameBuffer; }
+    // the same frame as RGBA8888 (0xRRGGBBAA), resolved line by line
+    // through the system palette; nullptr until setRgbaPalette()
+    const uint32_t *rgbaFrameBuffer() { return m_isRgbaEnabled ? m_rgbaFrameBuffer : nullptr; }
+    void setRgbaPalette(const uint32_t* palette);
+    const uint8_t *oamData() { return m_oamData; }
     uint8_t readRegister(Register reg);
     void writeRegister(Register reg, uint8_t value);
+    void writeOamDma(const uint8_t* data);
+    void setMirroring(Mirroring mirroring);
 
     void connect(Bus* bus) { m_bus = bus; }
     void reset(bool isAutoTest);
     void clock();
+    void run(uint32_t nDots);
     bool isFrameComplete() { return m_frameComplete; }
     void clearFrameComplete() { m_frameComplete = false; }
 
+    // see save_state.hpp; throws on an invalid position
+    void saveState(StateWriter& writer);
+    void loadState(StateReader& reader);
+
+    uint64_t nFastLines() { return m_nFastLines; }
+    uint64_t nDotLines() { return m_nDotLines; }
+    void printStats();
+
+    // scheduled frame events, see Bus::dispatchEvents()
+    void startVBlank(uint64_t timestamp);
+    void startPreRenderLine(uint64_t timestamp);
+    void completeFrame(uint64_t timestamp);
+
+    // from a time ahead of the PPU (that of the CPU), dots until the end of
+    // the next line where sprite 0 hit may be set, see ppu_sprites.cpp
+    uint32_t dotsUntilSpriteZeroLineEnd(uint64_t time);
+    // from the current position, dots until right after the nClocks-th
+    // next clock of the scanline counter, rendering staying enabled
+    uint32_t dotsUntilScanlineClock(uint32_t nClocks);
+    // position nDots after the current one, e.g. that of the CPU
+    // while the PPU lags behind
+    void positionAfter(uint32_t nDots, uint16_t& scanline, uint16_t& dot);
+
     void testNameTables();
     void fillDummyNameTable();
     void fillDummyPalette();
@@ -65,15 +119,27 @@ private:
     uint8_t  m_internalRegisterW = 0x00;
 
     uint8_t m_frameBuffer[SCREEN_WIDTH*SCREEN_HEIGHT] = {};
+    uint32_t m_rgbaFrameBuffer[SCREEN_WIDTH*SCREEN_HEIGHT] = {};
+    uint32_t m_rgbaPalette[N_SYSTEM_COLORS] = {};
+    bool m_isRgbaEnabled = false;
 
     uint8_t m_vram[INTERNAL_RAM_SIZE] = {};
+    // VRAM offset of each logical nametable; all distinct until setMirroring()
+    uint16_t m_nameTableOffsets[4] = { 0x0000, 0x0400, 0x0800, 0x0C00 };
     uint8_t m_paletteRam[PALETTE_RAM_SIZE] = {};
 
     uint16_t m_scanline;
     uint16_t m_dot;
     bool m_frameComplete;
     bool m_oddFrame = false;
+
+    // scanlines rendered by renderScanline(), or dot by dot by fetchAndRender()
+    uint64_t m_nFastLines = 0;
+    uint64_t m_nDotLines = 0;
     
+    // decoded row of the last fetched tile, see Cartridge::chrTileRow()
+    uint64_t m_patternRow;
+
     //shift registers
     uint16_t m_patternShiftHi;
     uint16_t m_patternShiftLo;
@@ -85,17 +151,36 @@ private:
     uint8_t m_attrEntry;
     uint8_t m_ppuDataBuffer;
 
-    uint8_t m_oamData[64*4];
+    uint8_t m_oamData[N_SPRITES*4];
+
+    // secondary OAM of the scanline, see ppu_sprites.cpp
+    struct LineSprite
+    {
+        uint64_t row;       // decoded pattern row, already flipped
+        uint8_t x;
+        uint8_t attr;
+        bool isSpriteZero;
+    };
+    LineSprite m_lineSprites[MAX_LINE_SPRITES];
+
+    // background pattern pixels (0 transparent) of the scanline being
+    // rendered, for sprite priority and sprite 0 hit
+    uint8_t m_bgPixels[SCREEN_WIDTH] = {};
 
     //DEBUG
     uint8_t m_paletteIndex;
     void renderPixel(uint8_t dx);
-    void renderOAMs();
     //
 
     uint8_t read(uint16_t addr);
     void write(uint16_t addr, uint8_t value);
     bool isPaletteAddress(uint16_t addr);
+    // VRAM offset of a nametable address, $2000-$3EFF
+    uint16_t mapNameTable(uint16_t addr)
+    {
+        addr &= 0x0FFF;
+        return m_nameTableOffsets[addr >> 10] | (addr & 0x03FF);
+    }
     
     uint8_t currentFineY();
     uint8_t currentCoarseX();
@@ -105,11 +190,19 @@ private:
     void incrementY();
 
     void fetchAndRender();
+    void renderScanline();
     void fetchAndRender__no();
     void fetchTile();
     void renderPixel();
     void updateShiftRegisters();
+    void resolveRgbaLine(uint16_t scanline);
+
+    uint8_t spriteHeight();
+    uint8_t evaluateSprites(uint16_t scanline);
+    void renderSprites();
 
     void renderFullFrame();
 
+    void scheduleFrameEvents();
+
 };
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+
+//---- profiler of the emulated code ----
+// Where a game spends its emulated time: instructions per opcode, cycles
+// per PC over the whole 64KB address space, and cycles spent in NMI
+// handlers vs the main loop.
+// Cpu only feeds the attached Profiler when built with CPU_PROFILER
+// (cmake -DCPU_PROFILER=ON), otherwise the hook is compiled out.
+// While profiling, every instruction goes through the interpreter: the
+// JIT and idle loop skipping are off, as when tracing
+
+class Profiler
+{
+public:
+    static const uint32_t ADDR_SPACE_SIZE = 0x10000;
+    static const uint16_t N_OPCODES = 0x100;
+    static const uint8_t RTI_OPCODE = 0x40;
+
+    Profiler();
+
+    static bool isCompiledIn();
+    void reset();
+
+    // called by Cpu after each interpreted instruction
+    void countInstruction(uint16_t pc, uint8_t opcode, uint16_t nCycles)
+    {
+        m_opcodeCounts[opcode] ++;
+        m_pcCycles[pc] += nCycles;
+        m_contextCycles[m_nmiDepth > 0] += nCycles;
+
+        // the RTI closing the handler still counts as NMI time
+        if (opcode == RTI_OPCODE && m_nmiDepth > 0)
+            m_nmiDepth --;
+    }
+
+    void enterNmi()
+    {
+        m_nmiDepth ++;
+        m_nNmis ++;
+    }
+
+    uint64_t nInstr();
+    uint64_t nCycles() { return m_contextCycles[0] + m_contextCycles[1]; }
+    uint64_t nNmiCycles() { return m_contextCycles[1]; }
+    uint64_t nNmis() { return m_nNmis; }
+    uint64_t opcodeCount(uint8_t opcode) { return m_opcodeCounts[opcode]; }
+    uint64_t pcCycles(uint16_t pc) { return m_pcCycles[pc]; }
+
+    // the nTop opcodes and PCs taking the most instructions and cycles
+    void printReport(uint32_t nTop);
+    // header, then the raw counters, see profiler.cpp
+    void writeDump(const char* path);
+
+private:
+    uint64_t m_opcodeCounts[N_OPCODES];
+    std::vector<uint64_t> m_pcCycles;
+    uint64_t m_contextCycles[2];    // main loop, NMI handlers
+    uint32_t m_nmiDepth;
+    uint64_t m_nNmis;
+};
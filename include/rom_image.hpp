@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+#if defined(__unix__) || defined(__APPLE__)
+#define ROM_MMAP_SUPPORTED
+#endif
+
+
+//---- read-only ROM image ----
+// The whole file, memory-mapped read-only where possible, so that the
+// cartridge data points into the page cache instead of being copied;
+// files that cannot be mapped (pipes, empty files, platforms without
+// mmap) are read into a buffer instead.
+// Images are shared: opening a file already open in this process, e.g.
+// by several emulator instances, returns the same image, which is
+// unmapped when its last user releases it
+
+class RomImage
+{
+public:
+    static std::shared_ptr<const RomImage> open(const char* path);
+
+    ~RomImage();
+    RomImage(const RomImage&) = delete;
+    RomImage& operator=(const RomImage&) = delete;
+
+    const uint8_t* data() const { return m_data; }
+    size_t size() const { return m_size; }
+    bool isMapped() const { return m_isMapped; }
+
+private:
+    RomImage() = default;
+
+    bool load(const char* path);
+    bool readAll(FILE* f);
+
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+    bool m_isMapped = false;
+    std::vector<uint8_t> m_buffer;     // fallback when not mapped
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+
+//---- save states ----
+// A snapshot of the whole machine: Cpu, Ppu, Bus (internal RAM,
+// controllers, scheduled events), Mapper registers and cartridge RAM.
+// Binary layout, see Bus::saveState(): a header (magic, version, the
+// cartridge it belongs to), then each component's fields in a fixed
+// order, as raw little-endian host values, mostly whole arrays, so both
+// saving and loading are little more than a series of memcpy: about
+// 15KB in a microsecond or two, cheap enough for a snapshot per frame.
+// Derived state is not saved but rebuilt on load: bank mappings from
+// the mapper registers, decoded CHR RAM tiles, the code caches.
+// The frame buffers are output, not state: they are only complete
+// again from the first frame started after loading.
+// Any change to the layout must bump STATE_VERSION
+
+class StateWriter
+{
+public:
+    // the buffer is cleared, its capacity kept for the next snapshot
+    StateWriter(std::vector<uint8_t>& buffer) : m_buffer(buffer) { m_buffer.clear(); }
+
+    void write(const void* data, size_t size)
+    {
+        size_t offset = m_buffer.size();
+        m_buffer.resize(offset + size);
+        memcpy(m_buffer.data() + offset, data, size);
+    }
+
+    template<typename T>
+    void write(const T& value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        write(&value, sizeof(T));
+    }
+
+private:
+    std::vector<uint8_t>& m_buffer;
+};
+
+
+// throws on reading past the end
+class StateReader
+{
+public:
+    StateReader(const uint8_t* data, size_t size) : m_data(data), m_size(size) {}
+
+    // the next size bytes, in place
+    const uint8_t* take(size_t size)
+    {
+        if (size > m_size - m_offset)
+            throw std::runtime_error("save state truncated");
+
+        const uint8_t* data = m_data + m_offset;
+        m_offset += size;
+        return data;
+    }
+
+    void read(void* data, size_t size) { memcpy(data, take(size), size); }
+
+    template<typename T>
+    void read(T& value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        read(&value, sizeof(T));
+    }
+
+    bool isAtEnd() { return m_offset == m_size; }
+
+private:
+    const uint8_t* m_data;
+    size_t m_size;
+    size_t m_offset = 0;
+};
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+
+//---- event scheduler ----
+// Timing events are scheduled ahead on the master clock, counted in PPU
+// dots since reset (3 per CPU cycle), instead of being polled for on
+// every dot or cycle: the execution loops only compare the current time
+// with nextTimestamp(), and Bus::dispatchEvents() handles the events due.
+// now() is the time of the PPU, which may lag behind the CPU, see
+// Bus::syncPpu().
+// Each event type is pending at most once, so the queue is a fixed
+// array with the earliest entry cached
+
+enum class Event
+{
+    VBlankStart,        // VBlank flag set, NMI asserted when enabled
+    PreRenderLine,      // VBlank and sprite flags cleared
+    FrameComplete,
+    OamDmaComplete,     // end of the CPU stall, the OAM page is transferred
+    ScanlineIrq,        // right after the mapper scanline counter may assert its IRQ
+
+    N_EVENTS
+};
+
+
+class Scheduler
+{
+public:
+    static const uint64_t NEVER = UINT64_MAX;
+
+    void reset()
+    {
+        m_now = 0;
+        for (auto& timestamp: m_timestamps)
+            timestamp = NEVER;
+        m_nextTimestamp = NEVER;
+        m_nextEvent = Event::N_EVENTS;
+    }
+
+    uint64_t now() { return m_now; }
+    void advanceTo(uint64_t time) { m_now = time; }
+
+    uint64_t nextTimestamp() { return m_nextTimestamp; }
+    // NEVER when not pending
+    uint64_t timestamp(Event event) { return m_timestamps[(int)event]; }
+    // from a time ahead of now(), e.g. that of the CPU while the PPU lags behind
+    uint32_t dotsUntilNextEvent(uint64_t time)
+    {
+        if (m_nextTimestamp <= time)
+            return 0;
+
+        return (uint32_t)std::min(m_nextTimestamp - time, (uint64_t)UINT32_MAX);
+    }
+
+    void schedule(Event event, uint64_t timestamp)
+    {
+        m_timestamps[(int)event] = timestamp;
+        if (timestamp < m_nextTimestamp)
+        {
+            m_nextTimestamp = timestamp;
+            m_nextEvent = event;
+        }
+        else if (event == m_nextEvent)
+            updateNext();
+    }
+
+    void cancel(Event event)
+    {
+        m_timestamps[(int)event] = NEVER;
+        if (event == m_nextEvent)
+            updateNext();
+    }
+
+    // earliest event due at the current time, if any
+    bool popDueEvent(Event& event, uint64_t& timestamp)
+    {
+        if (m_nextTimestamp > m_now)
+            return false;
+
+        event = m_nextEvent;
+        timestamp = m_nextTimestamp;
+        m_timestamps[(int)event] = NEVER;
+        updateNext();
+        return true;
+    }
+
+private:
+    uint64_t m_now;
+    uint64_t m_timestamps[(int)Event::N_EVENTS];
+    uint64_t m_nextTimestamp;
+    Event m_nextEvent;
+
+    void updateNext()
+    {
+        m_nextTimestamp = NEVER;
+        m_nextEvent = Event::N_EVENTS;
+        for (int i=0; i < (int)Event::N_EVENTS; i++)
+        {
+            if (m_timestamps[i] < m_nextTimestamp)
+            {
+                m_nextTimestamp = m_timestamps[i];
+                m_nextEvent = (Event)i;
+            }
+        }
+    }
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+
+//---- single-producer single-consumer ring buffer ----
+// Lock-free: the producer only writes m_head, the consumer only writes
+// m_tail, each keeping a cached copy of the other index so that the
+// shared cache line is only touched when the ring looks full (or empty).
+// Capacity must be a power of two
+
+template<typename T, size_t Capacity>
+class SpscRing
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+    SpscRing() : m_items(new T[Capacity]) {}
+
+    // producer side; false when the ring is full
+    bool tryPush(const T& item)
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_cachedTail == Capacity)
+        {
+            m_cachedTail = m_tail.load(std::memory_order_acquire);
+            if (head - m_cachedTail == Capacity)
+                return false;
+        }
+
+        m_items[head & (Capacity - 1)] = item;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side; copies up to maxItems into dest, returns how many
+    size_t popBulk(T* dest, size_t maxItems)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (m_cachedHead == tail)
+        {
+            m_cachedHead = m_head.load(std::memory_order_acquire);
+            if (m_cachedHead == tail)
+                return 0;
+        }
+
+        size_t nItems = std::min(m_cachedHead - tail, maxItems);
+        for (size_t i=0; i < nItems; i++)
+            dest[i] = m_items[(tail + i) & (Capacity - 1)];
+
+        m_tail.store(tail + nItems, std::memory_order_release);
+        return nItems;
+    }
+
+    bool isEmpty() const
+    {
+        return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+    }
+
+private:
+    std::unique_ptr<T[]> m_items;
+
+    alignas(64) std::atomic<size_t> m_head = 0;
+    size_t m_cachedTail = 0;        // producer's copy
+
+    alignas(64) std::atomic<size_t> m_tail = 0;
+    size_t m_cachedHead = 0;        // consumer's copy
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define TILE_DECODE_X86
+#endif
+
+
+//---- CHR tile row decoding ----
+// A tile row is stored as two bitplanes, the leftmost pixel in bit 7.
+// Decoding interleaves them into 8 pixels of one byte each, the leftmost
+// in the lowest byte of a uint64 (see Cartridge::chrTileRow()), and ORs
+// the palette offset given by the attribute bits (0, 4, 8 or 12) into
+// every pixel in the same pass.
+// Several kernels do the same work: a plain loop of shifts, a 256-entry
+// table spreading a plane byte over 8 bytes, BMI2 PDEP and SSE2, the
+// latter two only on x86-64 and only if the CPU has them
+
+enum class TileDecoder : uint8_t
+{
+    Scalar,
+    Lut,
+    Pdep,
+    Sse2,
+
+    N_DECODERS
+};
+
+const char* tileDecoderName(TileDecoder decoder);
+bool isTileDecoderSupported(TileDecoder decoder);
+// fastest decoder supported by this CPU
+TileDecoder bestTileDecoder();
+
+// one row, through the table
+uint64_t decodeTileRow(uint8_t plane1, uint8_t plane2, uint8_t attrBits=0);
+// the 8 rows of the 16-byte tile, into rows[8]
+void decodeTile(TileDecoder decoder, const uint8_t* tile, uint8_t attrBits, uint64_t* rows);
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include "spsc_ring.hpp"
+
+
+//---- binary CPU trace ----
+// One fixed-size record per instruction, captured before executing it
+// with the same fields as the nestest log; Cpu pushes the records into
+// a TraceWriter, whose background thread drains them to a file.
+// Text is only produced on demand by formatTraceRecord(), e.g. by the
+// trace-formatter tool
+
+struct TraceRecord
+{
+    uint64_t cycle;
+    uint16_t pc;
+    uint16_t scanline;
+    uint16_t dot;
+    uint8_t opcodeBytes[3];  // the formatter only shows those of the addressing mode
+    uint8_t A;
+    uint8_t X;
+    uint8_t Y;
+    uint8_t P;
+    uint8_t SP;
+};
+
+static_assert(sizeof(TraceRecord) == 24);
+
+// C000  4C F5 C5  JMP $C5F5                       A:00 X:00 Y:00 P:24 SP:FD PPU:  0, 21 CYC:7
+std::string formatTraceRecord(const TraceRecord& record);
+
+
+class TraceWriter
+{
+public:
+    static const size_t RING_CAPACITY = 1 << 14;
+    static const size_t WRITE_CHUNK = 4096;  // records per fwrite
+
+    TraceWriter(const char* path);
+    ~TraceWriter();
+
+    // blocks, waiting for the writer thread, only when the ring is full
+    void push(const TraceRecord& record)
+    {
+        while (!m_ring.tryPush(record))
+        {
+            m_nStalls ++;
+            std::this_thread::yield();
+        }
+    }
+
+    // stops the writer thread once all the records are on disk
+    void close();
+
+    uint64_t nRecords() { return m_nRecords; }
+    uint64_t nStalls() { return m_nStalls; }
+
+private:
+    FILE* m_file;
+    SpscRing<TraceRecord, RING_CAPACITY> m_ring;
+    std::thread m_thread;
+    std::atomic<bool> m_stopping;
+
+    std::atomic<uint64_t> m_nRecords;
+    uint64_t m_nStalls;
+
+    void drain();
+};
+
+
+class TraceReader
+{
+public:
+    TraceReader(const char* path);
+    ~TraceReader();
+
+    bool next(TraceRecord& record);
+
+private:
+    FILE* m_file;
+};
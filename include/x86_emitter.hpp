@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+
+//---- minimal x86-64 assembler ----
+// Only the instruction forms the JIT emits, appended to a byte vector.
+// Register operands are 32-bit unless the name says otherwise: byte
+// operations always get a REX prefix, so that registers 4-7 are
+// SPL/BPL/SIL/DIL and never AH-BH.
+// Jumps all take a rel32 to a Label, patched by finish() when the label
+// was bound after the jump
+
+enum X86Reg : uint8_t
+{
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15,
+    NO_REG = 0xFF
+};
+
+enum class X86Cond : uint8_t
+{
+    O, NO, B, AE, E, NE, BE, A, S, NS, P, NP, L, GE, LE, G
+};
+
+// the 8 classic ALU operations, in encoding order
+enum class X86Alu : uint8_t
+{
+    Add, Or, Adc, Sbb, And, Sub, Xor, Cmp
+};
+
+// rotates and shifts, in encoding order
+enum class X86Shift : uint8_t
+{
+    Rol, Ror, Rcl, Rcr, Shl, Shr
+};
+
+// [base + index*scale + disp]
+struct X86Mem
+{
+    X86Reg base;
+    int32_t disp = 0;
+    X86Reg index = NO_REG;
+    uint8_t scale = 1;
+};
+
+using X86Label = uint32_t;
+
+
+class X86Emitter
+{
+public:
+    const std::vector<uint8_t>& code() { return m_code; }
+
+    X86Label newLabel();
+    void bind(X86Label label);
+    // patches the jumps to labels bound after them
+    void finish();
+
+    void mov(X86Reg dst, X86Reg src);
+    void mov64(X86Reg dst, X86Reg src);
+    void movImm(X86Reg dst, uint32_t imm);
+    void movImm64(X86Reg dst, uint64_t imm);
+    void movzx8(X86Reg dst, X86Mem src);
+    void movzx8(X86Reg dst, X86Reg src);
+    void movzx16(X86Reg dst, X86Reg src);
+    void load64(X86Reg dst, X86Mem src);
+    void store8(X86Mem dst, X86Reg src);
+    void store16Imm(X86Mem dst, uint16_t imm);
+    void lea(X86Reg dst, X86Mem src);
+
+    void alu(X86Alu op, X86Reg dst, X86Reg src);
+    void alu8(X86Alu op, X86Reg dst, X86Reg src);
+    void aluImm(X86Alu op, X86Reg dst, int32_t imm);
+    void aluImm64(X86Alu op, X86Reg dst, int8_t imm);
+    void alu8Imm(X86Alu op, X86Reg dst, uint8_t imm);
+    void aluMemImm(X86Alu op, X86Mem dst, int32_t imm);
+    void aluMem(X86Alu op, X86Mem dst, X86Reg src);
+    void cmp64(X86Reg a, X86Reg b);
+    void test(X86Reg a, X86Reg b);
+    void test64(X86Reg a, X86Reg b);
+    void testImm(X86Reg reg, uint32_t imm);
+
+    // by one bit
+    void shift8(X86Shift op, X86Reg reg);
+    void shiftImm(X86Shift op, X86Reg reg, uint8_t count);
+    void btImm(X86Reg reg, uint8_t bit);
+    void cmc();
+    void setcc(X86Cond cond, X86Reg dst);
+
+    void push(X86Reg reg);
+    void pop(X86Reg reg);
+    void call(X86Reg target);
+    void ret();
+    void jmp(X86Label target);
+    void jcc(X86Cond cond, X86Label target);
+
+private:
+    // W set for 64-bit operands; byte operations always carry a REX
+    enum class Size { Byte, Dword, Qword };
+
+    struct Fixup
+    {
+        size_t pos;         // of the rel32
+        X86Label target;
+    };
+
+    std::vector<uint8_t> m_code;
+    std::vector<size_t> m_labels;  // code offset of each label, UNBOUND_LABEL until bound
+    std::vector<Fixup> m_fixups;
+
+    void emitBytes(std::initializer_list<uint8_t> bytes);
+    void emitImm16(uint16_t value);
+    void emitImm32(uint32_t value);
+    void emitRex(Size size, uint8_t reg, uint8_t index, uint8_t base);
+    // reg is a register or an opcode extension
+    void emitMem(Size size, std::initializer_list<uint8_t> opcode, uint8_t reg, X86Mem mem);
+    void emitReg(Size size, std::initializer_list<uint8_t> opcode, uint8_t reg, uint8_t rm);
+    void emitRel32(X86Label target);
+};
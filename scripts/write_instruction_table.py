@@ -1,6 +1,16 @@
 #!/bin/env python3
 
+import sys
+
+
 def main():
+    if len(sys.argv) > 1 and sys.argv[1] == "--switch":
+        write_switch_core()
+    else:
+        write_lookup_table()
+
+
+def write_lookup_table():
     with open("instruction_list.txt", "r") as f:
         file_lines = f.readlines()
     
@@ -46,9 +56,16 @@ def main():
         else:
             raise ValueError(f"Unmapped mode_str: {mode_str}")
         
-        #"instructionLookupTable[0x10] = { "BPL", &Cpu::OpBPL, &Cpu::AddrREL, 2 };"
-        #instructionLookupTable[0x10] = { "BPL", &Cpu::OpBPL, &Cpu::AddrREL, 2 };
-        print(f"instructionLookupTable[0x{hex[1:]}] = {{ \"{mnemonic}\", &Cpu::Op{mnemonic}, &Cpu::Addr{addr_mode}, {n_bytes}, {n_cycles} }};")
+        #table[0x10] = { Operation::BPL, AddrMode::REL, 2, 2 };
+        print(f"table[0x{hex[1:]}] = {{ Operation::{mnemonic}, AddrMode::{addr_mode}, {n_bytes}, {n_cycles} }};")
+
+
+
+def write_switch_core():
+    # every case reads its addressing mode, operation and cycles
+    # from the constexpr instructionLookupTable in include/instructions.hpp
+    for opcode in range(256):
+        print(f"        case 0x{opcode:02X}: fused<0x{opcode:02X}>(); break;")
 
 
 
@@ -0,0 +1,141 @@
+#include "battery_ram.hpp"
+
+#include <cstdio>
+#include <filesystem>
+#include <format>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+
+#ifdef ROM_MMAP_SUPPORTED
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+
+// save files owned in the process, by canonical path
+static std::mutex s_ownersMutex;
+static std::set<std::string> s_owners;
+
+
+BatteryRam::BatteryRam(const char* path, size_t size)
+{
+    m_path = path;
+    m_size = size;
+
+    std::error_code error;
+    m_ownerKey = fs::weakly_canonical(path, error).string();
+    if (error)
+        m_ownerKey = path;
+
+    {
+        std::lock_guard<std::mutex> lock(s_ownersMutex);
+        m_isOwner = s_owners.insert(m_ownerKey).second;
+    }
+
+    try {
+        if (!map())
+            read();
+    } catch (...) {
+        if (m_isOwner)
+        {
+            std::lock_guard<std::mutex> lock(s_ownersMutex);
+            s_owners.erase(m_ownerKey);
+        }
+        throw;
+    }
+}
+
+BatteryRam::~BatteryRam()
+{
+    flush();
+
+#ifdef ROM_MMAP_SUPPORTED
+    if (m_isMapped)
+        munmap(m_data, m_size);
+#endif
+
+    if (m_isOwner)
+    {
+        std::lock_guard<std::mutex> lock(s_ownersMutex);
+        s_owners.erase(m_ownerKey);
+    }
+}
+
+
+// The RAM goes to a new file replacing the save file, which is never
+// truncated: it may be the mapped one backing the RAM being written
+bool BatteryRam::flush()
+{
+    if (!m_isOwner)
+        return true;
+
+    std::string tmpPath = m_path + ".tmp";
+    FILE* f = fopen(tmpPath.c_str(), "wb");
+    if (f == nullptr)
+        return false;
+
+    bool isWritten = (fwrite(m_data, sizeof(uint8_t), m_size, f) == m_size);
+    isWritten &= (fclose(f) == 0);
+
+    std::error_code error;
+    if (isWritten)
+        fs::rename(tmpPath, m_path, error);
+    if (!isWritten || error)
+    {
+        fs::remove(tmpPath, error);
+        return false;
+    }
+    return true;
+}
+
+
+// Only a file of exactly the RAM size is mapped: past its end, pages
+// could not be accessed
+bool BatteryRam::map()
+{
+#ifdef ROM_MMAP_SUPPORTED
+    int fd = open(m_path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    bool isSized = (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && (size_t)st.st_size == m_size);
+
+    // the mapping outlives the descriptor; writes go to private copies
+    void* data = (isSized ? mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0) : MAP_FAILED);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    m_data = (uint8_t*)data;
+    m_isMapped = true;
+    return true;
+#else
+    return false;
+#endif
+}
+
+// a shorter file is padded with zeros, a longer one cut
+void BatteryRam::read()
+{
+    m_buffer.assign(m_size, 0x00);
+    m_data = m_buffer.data();
+    m_isMapped = false;
+
+    // a missing file is a new save
+    FILE* f = fopen(m_path.c_str(), "rb");
+    if (f == nullptr)
+        return;
+
+    size_t nRead = fread(m_buffer.data(), sizeof(uint8_t), m_size, f);
+    bool isError = ferror(f);
+    fclose(f);
+
+    if (isError)
+        throw std::runtime_error(std::format("cannot read save file [{}]; {} bytes read", m_path, nRead));
+}
@@ -0,0 +1,380 @@
+#include "bus.hpp"
+#include "cartridge.hpp"
+#include "tile_decode.hpp"
+
+#include <print>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <vector>
+
+
+// nestest in automated mode starts at $C000 and ends at this cycle count,
+// see nestest/nestest.txt
+static const uint32_t NESTEST_CYCLES = 26554;
+static const int N_NESTEST_RUNS = 1000;
+static const int N_TRACE_RUNS = 100;
+
+// shift-heavy loop: accumulator and memory variants of ASL/LSR/ROL/ROR,
+// then JMP back to the first shift. Run from RAM, then from the PRG ROM
+// of an NROM image, which only the cached and jit cores compile
+static const uint16_t SHIFTS_RAM_ADDR = 0x0200;
+static const uint16_t SHIFTS_ROM_ADDR = 0x8000;
+static const uint8_t SHIFTS_PROGRAM[] = {
+    0xA9, 0x01,         // LDA #$01
+    0xA2, 0x01,         // LDX #$01
+    0x0A,               // ASL A
+    0x2A,               // ROL A
+    0x4A,               // LSR A
+    0x6A,               // ROR A
+    0x06, 0x10,         // ASL $10
+    0x26, 0x10,         // ROL $10
+    0x46, 0x11,         // LSR $11
+    0x66, 0x11,         // ROR $11
+    0x16, 0x10,         // ASL $10,X
+    0x5E, 0x00, 0x03,   // LSR $0300,X
+    0x2E, 0x00, 0x03,   // ROL $0300
+    0x7E, 0x00, 0x03,   // ROR $0300,X
+    0x4C, 0x04, 0x00,   // JMP start+4, high byte added when loaded
+};
+static const uint32_t SHIFTS_CYCLES = 30000000;
+
+static const int N_TILE_DECODE_RUNS = 20000;
+
+static const int N_SPRITE_FRAMES = 2000;
+
+static const int N_STATE_RUNS = 100000;
+
+enum class SpriteLayout
+{
+    None,       // OAM all off screen
+    Spread,     // 8 bands of 8 sprites side by side
+    Stacked,    // all 64 on the same lines, overflowing every one of them
+};
+
+
+const char* coreName(CpuCore core);
+void benchmarkCpuCore(Cartridge* cart, CpuCore core);
+std::vector<uint8_t> shiftsProgram(uint16_t startAddr);
+Cartridge* newShiftsCartridge();
+void benchmarkShifts(Cartridge* cart, CpuCore core, uint16_t startAddr);
+void benchmarkTracing(Cartridge* cart);
+void benchmarkTileDecode(Cartridge* cart, TileDecoder decoder);
+void benchmarkSprites(Cartridge* cart, SpriteLayout layout);
+void benchmarkSaveState(Cartridge* cart);
+
+
+int main(int argc, char* argv[])
+{
+    const char* romPath = (argc < 2 ? "nestest/nestest.nes" : argv[1]);
+
+    Cartridge* cart;
+    try {
+        cart = new Cartridge(romPath);
+    } catch (const std::exception& e)  {
+        std::println("!! Error loading cartridge: {}", e.what());
+        exit(1);
+    }
+
+    std::println("-- CPU core benchmark; {} runs of {}", N_NESTEST_RUNS, romPath);
+    benchmarkCpuCore(cart, CpuCore::Table);
+    benchmarkCpuCore(cart, CpuCore::Switch);
+    benchmarkCpuCore(cart, CpuCore::Cached);
+    benchmarkCpuCore(cart, CpuCore::Jit);
+
+    std::println("-- shift-heavy micro-benchmark from RAM; {} cycles", SHIFTS_CYCLES);
+    benchmarkShifts(cart, CpuCore::Table, SHIFTS_RAM_ADDR);
+    benchmarkShifts(cart, CpuCore::Switch, SHIFTS_RAM_ADDR);
+    benchmarkShifts(cart, CpuCore::Jit, SHIFTS_RAM_ADDR);
+
+    std::println("-- shift-heavy micro-benchmark from ROM; {} cycles", SHIFTS_CYCLES);
+    Cartridge* shiftsCart = newShiftsCartridge();
+    benchmarkShifts(shiftsCart, CpuCore::Table, SHIFTS_ROM_ADDR);
+    benchmarkShifts(shiftsCart, CpuCore::Switch, SHIFTS_ROM_ADDR);
+    benchmarkShifts(shiftsCart, CpuCore::Cached, SHIFTS_ROM_ADDR);
+    benchmarkShifts(shiftsCart, CpuCore::Jit, SHIFTS_ROM_ADDR);
+    delete shiftsCart;
+
+    std::println("-- binary trace; {} runs of {}", N_TRACE_RUNS, romPath);
+    benchmarkTracing(cart);
+
+    std::println("-- CHR tile decoding; {} runs over the first CHR block", N_TILE_DECODE_RUNS);
+    for (int i=0; i < (int)TileDecoder::N_DECODERS; i++)
+        benchmarkTileDecode(cart, (TileDecoder)i);
+
+    std::println("-- PPU frames with a full OAM; {} frames", N_SPRITE_FRAMES);
+    benchmarkSprites(cart, SpriteLayout::None);
+    benchmarkSprites(cart, SpriteLayout::Spread);
+    benchmarkSprites(cart, SpriteLayout::Stacked);
+
+    std::println("-- save states; {} saves and loads", N_STATE_RUNS);
+    benchmarkSaveState(cart);
+}
+
+
+const char* coreName(CpuCore core)
+{
+    switch (core)
+    {
+        case CpuCore::Switch: return "switch";
+        case CpuCore::Cached: return "cached";
+        case CpuCore::Jit:    return "jit";
+        default:              return "table";
+    }
+}
+
+
+void benchmarkCpuCore(Cartridge* cart, CpuCore core)
+{
+    auto bus = new Bus();
+    bus->insertCartridge(cart);
+
+    uint64_t nInstr = 0;
+    uint64_t nCycles = 0;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int iRun=0; iRun < N_NESTEST_RUNS; iRun++)
+    {
+        bus->reset(true);
+        bus->cpu()->setCore(core);
+
+        while (bus->cpu()->nTotCycles() < NESTEST_CYCLES)
+            bus->cpu()->step();
+
+        nInstr  += bus->cpu()->nProcessedInstr();
+        nCycles += bus->cpu()->nTotCycles();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    std::println("{:6s} core: {:10d} instructions in {:.3f} s; {:.2f} Minstr/s, {:.2f} emulated MHz",
+        coreName(core), nInstr, seconds,
+        nInstr / seconds / 1e6, nCycles / seconds / 1e6);
+
+    if (core == CpuCore::Cached)
+        bus->cpu()->blockCache().printStats();
+    if (core == CpuCore::Jit && bus->cpu()->jit() != nullptr)
+        bus->cpu()->jit()->printStats();
+
+    delete bus;
+}
+
+
+std::vector<uint8_t> shiftsProgram(uint16_t startAddr)
+{
+    std::vector<uint8_t> program(std::begin(SHIFTS_PROGRAM), std::end(SHIFTS_PROGRAM));
+    program.back() += startAddr >> 8;
+    return program;
+}
+
+// 16KB of PRG with the program at $8000, 8KB of blank CHR
+Cartridge* newShiftsCartridge()
+{
+    std::vector<uint8_t> rom = { 'N', 'E', 'S', 0x1A, 1, 1, 0x00, 0x00 };
+    rom.resize(Cartridge::HEADER_SIZE, 0x00);
+    rom.resize(Cartridge::HEADER_SIZE + 0x4000 + 0x2000, 0x00);
+
+    std::vector<uint8_t> program = shiftsProgram(SHIFTS_ROM_ADDR);
+    std::copy(program.begin(), program.end(), rom.begin() + Cartridge::HEADER_SIZE);
+
+    auto romPath = std::filesystem::temp_directory_path() / "benchmark_shifts.nes";
+    FILE* f = fopen(romPath.string().c_str(), "wb");
+    fwrite(rom.data(), 1, rom.size(), f);
+    fclose(f);
+
+    auto cart = new Cartridge(romPath.string().c_str());
+    std::filesystem::remove(romPath);
+    return cart;
+}
+
+void benchmarkShifts(Cartridge* cart, CpuCore core, uint16_t startAddr)
+{
+    auto bus = new Bus();
+    bus->insertCartridge(cart);
+    bus->reset(true);
+    bus->cpu()->setCore(core);
+
+    if (startAddr < SHIFTS_ROM_ADDR)
+    {
+        std::vector<uint8_t> program = shiftsProgram(startAddr);
+        for (uint16_t i=0; i < program.size(); i++)
+            bus->write(startAddr + i, program[i]);
+    }
+    bus->cpu()->setPC(startAddr);
+
+    // with the PPU catching up on its events, past which the jit core
+    // would not run blocks
+    auto start = std::chrono::high_resolution_clock::now();
+    while (bus->cpu()->nTotCycles() < SHIFTS_CYCLES)
+    {
+        bus->runCycles(SHIFTS_CYCLES - bus->cpu()->nTotCycles());
+        bus->ppu()->clearFrameComplete();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    uint64_t nInstr = bus->cpu()->nProcessedInstr();
+    double seconds = std::chrono::duration<double>(end - start).count();
+    std::println("{:6s} core: {:10d} instructions in {:.3f} s; {:.2f} Minstr/s, {:.2f} emulated MHz",
+        coreName(core), nInstr, seconds,
+        nInstr / seconds / 1e6, bus->cpu()->nTotCycles() / seconds / 1e6);
+
+    if (core == CpuCore::Jit && bus->cpu()->jit() != nullptr)
+        bus->cpu()->jit()->printStats();
+
+    delete bus;
+}
+
+
+// table core with and without a TraceWriter attached
+void benchmarkTracing(Cartridge* cart)
+{
+    auto tracePath = std::filesystem::temp_directory_path() / "benchmark.trace";
+    double nsPerInstr[2];
+    TraceWriter* writer = nullptr;
+
+    for (int isTracing=0; isTracing < 2; isTracing++)
+    {
+        auto bus = new Bus();
+        bus->insertCartridge(cart);
+        if (isTracing)
+            writer = new TraceWriter(tracePath.string().c_str());
+
+        uint64_t nInstr = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int iRun=0; iRun < N_TRACE_RUNS; iRun++)
+        {
+            bus->reset(true);
+            bus->cpu()->setTraceWriter(writer);
+
+            while (bus->cpu()->nTotCycles() < NESTEST_CYCLES)
+                bus->cpu()->step();
+
+            nInstr += bus->cpu()->nProcessedInstr();
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+
+        nsPerInstr[isTracing] = std::chrono::duration<double, std::nano>(end - start).count() / nInstr;
+        delete bus;
+    }
+
+    writer->close();
+    std::println("table core: {:.1f} ns/instr untraced, {:.1f} ns/instr traced; {} records written, {} stalls on a full ring",
+        nsPerInstr[0], nsPerInstr[1], writer->nRecords(), writer->nStalls());
+
+    delete writer;
+    std::filesystem::remove(tracePath);
+}
+
+
+// the 512 tiles of a CHR block, through each kernel, with a palette
+// offset changing every tile as when rendering
+void benchmarkTileDecode(Cartridge* cart, TileDecoder decoder)
+{
+    if (!isTileDecoderSupported(decoder))
+    {
+        std::println("{:6s}: not supported", tileDecoderName(decoder));
+        return;
+    }
+
+    static const uint32_t N_TILES = Cartridge::CHR_BLOCK_SIZE / Cartridge::TILE_SIZE;
+
+    // a cartridge without CHR ROM decodes a pseudo-random block
+    std::vector<uint8_t> chr(Cartridge::CHR_BLOCK_SIZE);
+    for (uint32_t addr=0; addr < chr.size(); addr++)
+        chr[addr] = (cart->nCharBlocks() > 0 ? cart->chrData(0, addr) : (uint8_t)(addr * 0x9E3779B1 >> 24));
+
+    std::vector<uint64_t> rows(N_TILES * Cartridge::N_TILE_ROWS);
+    uint64_t checksum = 0;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int iRun=0; iRun < N_TILE_DECODE_RUNS; iRun++)
+    {
+        for (uint32_t iTile=0; iTile < N_TILES; iTile++)
+            decodeTile(decoder, &chr[iTile * Cartridge::TILE_SIZE], (iTile & 0x3) << 2, &rows[iTile * Cartridge::N_TILE_ROWS]);
+
+        checksum += rows[iRun % rows.size()];
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    uint64_t nTiles = (uint64_t)N_TILES * N_TILE_DECODE_RUNS;
+    std::println("{:6s}: {:10d} tiles in {:.3f} s; {:.1f} Mtiles/s, {:.2f} ns/tile [checksum {:016X}]",
+        tileDecoderName(decoder), nTiles, seconds,
+        nTiles / seconds / 1e6, seconds * 1e9 / nTiles, checksum);
+}
+
+
+// the PPU alone, background and sprites enabled, over the 64 sprites of
+// the layout: mixed palettes, flips and priorities
+void benchmarkSprites(Cartridge* cart, SpriteLayout layout)
+{
+    auto bus = new Bus();
+    bus->insertCartridge(cart);
+    bus->reset(true);
+
+    Ppu* ppu = bus->ppu();
+    ppu->writeRegister(Ppu::Register::PPUMASK, 0x1E);
+
+    uint8_t oam[Ppu::N_SPRITES * 4];
+    for (uint8_t i=0; i < Ppu::N_SPRITES; i++)
+    {
+        uint8_t y = 0xFF;
+        uint8_t x = 0;
+        if (layout == SpriteLayout::Spread)
+        {
+            y = (i / 8) * 28;
+            x = (i % 8) * 32;
+        }
+        else if (layout == SpriteLayout::Stacked)
+        {
+            y = 100;
+            x = i * 4;
+        }
+
+        oam[4*i + 0] = y;
+        oam[4*i + 1] = 2 + (i % 8);     // tiles with pixels in nestest's CHR
+        oam[4*i + 2] = (i & 0x03) | ((i & 0x1C) << 3);
+        oam[4*i + 3] = x;
+    }
+    ppu->writeOamDma(oam);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int iFrame=0; iFrame < N_SPRITE_FRAMES; iFrame++)
+        ppu->run(Ppu::DOTS_PER_FRAME);
+    auto end = std::chrono::high_resolution_clock::now();
+
+    static const char* layoutNames[] = { "none", "spread", "stacked" };
+    double seconds = std::chrono::duration<double>(end - start).count();
+    std::println("{:7s} sprites: {} frames in {:.3f} s; {:.0f} fps, {:.1f} us/frame",
+        layoutNames[(int)layout], N_SPRITE_FRAMES, seconds,
+        N_SPRITE_FRAMES / seconds, seconds * 1e6 / N_SPRITE_FRAMES);
+
+    delete bus;
+}
+
+
+// snapshots of nestest halfway, into the same buffer as when taken every frame
+void benchmarkSaveState(Cartridge* cart)
+{
+    auto bus = new Bus();
+    bus->insertCartridge(cart);
+    bus->reset(true);
+    while (bus->cpu()->nTotCycles() < NESTEST_CYCLES / 2)
+        bus->runCycles(1);
+
+    std::vector<uint8_t> state;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int iRun=0; iRun < N_STATE_RUNS; iRun++)
+        bus->saveState(state);
+    auto mid = std::chrono::high_resolution_clock::now();
+    for (int iRun=0; iRun < N_STATE_RUNS; iRun++)
+        bus->loadState(state.data(), state.size());
+    auto end = std::chrono::high_resolution_clock::now();
+
+    double saveSeconds = std::chrono::duration<double>(mid - start).count();
+    double loadSeconds = std::chrono::duration<double>(end - mid).count();
+    std::println("{} bytes: save {:.2f} us, load {:.2f} us",
+        state.size(), saveSeconds * 1e6 / N_STATE_RUNS, loadSeconds * 1e6 / N_STATE_RUNS);
+
+    delete bus;
+}
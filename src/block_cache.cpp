@@ -0,0 +1,189 @@
+#include "block_cache.hpp"
+
+#include "bus.hpp"
+#include "cpu.hpp"
+#include "instructions.hpp"
+
+#include <algorithm>
+#include <print>
+
+
+BlockCache::BlockCache()
+{
+    m_bus = nullptr;
+    m_blockStarts.assign(END_ADDR - START_ADDR, NO_BLOCK);
+    m_instrs.clear();
+    m_nextInstr = NO_BLOCK;
+
+    resetStats();
+}
+
+// Dropped blocks are only unlinked, their instructions staying in
+// m_instrs until it fills up
+void BlockCache::invalidate(CodeWindows windows)
+{
+    m_nextInstr = NO_BLOCK;
+    m_nInvalidations ++;
+
+    // nothing decoded since the last time, e.g. with the table core
+    if (m_instrs.empty())
+        return;
+
+    if (windows == ALL_CODE_WINDOWS || m_instrs.size() >= MAX_INSTRS)
+    {
+        m_instrs.clear();
+        std::fill(m_blockStarts.begin(), m_blockStarts.end(), NO_BLOCK);
+        for (auto& blocks: m_windowBlocks)
+            blocks.clear();
+        return;
+    }
+
+    for (int i=0; i < N_CODE_WINDOWS; i++)
+    {
+        if (!(windows & (1 << i)))
+            continue;
+
+        for (uint16_t startPC: m_windowBlocks[i])
+            m_blockStarts[startPC - START_ADDR] = NO_BLOCK;
+        m_windowBlocks[i].clear();
+    }
+}
+
+void BlockCache::resetStats()
+{
+    m_nHits = 0;
+    m_nMisses = 0;
+    m_nDecodedInstr = 0;
+    m_nInvalidations = 0;
+}
+
+void BlockCache::printStats()
+{
+    uint64_t nLookups = m_nHits + m_nMisses;
+    std::println("block cache: {} hits, {} misses ({:.2f}% hit rate); {} instructions decoded in {} blocks; {} invalidations",
+        m_nHits, m_nMisses, (nLookups == 0 ? 0.0 : 100.0 * m_nHits / nLookups),
+        m_nDecodedInstr, m_nMisses, m_nInvalidations);
+}
+
+
+const DecodedInstr& BlockCache::fetch(uint16_t pc)
+{
+    int32_t iInstr;
+    if (m_nextInstr != NO_BLOCK && pc == m_nextPC)
+    {
+        iInstr = m_nextInstr;
+        m_nHits ++;
+    }
+    else
+    {
+        iInstr = m_blockStarts[pc - START_ADDR];
+        if (iInstr == NO_BLOCK)
+        {
+            iInstr = decodeBlock(pc);
+            m_nMisses ++;
+        }
+        else
+            m_nHits ++;
+    }
+
+    const DecodedInstr& instr = m_instrs[iInstr];
+    if (instr.isBlockEnd)
+        m_nextInstr = NO_BLOCK;
+    else
+    {
+        m_nextInstr = iInstr + 1;
+        m_nextPC = pc + instr.nBytes;
+    }
+
+    return instr;
+}
+
+
+int32_t BlockCache::decodeBlock(uint16_t startPC)
+{
+    int32_t iFirst = m_instrs.size();
+    uint32_t pc = startPC;
+
+    for (uint32_t i=0; i < MAX_BLOCK_LEN; i++)
+    {
+        DecodedInstr decoded = decodeInstr(m_bus, pc);
+
+        pc += decoded.nBytes;
+        decoded.isBlockEnd = (endsBlock(decoded.operation) || i == MAX_BLOCK_LEN - 1 || pc + 3 > END_ADDR);
+        m_instrs.push_back(decoded);
+        m_nDecodedInstr ++;
+
+        if (decoded.isBlockEnd)
+            break;
+    }
+
+    m_blockStarts[startPC - START_ADDR] = iFirst;
+
+    CodeWindows windows = codeWindows(startPC, pc - 1);
+    for (int i=0; i < N_CODE_WINDOWS; i++)
+    {
+        if (windows & (1 << i))
+            m_windowBlocks[i].push_back(startPC);
+    }
+
+    return iFirst;
+}
+
+
+DecodedInstr BlockCache::decodeInstr(Bus* bus, uint16_t pc)
+{
+    uint8_t opcode = bus->read(pc);
+    const Instruction& instr = instructionLookupTable[opcode];
+
+    DecodedInstr decoded;
+    decoded.addrMode = nullptr;
+    decoded.operate = cpuOpcodeOperations[opcode];
+    decoded.targetAddress = 0x0000;
+    decoded.opcode = opcode;
+    decoded.operation = instr.operation;
+    decoded.nCycles = instr.nCycles;
+    decoded.nBytes = addrModeBytes(instr.addrMode);
+    decoded.isBlockEnd = false;
+
+    // operands not depending on registers or RAM are resolved here
+    switch (instr.addrMode)
+    {
+        case AddrMode::IMP:
+        case AddrMode::ACC:
+            break;
+        case AddrMode::IMM:
+            decoded.targetAddress = pc + 1;
+            break;
+        case AddrMode::ZP0:
+            decoded.targetAddress = bus->read(pc + 1);
+            break;
+        case AddrMode::ABS:
+            decoded.targetAddress = (bus->read(pc + 2) << 8) | bus->read(pc + 1);
+            break;
+        case AddrMode::REL:
+            decoded.targetAddress = pc + 2 + (int8_t)bus->read(pc + 1);
+            break;
+        default:
+            // operand fetched by the addressing mode after the opcode
+            decoded.addrMode = cpuAddrModes[(int)instr.addrMode];
+            break;
+    }
+
+    return decoded;
+}
+
+
+bool endsBlock(Operation operation)
+{
+    switch (operation)
+    {
+        case Operation::BCC: case Operation::BCS: case Operation::BEQ: case Operation::BMI:
+        case Operation::BNE: case Operation::BPL: case Operation::BVC: case Operation::BVS:
+        case Operation::JMP: case Operation::JSR: case Operation::RTS: case Operation::RTI:
+        case Operation::BRK:
+        case Operation::Unknown:
+            return true;
+        default:
+            return false;
+    }
+}
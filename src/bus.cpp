@@ -1,5 +1,8 @@
 #include "bus.hpp"
 
+#include "mapper.hpp"
+
+#include <algorithm>
 #include <print>
 
 
@@ -29,127 +32,255 @@
 // $FFFE-$FFFF    $0001    BRK/interrupt request handler (IRQ/BRK vector)
 
 
-uint16_t mapInternalRam(uint16_t addr);
-uint16_t mapCartridgeRom(uint16_t addr);
 Ppu::Register mapPPURegister(uint16_t addr);
 
 
 Bus::Bus()
 {
+    m_cart = nullptr;
+    m_mapper = nullptr;
+    m_scheduler.reset();
+
     m_cpu = new Cpu();
     m_cpu->connect(this);
 
     m_ppu = new Ppu();
     m_ppu->connect(this);
+
+    // internal RAM, mirrored every 2KB up to $1FFF
+    for (uint32_t iPage = 0x00; iPage < 0x20; iPage++)
+    {
+        uint8_t* ramPage = m_internalRam + (iPage * PAGE_SIZE) % INTERNAL_RAM_SIZE;
+        m_readPages[iPage] = ramPage;
+        m_writePages[iPage] = ramPage;
+    }
+
+    mapPages(0x2000, 0x3FFF, &Bus::readPpuRegister, &Bus::writePpuRegister);
+    mapPages(0x4000, 0x5FFF, &Bus::readApuIo, &Bus::writeApuIo);
+    mapPages(0x6000, 0x7FFF, &Bus::readUnmapped, &Bus::writeUnmapped);
+    mapPages(0x8000, 0xFFFF, &Bus::readUnmapped, &Bus::writeMapper);
+}
+
+Bus::~Bus()
+{
+    delete m_mapper;
+    delete m_cpu;
+    delete m_ppu;
 }
 
+// Throws if its mapper is not supported
 void Bus::insertCartridge(Cartridge* cart)
 {
+    Mapper* mapper = Mapper::create(cart, this);
+
+    delete m_mapper;
     m_cart = cart;
+    m_mapper = mapper;
+    m_mapper->reset();
+
+    // PRG RAM, always enabled
+    for (uint32_t iPage = 0x60; iPage < 0x80; iPage++)
+    {
+        uint8_t* ramPage = cart->prgRam() + (iPage - 0x60) * PAGE_SIZE;
+        m_readPages[iPage] = ramPage;
+        m_writePages[iPage] = ramPage;
+    }
 }
 
 void Bus::reset(bool isAutoTest)
 {
+    // the PPU schedules its frame events on reset,
+    // the mapper maps the reset vector
+    m_scheduler.reset();
+    if (m_mapper != nullptr)
+        m_mapper->reset();
     m_cpu->reset(isAutoTest);
     m_ppu->reset(isAutoTest);
+    for (auto& controller: m_controllers)
+        controller.reset();
 }
 
-
-uint8_t Bus::read(uint16_t addr)
+// Runs whole CPU instructions for (at least) nCycles CPU cycles.
+// The PPU lags behind, only catching up (3 dots per CPU cycle) when an
+// event is due, when the CPU accesses its registers, and at the end:
+// the CPU sees it exactly as if it ran after each instruction, while
+// it renders long stretches of dots at once.
+// Returns early when the PPU completes a frame; returns the cycles actually run
+uint32_t Bus::runCycles(uint32_t nCycles)
 {
-    if (addr >= 0x8000)
+    uint32_t nDone = 0;
+    while (nDone < nCycles)
     {
-        static const uint8_t iPrgBlock = 0; //TODO: support prg block switching
-        addr = mapCartridgeRom(addr);
-        return m_cart->prgData(iPrgBlock, addr);
-    }
+        nDone += m_cpu->step();
 
-    if (addr >= 0x6000)
-        throw std::runtime_error(std::format("access to cartridge RAM area unimplemented; addr=0x{:02X}", addr));
+        //PPU clock is 3x CPU clock
+        if (m_scheduler.nextTimestamp() < 3 * m_cpu->nTotCycles())
+            syncPpu();
 
-    if (addr >= 0x4000)
-    {
-        //TODO: NES APU and I/O registers
-        return  0x00;
+        if (m_ppu->isFrameComplete())
+            break;
     }
 
-    if (addr >= 0x2000)
-    {
-        //NES PPU registers
-        return m_ppu->readRegister(mapPPURegister(addr));
-    }
-
-    addr = mapInternalRam(addr);
-    return m_internalRam[addr];
+    syncPpu();
+    return nDone;
 }
 
+// catches up the PPU with the start of the current CPU instruction
+void Bus::syncPpu()
+{
+    uint64_t cpuTime = 3 * m_cpu->nTotCycles();
+    if (cpuTime > m_scheduler.now())
+        m_ppu->run(cpuTime - m_scheduler.now());
+}
 
-void Bus::write(uint16_t addr, uint8_t value)
+// Handles the events due at the current master time, called by the PPU
+// as it reaches their timestamp
+void Bus::dispatchEvents()
 {
-    if (addr >= 0x8000)
+    Event event;
+    uint64_t timestamp;
+    while (m_scheduler.popDueEvent(event, timestamp))
     {
-        throw std::runtime_error(std::format("Trying to write to read-only memory?; addr=0x{:04X}", addr));
+        switch (event)
+        {
+            case Event::VBlankStart:
+                m_ppu->startVBlank(timestamp);
+                break;
+            case Event::PreRenderLine:
+                m_ppu->startPreRenderLine(timestamp);
+                break;
+            case Event::FrameComplete:
+                m_ppu->completeFrame(timestamp);
+                break;
+            case Event::OamDmaComplete:
+                m_cpu->completeOAMDMA();
+                break;
+            case Event::ScanlineIrq:
+                m_mapper->handleScanlineIrq();
+                break;
+            default:
+                break;
+        }
     }
+}
 
-    if (addr >= 0x6000)
-        throw std::runtime_error(std::format("access to cartridge RAM area unimplemented; addr=0x{:04X}", addr));
 
-    if (addr >= 0x4000)
+void Bus::mapPages(uint16_t startAddr, uint16_t endAddr, BusReadHandler readHandler, BusWriteHandler writeHandler)
+{
+    for (uint32_t iPage = (startAddr >> 8); iPage <= (endAddr >> 8); iPage++)
     {
-        //TODO: NES APU and I/O registers
-        return;
+        m_readPages[iPage] = nullptr;
+        m_writePages[iPage] = nullptr;
+        m_readHandlers[iPage] = readHandler;
+        m_writeHandlers[iPage] = writeHandler;
     }
+}
 
-    if (addr >= 0x2000)
+// Maps size bytes of PRG ROM (a multiple of the page size) from startAddr;
+// the pages stay read-only, writes going to writeMapper().
+// The decoded and compiled code is only dropped where the mapping
+// actually changes, games often select the same banks again
+void Bus::mapPrgRom(uint16_t startAddr, uint32_t size, const uint8_t* data)
+{
+    CodeWindows changed = 0;
+    for (uint32_t offset = 0; offset < size; offset += PAGE_SIZE)
     {
-        //NES PPU registers
-        m_ppu->writeRegister(mapPPURegister(addr), value);
-        return;
+        uint16_t addr = startAddr + offset;
+        const uint8_t*& page = m_readPages[addr >> 8];
+        if (page != data + offset)
+            changed |= codeWindows(addr, addr);
+        page = data + offset;
     }
 
-    if (addr >= 0x0100 && addr < 0x0200)
+    if (changed != 0)
+        m_cpu->invalidateCode(changed);
+}
+
+// Maps size bytes of CHR (a multiple of the slot size) from chrOffset
+// to the pattern table addresses from startAddr
+void Bus::mapChr(uint16_t startAddr, uint32_t size, uint32_t chrOffset)
+{
+    for (uint32_t offset = 0; offset < size; offset += CHR_SLOT_SIZE)
     {
-        //std::println("Writing on stack; addr=${:04X}, value=${:02X}", addr, value);
+        uint8_t iSlot = (startAddr + offset) >> 10;
+        m_chrOffsets[iSlot] = chrOffset + offset;
+        m_chrSlots[iSlot] = m_cart->chrBank(chrOffset + offset);
+        m_chrRowSlots[iSlot] = m_cart->chrTileRows(chrOffset + offset, false);
+        m_chrRowSlotsFlipped[iSlot] = m_cart->chrTileRows(chrOffset + offset, true);
     }
+}
 
-    addr = mapInternalRam(addr);
-    m_internalRam[addr] = value;
+
+// the PPU must be where the CPU expects it before any access
+uint8_t Bus::readPpuRegister(uint16_t addr)
+{
+    syncPpu();
+    return m_ppu->readRegister(mapPPURegister(addr));
 }
 
+void Bus::writePpuRegister(uint16_t addr, uint8_t value)
+{
+    syncPpu();
+    m_ppu->writeRegister(mapPPURegister(addr), value);
+}
 
-uint8_t Bus::readChr(uint16_t addr)
+uint8_t Bus::readApuIo(uint16_t addr)
 {
-    static const uint8_t iChrBlock = 0; //TODO: support chr block switching
-    return m_cart->chrData(iChrBlock, addr);
+    if (addr == 0x4016 || addr == 0x4017)
+        return m_controllers[addr - 0x4016].read();
 
-    //uint8_t value = m_cart->chrData(iChrBlock, addr);
-    //std::println("Bus::readChr(0x{:04X})=[0x{:02X}]", addr, value);
-    //return value;
+    //TODO: NES APU registers
+    return 0x00;
 }
 
+void Bus::writeApuIo(uint16_t addr, uint8_t value)
+{
+    // one strobe line for both ports
+    if (addr == 0x4016)
+    {
+        for (auto& controller: m_controllers)
+            controller.writeStrobe(value);
+        return;
+    }
 
+    //TODO: NES APU registers
+}
 
-uint16_t mapInternalRam(uint16_t addr)
+uint8_t Bus::readUnmapped(uint16_t)
 {
-    return (addr % 0x0800);
+    // open bus, e.g. no cartridge inserted
+    return 0x00;
 }
 
-Ppu::Register mapPPURegister(uint16_t addr)
+void Bus::writeUnmapped(uint16_t, uint8_t)
 {
-    return ((Ppu::Register)(addr % 0x0008));
 }
 
+// mapper registers; bank switches may change what the PPU
+// fetches, so it must first catch up
+void Bus::writeMapper(uint16_t addr, uint8_t value)
+{
+    if (m_mapper == nullptr)
+        throw std::runtime_error(std::format("Trying to write to read-only memory?; addr=0x{:04X}", addr));
+
+    syncPpu();
+    m_mapper->writeRegister(addr, value);
+}
+
+
+void Bus::writeChr(uint16_t addr, uint8_t value)
+{
+    m_cart->writeChrRam(m_chrOffsets[addr >> 10] + (addr & 0x03FF), value);
+}
 
-uint16_t mapCartridgeRom(uint16_t addr)
+void Bus::clockScanlineCounter()
 {
-    // // Mapper 0 (NROM) mirroring
-    // if (addr >= 0xC000)
-    //     return addr - 0xC000;
-    // else
-    //     return addr - 0x8000;
+    m_mapper->clockScanline();
+}
+
 
-    if (addr >= 0x8000)
-        addr = (addr - 0x8000) & 0x3FFF;
 
-    return addr;
+Ppu::Register mapPPURegister(uint16_t addr)
+{
+    return ((Ppu::Register)(addr % 0x0008));
 }
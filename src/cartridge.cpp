@@ -1,10 +1,17 @@
 #include "cartridge.hpp"
 
+#include "save_state.hpp"
+#include "tile_decode.hpp"
+
 #include <cassert>
 #include <print>
 #include <filesystem>
 #include <stdexcept>
 #include <cstring>
+#include <algorithm>
+#include <bit>
+#include <map>
+#include <mutex>
 
 namespace fs = std::filesystem;
 
@@ -24,7 +31,54 @@ uint8_t Cartridge::nCharBlocks() { return m_rawData[5]; }
 std::bitset<8> Cartridge::flags6() { return std::bitset<8>(m_rawData[6]); }
 std::bitset<8> Cartridge::flags7() { return std::bitset<8>(m_rawData[7]); }
 bool Cartridge::hasTrainer() { return (flags6().test(2)); }
+bool Cartridge::hasVerticalMirroring() { return (flags6().test(0)); }
+bool Cartridge::hasFourScreenVram() { return (flags6().test(3)); }
+bool Cartridge::hasBattery() { return (flags6().test(1)); }
+
+uint8_t Cartridge::mapperNumber()
+{
+    // old dumps with garbage (e.g. "DiskDude!") in bytes 7-15
+    // only have the lower nibble
+    bool isNes2 = ((m_rawData[7] & 0x0C) == 0x08);
+    bool hasGarbage = !isNes2 && (m_rawData[12] | m_rawData[13] | m_rawData[14] | m_rawData[15]) != 0;
+
+    uint8_t upper = (hasGarbage ? 0x00 : m_rawData[7] & 0xF0);
+    return upper | (m_rawData[6] >> 4);
+}
+
+
+uint32_t Cartridge::prgRomSize()
+{
+    return nProgBlocks() * KBYTES_16;
+}
+
+void Cartridge::saveState(StateWriter& writer)
+{
+    writer.write(prgRam(), PRG_RAM_SIZE);
+    writer.write(m_chrRam.data(), m_chrRam.size());
+}
 
+// only the CHR RAM tiles that differ are decoded again
+void Cartridge::loadState(StateReader& reader)
+{
+    reader.read(prgRam(), PRG_RAM_SIZE);
+
+    const uint8_t* chrRam = reader.take(m_chrRam.size());
+    for (uint32_t offset = 0; offset < m_chrRam.size(); offset += TILE_SIZE)
+    {
+        if (memcmp(&m_chrRam[offset], chrRam + offset, TILE_SIZE) == 0)
+            continue;
+
+        memcpy(&m_chrRam[offset], chrRam + offset, TILE_SIZE);
+        for (uint8_t dy=0; dy < N_TILE_ROWS; dy++)
+            decodeChrRow(offset / TILE_SIZE, dy);
+    }
+}
+
+bool Cartridge::flushPrgRam()
+{
+    return (m_batteryRam ? m_batteryRam->flush() : true);
+}
 
 const uint8_t Cartridge::prgData(uint8_t iBlock, uint16_t addr)
 {
@@ -38,41 +92,146 @@ const uint8_t Cartridge::chrData(uint8_t iBlock, uint16_t addr)
     return *(m_charData + iBlock*KBYTES_8 + addr);
 }
 
+uint32_t Cartridge::chrSize()
+{
+    return std::max(nCharBlocks(), (uint8_t)1) * KBYTES_8;
+}
+
+void Cartridge::writeChrRam(uint32_t offset, uint8_t value)
+{
+    if (m_chrRam.empty())
+        return;
+
+    offset %= m_chrRam.size();
+    m_chrRam[offset] = value;
+    decodeChrRow(offset / TILE_SIZE, offset & 0x07);
+}
+
 
 
 bool Cartridge::load(const char* filename) {
-    FILE *f;
-    if (!(f = fopen(filename, "rb")))
+    m_image = RomImage::open(filename);
+    if (!m_image)
     {
         std::println("!! {} is not a readable file", filename);
         return false;
     }
 
-    m_rawDataSize = fread(m_rawData, sizeof(uint8_t), MAX_SIZE, f);    
-    fclose(f);
+    m_rawData = m_image->data();
+    m_rawDataSize = m_image->size();
 
-    if (std::strncmp((const char *)m_rawData, "NES", 3) || (m_rawData[3] != 0x1A)) {
+    if (m_rawDataSize < HEADER_SIZE || std::strncmp((const char *)m_rawData, "NES", 3) || (m_rawData[3] != 0x1A)) {
         std::println("!! not a NES ROM");
         return false;
     }
 
+    // the mapping is only as long as the file: PRG and CHR must fit in it
+    size_t dataSize = HEADER_SIZE + (hasTrainer() ? TRAINER_SIZE : 0) + nProgBlocks() * KBYTES_16 + nCharBlocks() * KBYTES_8;
+    if (m_rawDataSize < dataSize) {
+        std::println("!! truncated NES ROM, {} bytes instead of {}", m_rawDataSize, dataSize);
+        return false;
+    }
+
     m_filename = fs::path(filename).filename().string();
-    m_progData = m_rawData + 16 + (hasTrainer() ? 512 : 0);
+    m_progData = m_rawData + HEADER_SIZE + (hasTrainer() ? TRAINER_SIZE : 0);
     m_charData = m_progData + nProgBlocks() * KBYTES_16;
+    if (nCharBlocks() == 0)
+    {
+        m_chrRam.assign(KBYTES_8, 0x00);
+        m_charData = m_chrRam.data();
+    }
+
+    decodeChrTiles();
+
+    if (hasBattery())
+    {
+        std::string savePath = fs::path(filename).replace_extension(".sav").string();
+        m_batteryRam = std::make_unique<BatteryRam>(savePath.c_str(), PRG_RAM_SIZE);
+    }
+    else
+        m_prgRam.assign(PRG_RAM_SIZE, 0x00);
+
+    // not into a save, which it would overwrite on every load
+    if (hasTrainer() && !hasBattery())
+        memcpy(prgRam() + TRAINER_PRG_RAM_OFFSET, m_rawData + HEADER_SIZE, TRAINER_SIZE);
 
     return true;
 }
 
+void Cartridge::decodeChrTiles()
+{
+    if (hasChrRam())
+        m_chrTileRows = decodeChrTileRows(m_charData, chrSize());
+    else
+        m_chrTileRows = sharedChrTileRows();
+}
+
+// decoded CHR ROM tiles by image; entries of released images expire.
+// An image outlives the tiles of its cartridges, so a live entry is
+// never that of an older image at the same address
+static std::mutex s_chrTileRowsMutex;
+static std::map<const RomImage*, std::weak_ptr<ChrTileRows>> s_chrTileRowsCache;
+
+std::shared_ptr<ChrTileRows> Cartridge::sharedChrTileRows()
+{
+    std::lock_guard<std::mutex> lock(s_chrTileRowsMutex);
+
+    auto it = s_chrTileRowsCache.find(m_image.get());
+    if (it != s_chrTileRowsCache.end())
+    {
+        if (auto tileRows = it->second.lock())
+            return tileRows;
+    }
+
+    auto tileRows = decodeChrTileRows(m_charData, chrSize());
+    s_chrTileRowsCache[m_image.get()] = tileRows;
+    return tileRows;
+}
+
+std::shared_ptr<ChrTileRows> Cartridge::decodeChrTileRows(const uint8_t* chrData, uint32_t size)
+{
+    uint32_t nTiles = size / TILE_SIZE;
+    auto tileRows = std::make_shared<ChrTileRows>();
+    tileRows->rows.assign(nTiles * N_TILE_ROWS, 0);
+    tileRows->flipped.assign(nTiles * N_TILE_ROWS, 0);
+
+    TileDecoder decoder = bestTileDecoder();
+    for (uint32_t iTile=0; iTile < nTiles; iTile++)
+    {
+        uint64_t* rows = &tileRows->rows[iTile * N_TILE_ROWS];
+        decodeTile(decoder, chrData + iTile * TILE_SIZE, 0, rows);
+
+        for (uint32_t dy=0; dy < N_TILE_ROWS; dy++)
+            tileRows->flipped[iTile * N_TILE_ROWS + dy] = std::byteswap(rows[dy]);
+    }
+
+    return tileRows;
+}
+
+// after a CHR RAM write to either bitplane of the row
+void Cartridge::decodeChrRow(uint32_t iTile, uint8_t dy)
+{
+    const uint8_t* tile = m_charData + iTile * TILE_SIZE;
+    uint64_t row = decodeTileRow(tile[dy], tile[dy + 8]);
+
+    m_chrTileRows->rows[iTile * N_TILE_ROWS + dy] = row;
+    m_chrTileRows->flipped[iTile * N_TILE_ROWS + dy] = std::byteswap(row);
+}
+
 void Cartridge::printDiagnostics()
 {
     std::println("---- Cartridge diagnostics ----");
     std::println("file name: {}", m_filename);
-    std::println("raw data size: {}", m_rawDataSize);
+    std::println("raw data size: {}, {}", m_rawDataSize, m_image->isMapped() ? "mapped" : "read");
     std::println("nProgBlocks: {}", nProgBlocks());
-    std::println("nCharBlocks: {}", nCharBlocks());
+    std::println("nCharBlocks: {}{}", nCharBlocks(), hasChrRam() ? " (CHR RAM)" : "");
+    std::println("mapper: {}", mapperNumber());
     std::println("flags6: {}", flags6().to_string());
     std::println("flags7: {}", flags7().to_string());
     std::println("hasTrainer: {}", hasTrainer());
+    if (m_batteryRam)
+        std::println("battery: {}, {}{}", m_batteryRam->path(), m_batteryRam->isMapped() ? "mapped" : "read",
+            m_batteryRam->isOwner() ? "" : ", not persisted (in use by another instance)");
     std::println("-------------------------------");
 
 }
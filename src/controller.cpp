@@ -0,0 +1,48 @@
+#include "controller.hpp"
+
+#include "save_state.hpp"
+
+
+// upper bits of $4016/$4017 reads, left on the data bus by the address high byte
+static const uint8_t OPEN_BUS_BITS = 0x40;
+
+
+void Controller::reset()
+{
+    m_shiftRegister = 0;
+    m_strobe = false;
+}
+
+// while the strobe is high the register keeps reloading the buttons,
+// the snapshot at its falling edge is the one read out
+void Controller::writeStrobe(uint8_t value)
+{
+    m_strobe = (value & 0x01) != 0;
+    if (m_strobe)
+        m_shiftRegister = buttons();
+}
+
+uint8_t Controller::read()
+{
+    if (m_strobe)
+        m_shiftRegister = buttons();
+
+    uint8_t bit = m_shiftRegister & 0x01;
+    // ones are shifted in once the 8 buttons are out
+    m_shiftRegister = (m_shiftRegister >> 1) | 0x80;
+
+    return OPEN_BUS_BITS | bit;
+}
+
+
+void Controller::saveState(StateWriter& writer)
+{
+    writer.write(m_shiftRegister);
+    writer.write(m_strobe);
+}
+
+void Controller::loadState(StateReader& reader)
+{
+    reader.read(m_shiftRegister);
+    reader.read(m_strobe);
+}
@@ -2,6 +2,8 @@
 
 #include "bus.hpp"
 #include "instructions.hpp"
+#include "log.hpp"
+#include "save_state.hpp"
 
 #include <print>
 
@@ -12,6 +14,23 @@ bool isPageBreak(uint16_t addr1, uint16_t addr2)
 }
 
 
+Cpu::~Cpu()
+{
+    delete m_jit;
+}
+
+// to be called whenever the code mapped in PRG ROM changes,
+// with the windows remapped
+void Cpu::invalidateCode(CodeWindows windows)
+{
+    m_blockCache.invalidate(windows);
+    if (m_jit != nullptr)
+        m_jit->invalidate(windows);
+
+    resetIdleLoop();
+}
+
+
 void Cpu::reset(bool isAutoTest)
 {
     A = 0x00;
@@ -19,9 +38,10 @@ void Cpu::reset(bool isAutoTest)
     Y = 0x00;
     SP = 0xFD;     // offset to the start of the stack
 
-    P = 0x24; // IRQ disabled
+    setStatus(0x24); // IRQ disabled
 
     m_nmiPending = false;
+    m_irqLine = false;
 
     if (isAutoTest)
         PC = 0xC000;
@@ -36,10 +56,116 @@ void Cpu::reset(bool isAutoTest)
     m_nWaitCycles = 7;
     m_nProcessedInstr = 0;
     m_nTotCycles = 0;
+    m_nIdleCyclesSkipped = 0;
+    resetIdleLoop();
+
+    logInfo(LogCategory::Cpu, "CPU reset; PC=${0:04X}", PC);
+
+    m_oamDmaAddr = 0x0000;
+}
+
+
+// between instructions; the flags as assembled by status()
+void Cpu::saveState(StateWriter& writer)
+{
+    writer.write(A);
+    writer.write(X);
+    writer.write(Y);
+    writer.write(SP);
+    writer.write(PC);
+    writer.write(status());
+
+    writer.write(m_nmiPending);
+    writer.write(m_irqLine);
+    writer.write(m_nWaitCycles);
+    writer.write(m_targetAddress);
+    writer.write(m_nProcessedInstr);
+    writer.write(m_nTotCycles);
+    writer.write(m_oamDmaAddr);
+}
+
+void Cpu::loadState(StateReader& reader)
+{
+    uint8_t status;
+    reader.read(A);
+    reader.read(X);
+    reader.read(Y);
+    reader.read(SP);
+    reader.read(PC);
+    reader.read(status);
+    setStatus(status);
+
+    reader.read(m_nmiPending);
+    reader.read(m_irqLine);
+    reader.read(m_nWaitCycles);
+    reader.read(m_targetAddress);
+    reader.read(m_nProcessedInstr);
+    reader.read(m_nTotCycles);
+    reader.read(m_oamDmaAddr);
+
+    resetIdleLoop();
+}
+
+
+#ifdef LAZY_FLAGS
+
+bool Cpu::hasFlag(FlagIndex flagIndex)
+{
+    switch (flagIndex)
+    {
+        case FlagIndex::Negative: return (m_nValue & 0x80);
+        case FlagIndex::Zero:     return (m_zValue == 0x00);
+        case FlagIndex::Carry:    return m_carry;
+        case FlagIndex::Overflow: return m_overflow;
+        default:                  return ((P >> flagIndex) & 0x1) == 1;
+    }
+}
+
+void Cpu::setFlag(FlagIndex flagIndex, bool value)
+{
+    switch (flagIndex)
+    {
+        case FlagIndex::Negative: m_nValue = (value ? 0x80 : 0x00); break;
+        case FlagIndex::Zero:     m_zValue = (value ? 0x00 : 0x01); break;
+        case FlagIndex::Carry:    m_carry = value; break;
+        case FlagIndex::Overflow: m_overflow = value; break;
+        default:
+        {
+            uint8_t mask = (0x1 << flagIndex);
+            if (value)
+                P |= mask;
+            else
+                P &= ~mask;
+        }
+    }
+}
 
-    m_oamState = OAMState::INACTIVE;
+void Cpu::setNZ(uint8_t result)
+{
+    m_nValue = result;
+    m_zValue = result;
 }
 
+uint8_t Cpu::status()
+{
+    uint8_t value = P & 0b00111100;
+    value |= (m_nValue & 0x80);
+    value |= (m_overflow ? 0x40 : 0x00);
+    value |= (m_zValue == 0x00 ? 0x02 : 0x00);
+    value |= (m_carry ? 0x01 : 0x00);
+    return value;
+}
+
+void Cpu::setStatus(uint8_t value)
+{
+    P = value;
+    m_nValue = value;
+    m_zValue = (value & 0x02) ? 0x00 : 0x01;
+    m_carry = (value & 0x01);
+    m_overflow = (value & 0x40);
+}
+
+#else
 
 bool Cpu::hasFlag(FlagIndex flagIndex)
 {
@@ -54,6 +180,24 @@ void Cpu::setFlag(FlagIndex flagIndex, bool value)
     else
         P &= ~mask;
 }
+
+void Cpu::setNZ(uint8_t result)
+{
+    setFlag(FlagIndex::Zero,     result == 0x00);
+    setFlag(FlagIndex::Negative, result & 0x80);
+}
+
+uint8_t Cpu::status()
+{
+    return P;
+}
+
+void Cpu::setStatus(uint8_t value)
+{
+    P = value;
+}
+
+#endif
     
 uint8_t Cpu::read(uint16_t addr)
 {
@@ -64,7 +208,6 @@ void Cpu::write(uint16_t addr, uint8_t value)
 {
     if (addr == 0x4014)
     {
-        std::println("writing to OAMDMA; value=${:02X}", value);
         startOAMDMA(value << 8);
         return;
     }
@@ -97,120 +240,202 @@ void Cpu::requestNMI()
 
 void Cpu::executeNMI()
 {
-    std::println("NMI occurred");
+    logDebug(LogCategory::Nmi, "NMI occurred; PC=${0:04X}", PC);
+
+#ifdef CPU_PROFILER
+    if (m_profiler != nullptr)
+        m_profiler->enterNmi();
+#endif
 
     m_nmiPending = false;
     pushStack(PC >> 8);
     pushStack(PC & 0xFF);
-    pushStack(P & ~0x10);
+    pushStack(status() & ~0x10);
 
-    P |= 0x04;
+    setFlag(FlagIndex::InterruptDisable, true);
     PC = read(0xFFFA) + (read(0xFFFB) << 8);
 }
 
+// same sequence as the NMI, through the IRQ/BRK vector; the line stays
+// asserted until its source (the mapper) acknowledges it
+void Cpu::executeIRQ()
+{
+    logDebug(LogCategory::Irq, "IRQ occurred; PC=${0:04X}", PC);
+
+    pushStack(PC >> 8);
+    pushStack(PC & 0xFF);
+    pushStack(status() & ~0x10);
+
+    setFlag(FlagIndex::InterruptDisable, true);
+    PC = read(0xFFFE) + (read(0xFFFF) << 8);
+}
+
 
 void Cpu::clock()
 {
-    if (m_oamState == OAMState::READ)
-    {
-        m_currOAMValue = read(m_nextOAMAddr++);
-        m_oamState = OAMState::WRITE;
-        return;
-    }
+    //std::println("Cpu::clock()");
+    if (m_nWaitCycles == 0)
+        executeInstruction();
+
+    m_nWaitCycles--;
+    m_nTotCycles++;
+}
+
+uint32_t Cpu::step()
+{
+    uint16_t startPC = PC;
+    uint32_t nInstrBefore = m_nProcessedInstr;
+
+    // an instruction already in progress (or the reset sequence)
+    // is completed without fetching a new one
+    if (m_nWaitCycles == 0)
+        executeInstruction();
+
+    uint32_t nCycles = m_nWaitCycles;
+    m_nTotCycles += m_nWaitCycles;
+    m_nWaitCycles = 0;
+
+    if (m_idleLoopSkipping && !isInstrumented())
+        nCycles += skipIdleLoop(startPC, m_nProcessedInstr - nInstrBefore);
+
+    return nCycles;
+}
+
+void Cpu::executeInstruction()
+{
+    if (m_nmiPending)
+        executeNMI();
+    else if (m_irqLine && !hasFlag(FlagIndex::InterruptDisable))
+        executeIRQ();
     
-    if (m_oamState == OAMState::WRITE)
+    if (m_core == CpuCore::Jit && PC >= Jit::START_ADDR && !isInstrumented() && executeJit())
+        return;
+
+    m_nProcessedInstr ++;
+    auto startPC = PC;
+
+    if ((m_core == CpuCore::Cached || m_core == CpuCore::Jit) && startPC >= BlockCache::START_ADDR)
     {
-        //write on OAMDATA PPU register
-        m_bus->write(0x2004, m_currOAMValue);
+        if (m_tracing) {
+            logInstruction(startPC);
+        }
 
-        m_nOAMPerformed ++;
-        if (m_nOAMPerformed == N_OAMDMA_VALUES)
-            m_oamState = OAMState::INACTIVE;
-        else
-            m_oamState = OAMState::READ;
-        return;
+        executeCached();
     }
-
-    //std::println("Cpu::clock()");
-    if (m_nWaitCycles == 0) {
-        if (m_nmiPending)
-            executeNMI();
-        
-        m_nProcessedInstr ++;
-        auto startPC = PC;
+    else
+    {
         auto opcode = read(PC++);
 
-        Instruction& instr = instructionLookupTable[opcode];
-        m_nWaitCycles = instr.nCycles;
-
         if (m_tracing) {
             logInstruction(startPC);
         }
 
-        m_currAddrMode = instr.addrmode;
-        uint8_t extraCycles1 = (this->*instr.addrmode)();
-        uint8_t extraCycles2 = (this->*instr.operate)();  
-        m_nWaitCycles += extraCycles1 & extraCycles2;
+        if (m_core == CpuCore::Switch)
+        {
+            executeSwitch(opcode);
+        }
+        else
+        {
+            const Instruction& instr = instructionLookupTable[opcode];
+            m_nWaitCycles = instr.nCycles;
+
+            uint8_t extraCycles1 = (this->*cpuAddrModes[(int)instr.addrMode])();
+            uint8_t extraCycles2 = (this->*cpuOpcodeOperations[opcode])();
+            m_nWaitCycles += extraCycles1 & extraCycles2;
+        }
     }
 
-    m_nWaitCycles--;
-    m_nTotCycles++;
+#ifdef CPU_PROFILER
+    if (m_profiler != nullptr)
+        m_profiler->countInstruction(startPC, m_bus->peek(startPC), m_nWaitCycles);
+#endif
 }
 
+// same as the table core, with opcode and static operands
+// already decoded by the block cache
+void Cpu::executeCached()
+{
+    const DecodedInstr& instr = m_blockCache.fetch(PC);
+    m_nWaitCycles = instr.nCycles;
+
+    uint8_t extraCycles1 = 0x00;
+    if (instr.addrMode == nullptr)
+    {
+        m_targetAddress = instr.targetAddress;
+        PC += instr.nBytes;
+    }
+    else
+    {
+        PC ++;
+        extraCycles1 = (this->*instr.addrMode)();
+    }
+
+    uint8_t extraCycles2 = (this->*instr.operate)();
+    m_nWaitCycles += extraCycles1 & extraCycles2;
+}
+
+// The CPU stalls for one halt cycle, one more when needed so that reads
+// fall on even cycles, then a read and a write cycle per byte.
+// The $4014 write being the last cycle of the instruction, that is 514
+// cycles when it happens on an odd cycle, 513 otherwise.
+// The stall is added to the cycles of the writing instruction, and the
+// whole transfer is scheduled on the last of its cycles
 void Cpu::startOAMDMA(uint16_t startAddr)
 {
-    m_nextOAMAddr = startAddr;
-    m_oamState = OAMState::READ;
-    m_nOAMPerformed = 0;
+    uint64_t stallStart = m_nTotCycles + m_nWaitCycles;
+
+    uint8_t nAlignCycles = (stallStart + 1) & 1;
+    uint16_t nStallCycles = 1 + nAlignCycles + N_OAMDMA_CYCLES;
+    logDebug(LogCategory::Dma, "OAM DMA from ${0:04X}; {1} stall cycles", startAddr, nStallCycles);
+
+    m_oamDmaAddr = startAddr;
+    m_nWaitCycles += nStallCycles;
+
+    uint64_t endCycle = m_nTotCycles + m_nWaitCycles;
+    m_bus->scheduler().schedule(Event::OamDmaComplete, 3 * endCycle - 3);
 }
 
-void Cpu::logInstruction(uint16_t pc)
+// RAM and ROM pages are copied straight into OAM, pages behind
+// I/O handlers are read byte by byte first
+void Cpu::completeOAMDMA()
 {
-        auto opcode = read(pc);
-        Instruction& instr = instructionLookupTable[opcode];
-
-        //C000  4C F5 C5  JMP $C5F5                       A:00 X:00 Y:00 P:24 SP:FD PPU:  0, 21 CYC:7
-        std::string opcodeBytes;
-        if (instr.nBytes == 1)
-            opcodeBytes = std::format("{:02X}", read(pc));
-        else if (instr.nBytes == 2)
-            opcodeBytes = std::format("{:02X} {:02X}", read(pc), read(pc+1));
-        else if (instr.nBytes == 3)
-            opcodeBytes = std::format("{:02X} {:02X} {:02X}", read(pc), read(pc+1), read(pc+2));
-
-        std::string args;
-        if (instr.addrmode == &Cpu::AddrABS)
-           args = std::format("${:04X}", (read(pc+2)<<8) + read(pc+1));
-        if (instr.addrmode == &Cpu::AddrABS)
-           args = std::format("${:04X}", (read(pc+2)<<8) + read(pc+1));
-        else if (instr.addrmode == &Cpu::AddrABX)
-           args = std::format("${:04X},X", (read(pc+2)<<8) + read(pc+1));
-        else if (instr.addrmode == &Cpu::AddrABY)
-           args = std::format("${:04X},Y", (read(pc+2)<<8) + read(pc+1));
-        else if (instr.addrmode == &Cpu::AddrZP0)
-           args = std::format("${:02X}", read(pc+1));
-        else if (instr.addrmode == &Cpu::AddrZPX)
-           args = std::format("${:02X},X", read(pc+1));
-        else if (instr.addrmode == &Cpu::AddrZPY)
-           args = std::format("${:02X},Y", read(pc+1));
-        else if (instr.addrmode == &Cpu::AddrIZX)
-           args = std::format("(${:02X},X)", read(pc+1));
-        else if (instr.addrmode == &Cpu::AddrIZY)
-           args = std::format("(${:02X}),Y", read(pc+1));
-        else if (instr.addrmode == &Cpu::AddrIMM)
-           args = std::format("#${:02X}", read(pc+1));
-        else if (instr.addrmode == &Cpu::AddrACC)
-           args = std::format("A");
-        else if (instr.addrmode == &Cpu::AddrREL || instr.addrmode == &Cpu::AddrIND)
-           args = std::format("${:04X}", m_targetAddress);
+    uint8_t buffer[N_OAMDMA_VALUES];
 
-        else
-            args = "";
+    const uint8_t* page = m_bus->readPage(m_oamDmaAddr >> 8);
+    if (page == nullptr)
+    {
+        for (int i=0; i < N_OAMDMA_VALUES; i++)
+            buffer[i] = read(m_oamDmaAddr + i);
+        page = buffer;
+    }
 
+    m_bus->ppu()->writeOamDma(page);
+}
 
-        std::print("{:04X}  {:9s} {} {:27s} ", pc, opcodeBytes, instr.name, args);
-        std::print("A:{:02X} X:{:02X} Y:{:02X} P:{:02X} SP:{:02X} ", A, X, Y, P, SP);
-        std::println("PPU:{:3d},{:3d} CYC:{:d}", m_bus->ppu()->scanline(), m_bus->ppu()->dot(), 
-                    m_nTotCycles);
+// Records the state before executing the instruction at pc; opcode bytes
+// are peeked, so tracing never triggers side effects on I/O registers
+void Cpu::logInstruction(uint16_t pc)
+{
+    TraceRecord record = {};
+    record.cycle = m_nTotCycles;
+    record.pc = pc;
+    // where the PPU would be if it had caught up with the CPU, without
+    // the side effects of syncing it
+    uint64_t now = m_bus->scheduler().now();
+    uint64_t cpuTime = 3 * m_nTotCycles;
+    m_bus->ppu()->positionAfter(cpuTime > now ? cpuTime - now : 0, record.scanline, record.dot);
+    record.opcodeBytes[0] = m_bus->peek(pc);
+    record.opcodeBytes[1] = m_bus->peek(pc + 1);
+    record.opcodeBytes[2] = m_bus->peek(pc + 2);
+    record.A = A;
+    record.X = X;
+    record.Y = Y;
+    record.P = status();
+    record.SP = SP;
+
+    if (m_traceWriter != nullptr)
+        m_traceWriter->push(record);
+    else
+        std::println("{}", formatTraceRecord(record));
 }
 
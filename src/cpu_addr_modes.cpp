@@ -15,8 +15,7 @@ uint8_t Cpu::AddrIMP()
 }
 uint8_t Cpu::AddrACC()
 {
-    //CHECK
-    m_targetAddress = A;
+    // the operation itself is specialized on AddrMode::ACC and works on A
     return 0x00;
 }
 uint8_t Cpu::AddrIMM()
@@ -0,0 +1,198 @@
+#include "cpu.hpp"
+
+#include "bus.hpp"
+#include "instructions.hpp"
+
+#include <algorithm>
+
+
+//---- idle loop skipping ----
+// Games wait for VBlank spinning on a short loop, e.g. LDA $2002 / BPL
+// or JMP * while the NMI handler does the work.
+// A loop is idle when its code only reads RAM, ROM or PPUSTATUS, writes
+// nothing, and the registers are the same after two consecutive
+// iterations: until the PPU status changes (or an NMI or IRQ fires), every
+// further iteration is the same, so whole iterations are skipped up to
+// the next scheduled event, the PPU catching up in bulk. Sprite 0 hit is
+// not an event: skipping also stops at the end of the lines it may be
+// set on.
+// Only runs in step(), the per-cycle clock() always executes every instruction
+
+static const uint16_t MAX_IDLE_LOOP_BYTES = 32;
+
+
+bool isIdleLoopBody(Bus* bus, uint16_t startPC, uint16_t endPC);
+bool isIdleLoopOperation(Operation operation, AddrMode addrMode);
+bool isIdleLoopRead(uint16_t addr);
+
+
+void Cpu::resetIdleLoop()
+{
+    // no loop can match startPC > endPC
+    m_idleLoop.startPC = 0x0001;
+    m_idleLoop.endPC = 0x0000;
+    m_idleLoop.isPure = false;
+    m_idleLoop.isInLoop = false;
+}
+
+
+// Called by step() after each instruction (or compiled block), startPC
+// being the PC before it.
+// Returns the CPU cycles skipped, to be added to those of the step
+uint32_t Cpu::skipIdleLoop(uint16_t startPC, uint32_t nInstr)
+{
+    bool isBackwardJump = (nInstr == 1 && PC <= startPC && startPC - PC <= MAX_IDLE_LOOP_BYTES);
+    if (!isBackwardJump)
+    {
+        if (nInstr != 1 || PC < m_idleLoop.startPC || PC > m_idleLoop.endPC)
+            m_idleLoop.isInLoop = false;
+
+        return 0;
+    }
+
+    // from the end of this step, m_nTotCycles already including it
+    uint64_t time = 3 * m_nTotCycles;
+    int32_t nDotsLeft = std::min(m_bus->scheduler().dotsUntilNextEvent(time), m_bus->ppu()->dotsUntilSpriteZeroLineEnd(time));
+
+    uint32_t nSkippedCycles = 0;
+    if (PC != m_idleLoop.startPC || startPC != m_idleLoop.endPC)
+    {
+        // new candidate loop
+        m_idleLoop.startPC = PC;
+        m_idleLoop.endPC = startPC;
+        m_idleLoop.isPure = isIdleLoopBody(m_bus, PC, startPC);
+    }
+    else if (m_idleLoop.isPure && m_idleLoop.isInLoop && !isInterruptPending() && registers() == m_idleLoop.regs)
+    {
+        uint32_t nLoopCycles = m_nTotCycles - m_idleLoop.nTotCycles;
+        uint32_t nLoopInstr = m_nProcessedInstr - m_idleLoop.nProcessedInstr;
+
+        // the last iteration is only a fixed point if no event changed
+        // the PPU status meanwhile
+        bool isSameFrameEvent = (m_idleLoop.nDotsLeft - nDotsLeft == 3 * (int32_t)nLoopCycles);
+        if (nLoopCycles > 0 && nDotsLeft > 0 && isSameFrameEvent)
+        {
+            uint32_t nLoops = (nDotsLeft - 1) / (3 * nLoopCycles);
+
+            nSkippedCycles = nLoops * nLoopCycles;
+            m_nTotCycles += nSkippedCycles;
+            m_nProcessedInstr += nLoops * nLoopInstr;
+            m_nIdleCyclesSkipped += nSkippedCycles;
+            nDotsLeft -= 3 * nSkippedCycles;
+        }
+    }
+
+    m_idleLoop.isInLoop = true;
+    m_idleLoop.regs = registers();
+    m_idleLoop.nTotCycles = m_nTotCycles;
+    m_idleLoop.nProcessedInstr = m_nProcessedInstr;
+    m_idleLoop.nDotsLeft = nDotsLeft;
+
+    return nSkippedCycles;
+}
+
+
+// Static check of the loop code, decoded straight from startPC to the
+// backward jump at endPC: every jump must land on one of its instructions
+// (or leave the loop), and no instruction can have side effects
+bool isIdleLoopBody(Bus* bus, uint16_t startPC, uint16_t endPC)
+{
+    // only code in internal RAM or ROM, decoding must not touch I/O registers
+    bool isInRam = (endPC + 2 < 0x2000);
+    bool isInRom = (startPC >= 0x8000);
+    if (!isInRam && !isInRom)
+        return false;
+
+    bool isInstrStart[MAX_IDLE_LOOP_BYTES + 1] = {};
+    uint16_t jumpTargets[MAX_IDLE_LOOP_BYTES + 1];
+    int nJumps = 0;
+
+    uint32_t pc = startPC;
+    uint32_t lastPC = pc;
+    while (pc <= endPC)
+    {
+        isInstrStart[pc - startPC] = true;
+        lastPC = pc;
+
+        const Instruction& instr = instructionLookupTable[bus->read(pc)];
+        if (!isIdleLoopOperation(instr.operation, instr.addrMode))
+            return false;
+
+        uint16_t operand = (bus->read(pc + 2) << 8) | bus->read(pc + 1);
+        if (instr.addrMode == AddrMode::ABS)
+        {
+            if (instr.operation == Operation::JMP)
+                jumpTargets[nJumps++] = operand;
+            else if (!isIdleLoopRead(operand))
+                return false;
+        }
+        else if (instr.addrMode == AddrMode::REL)
+            jumpTargets[nJumps++] = pc + 2 + (int8_t)(operand & 0xFF);
+
+        pc += addrModeBytes(instr.addrMode);
+    }
+
+    // the backward jump must start exactly at endPC
+    if (lastPC != endPC)
+        return false;
+
+    for (int i=0; i < nJumps; i++)
+    {
+        uint16_t target = jumpTargets[i];
+        if (target >= startPC && target <= endPC && !isInstrStart[target - startPC])
+            return false;
+    }
+
+    return true;
+}
+
+
+bool isIdleLoopOperation(Operation operation, AddrMode addrMode)
+{
+    switch (addrMode)
+    {
+        case AddrMode::IMP: case AddrMode::ACC: case AddrMode::IMM: case AddrMode::REL:
+        case AddrMode::ZP0: case AddrMode::ZPX: case AddrMode::ZPY: case AddrMode::ABS:
+            break;
+        default:
+            // run-time addresses could reach I/O
+            return false;
+    }
+
+    switch (operation)
+    {
+        case Operation::LDA: case Operation::LDX: case Operation::LDY: case Operation::LAX:
+        case Operation::AND: case Operation::ORA: case Operation::EOR: case Operation::BIT:
+        case Operation::ADC: case Operation::SBC:
+        case Operation::CMP: case Operation::CPX: case Operation::CPY:
+        case Operation::TAX: case Operation::TAY: case Operation::TXA: case Operation::TYA:
+        case Operation::TSX: case Operation::TXS:
+        case Operation::INX: case Operation::INY: case Operation::DEX: case Operation::DEY:
+        case Operation::CLC: case Operation::SEC: case Operation::CLV:
+        case Operation::CLD: case Operation::SED:
+        case Operation::BCC: case Operation::BCS: case Operation::BEQ: case Operation::BMI:
+        case Operation::BNE: case Operation::BPL: case Operation::BVC: case Operation::BVS:
+        case Operation::NOP:
+            return true;
+
+        case Operation::JMP:
+            return (addrMode == AddrMode::ABS);
+
+        case Operation::ASL: case Operation::LSR: case Operation::ROL: case Operation::ROR:
+            return (addrMode == AddrMode::ACC);
+
+        default:
+            return false;
+    }
+}
+
+
+// internal RAM, PPUSTATUS (whose only side effect is resetting the
+// write toggle), PRG RAM or ROM
+bool isIdleLoopRead(uint16_t addr)
+{
+    if (addr < 0x2000 || addr >= 0x6000)
+        return true;
+
+    return (addr < 0x4000 && (addr & 0x0007) == Ppu::Register::PPUSTATUS);
+}
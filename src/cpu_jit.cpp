@@ -0,0 +1,150 @@
+#include "cpu.hpp"
+
+#include "bus.hpp"
+#include "instructions.hpp"
+#include "jit.hpp"
+
+#include <utility>
+
+
+//---- JIT thunks ----
+// one per opcode, called by the native code of a block for the
+// instructions it does not emit inline, and on the slow path of those
+// whose operand is behind a handler.
+// Same as the switch core, except that static operands come resolved
+// from the compiler and that run-time addresses reaching I/O make the
+// thunk bail out before anything is executed.
+// Returns false to leave the block: on bail out and on branches taken
+
+
+constexpr bool isStaticAddrMode(AddrMode addrMode)
+{
+    return (addrMode == AddrMode::IMP || addrMode == AddrMode::ACC || addrMode == AddrMode::IMM
+        || addrMode == AddrMode::ZP0 || addrMode == AddrMode::ABS || addrMode == AddrMode::REL);
+}
+
+
+
+template<uint8_t opcode>
+bool Cpu::jitStep(Cpu* cpu, uint32_t targetAddress, uint32_t pc)
+{
+    constexpr Instruction instr = instructionLookupTable[opcode];
+    constexpr auto operate = cpuOpcodeOperations[opcode];
+
+    uint8_t extraCycles = 0x00;
+    if constexpr (isStaticAddrMode(instr.addrMode))
+    {
+        cpu->m_targetAddress = targetAddress;
+        cpu->PC = pc + addrModeBytes(instr.addrMode);
+    }
+    else
+    {
+        constexpr auto addrMode = cpuAddrModes[(int)instr.addrMode];
+
+        cpu->PC = pc + 1;
+        extraCycles = (cpu->*addrMode)();
+
+        if (instr.operation != Operation::JMP && !isJitSafeAccess(instr.operation, cpu->m_targetAddress))
+        {
+            cpu->PC = pc;
+            cpu->m_jitBailout = true;
+            return false;
+        }
+    }
+
+    cpu->m_nWaitCycles = instr.nCycles;
+    extraCycles &= (cpu->*operate)();
+    cpu->m_nWaitCycles += extraCycles;
+
+    cpu->m_jitCycles += cpu->m_nWaitCycles;
+    cpu->m_nProcessedInstr ++;
+
+    if constexpr (instr.addrMode == AddrMode::REL)
+        return (cpu->PC == pc + 2);
+
+    return true;
+}
+
+
+template<std::size_t... opcodes>
+constexpr std::array<JitThunk, 256> makeJitThunks(std::index_sequence<opcodes...>)
+{
+    return { &Cpu::jitStep<opcodes>... };
+}
+
+JitThunk Cpu::jitThunk(uint8_t opcode)
+{
+    static constexpr std::array<JitThunk, 256> thunks = makeJitThunks(std::make_index_sequence<256>{});
+    return thunks[opcode];
+}
+
+JitCpuLayout Cpu::jitLayout()
+{
+    auto offset = [this](const void* field) { return (int32_t)((const uint8_t*)field - (const uint8_t*)this); };
+    return {
+        offset(&A), offset(&X), offset(&Y), offset(&SP), offset(&P), offset(&PC),
+        offset(&m_jitCycles), offset(&m_nProcessedInstr)
+    };
+}
+
+uint32_t Cpu::jitStatus(Cpu* cpu)
+{
+    return cpu->status();
+}
+
+void Cpu::jitSetStatus(Cpu* cpu, uint32_t value)
+{
+    cpu->setStatus(value);
+}
+
+
+// Runs the compiled block at PC, chaining the following ones, as long as
+// they cannot overlap an NMI or the end of the frame: the PPU only
+// catches up after the whole run.
+// Returns false when the interpreter must execute the next instruction
+bool Cpu::executeJit()
+{
+    if (m_jit == nullptr)
+    {
+        if (!Jit::isSupported())
+            return false;
+
+        m_jit = new Jit(m_bus);
+    }
+
+    const JitBlock* block = m_jit->lookup(PC);
+    if (block == nullptr)
+        return false;
+
+    uint32_t nDotsLeft = m_bus->scheduler().dotsUntilNextEvent(3 * m_nTotCycles);
+    m_jitCycles = 0;
+
+    while (block != nullptr)
+    {
+        uint32_t maxCycles = m_jitCycles + block->maxCycles;
+        if (3 * maxCycles >= nDotsLeft || maxCycles > Jit::MAX_RUN_CYCLES)
+        {
+            m_jit->countFallback();
+            break;
+        }
+
+        m_jitBailout = false;
+        block->code(this);
+
+        m_jit->countRun(!m_jitBailout);
+        if (m_jitBailout)
+            break;
+
+        // e.g. a CLI with the IRQ line asserted
+        if (isInterruptPending())
+            break;
+
+        block = m_jit->lookup(PC);
+    }
+
+    if (m_jitCycles == 0)
+        return false;
+
+    m_nWaitCycles = m_jitCycles;
+    return true;
+}
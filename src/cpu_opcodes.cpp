@@ -15,22 +15,19 @@
 uint8_t Cpu::OpLDA()
 {
     A = read(m_targetAddress);
-    setFlag(FlagIndex::Zero,     A == 0x00);
-    setFlag(FlagIndex::Negative, A & 0x80);
+    setNZ(A);
     return 0x01;
 }
 uint8_t Cpu::OpLDX()
 {
     X = read(m_targetAddress);
-    setFlag(FlagIndex::Zero,     X == 0x00);
-    setFlag(FlagIndex::Negative, X & 0x80);
+    setNZ(X);
     return 0x01;
 }
 uint8_t Cpu::OpLDY()
 {
     Y = read(m_targetAddress);
-    setFlag(FlagIndex::Zero,     Y == 0x00);
-    setFlag(FlagIndex::Negative, Y & 0x80);
+    setNZ(Y);
     return 0x01;
 }
 uint8_t Cpu::OpSTA()
@@ -53,29 +50,25 @@ uint8_t Cpu::OpSTY()
 uint8_t Cpu::OpTAX()
 {
     X = A;
-    setFlag(FlagIndex::Zero,     X == 0x00);
-    setFlag(FlagIndex::Negative, X & 0x80);
+    setNZ(X);
     return 0x00;
 }
 uint8_t Cpu::OpTAY()
 {
     Y = A;
-    setFlag(FlagIndex::Zero,     Y == 0x00);
-    setFlag(FlagIndex::Negative, Y & 0x80);
+    setNZ(Y);
     return 0x00;
 }
 uint8_t Cpu::OpTXA()
 {
     A = X;
-    setFlag(FlagIndex::Zero,     A == 0x00);
-    setFlag(FlagIndex::Negative, A & 0x80);
+    setNZ(A);
     return 0x00;
 }
 uint8_t Cpu::OpTYA()
 {
     A = Y;
-    setFlag(FlagIndex::Zero,     A == 0x00);
-    setFlag(FlagIndex::Negative, A & 0x80);
+    setNZ(A);
     return 0x00;
 }
 
@@ -83,8 +76,7 @@ uint8_t Cpu::OpTYA()
 uint8_t Cpu::OpTSX()
 {
     X = SP;
-    setFlag(FlagIndex::Zero,     X == 0x00);
-    setFlag(FlagIndex::Negative, X & 0x80);
+    setNZ(X);
     return 0x00;
 }
 uint8_t Cpu::OpTXS()
@@ -100,7 +92,7 @@ uint8_t Cpu::OpPHA()
 }
 uint8_t Cpu::OpPHP()
 {
-    uint8_t value = P;
+    uint8_t value = status();
     value |= 0b00110000; // the B flag and extra bit are pushed as 1
     pushStack(value);
     return 0x00;
@@ -108,15 +100,15 @@ uint8_t Cpu::OpPHP()
 uint8_t Cpu::OpPLA()
 {
     A = popStack();
-    setFlag(FlagIndex::Zero,     A == 0x00);
-    setFlag(FlagIndex::Negative, A & 0x80);
+    setNZ(A);
     return 0x00;
 }
 uint8_t Cpu::OpPLP()
 {
-    P = popStack();
-    P &= ~(0b00010000); // clear B flag, just for consistency with nestest log
-    P |=   0b00100000; // extra bit is always set, just for consistency with nestest log
+    uint8_t value = popStack();
+    value &= ~(0b00010000); // clear B flag, just for consistency with nestest log
+    value |=   0b00100000; // extra bit is always set, just for consistency with nestest log
+    setStatus(value);
     return 0x00;
 }
 
@@ -124,22 +116,19 @@ uint8_t Cpu::OpPLP()
 uint8_t Cpu::OpAND()
 {
     A = A & read(m_targetAddress);
-    setFlag(FlagIndex::Zero,     A == 0x00);
-    setFlag(FlagIndex::Negative, A & 0x80);
+    setNZ(A);
     return 0x01;
 }
 uint8_t Cpu::OpEOR()
 {
     A = A ^ read(m_targetAddress);
-    setFlag(FlagIndex::Zero,     A == 0x00);
-    setFlag(FlagIndex::Negative, A & 0x80);
+    setNZ(A);
     return 0x01;
 }
 uint8_t Cpu::OpORA()
 {
     A = A | read(m_targetAddress);
-    setFlag(FlagIndex::Zero,     A == 0x00);
-    setFlag(FlagIndex::Negative, A & 0x80);
+    setNZ(A);
     return 0x01;
 }
 uint8_t Cpu::OpBIT()
@@ -163,8 +152,7 @@ uint8_t Cpu::OpADC()
     A = Aout;
     
     setFlag(FlagIndex::Carry,  res >= 0x0100);
-    setFlag(FlagIndex::Zero,     A == 0x00);
-    setFlag(FlagIndex::Negative, A &  0x80);
+    setNZ(A);
     // for an explanation on Overflow
     // see http://www.6502.org/tutorials/vflag.html
     // and https://www.righto.com/2012/12/the-6502-overflow-flag-explained.html
@@ -183,8 +171,7 @@ uint8_t Cpu::OpSBC()
     A = Aout;
 
     setFlag(FlagIndex::Carry,    !(res >= 0x0100));
-    setFlag(FlagIndex::Zero,     A == 0x00);
-    setFlag(FlagIndex::Negative, A & 0x80);
+    setNZ(A);
     setFlag(FlagIndex::Overflow, overflowOut);
     
     return 0x01;
@@ -193,24 +180,21 @@ uint8_t Cpu::OpCMP()
 {
     int16_t res = A - read(m_targetAddress);
     setFlag(FlagIndex::Carry,    res >= 0x00);
-    setFlag(FlagIndex::Zero,     res == 0x00);
-    setFlag(FlagIndex::Negative, res  & 0x80);
+    setNZ(res);
     return 0x01;
 }
 uint8_t Cpu::OpCPX()
 {
     int16_t res = X - read(m_targetAddress);
     setFlag(FlagIndex::Carry,    res >= 0x00);
-    setFlag(FlagIndex::Zero,     res == 0x00);
-    setFlag(FlagIndex::Negative, res  & 0x80);
+    setNZ(res);
     return 0x00;
 }
 uint8_t Cpu::OpCPY()
 {
     int16_t res = Y - read(m_targetAddress);
     setFlag(FlagIndex::Carry,    res >= 0x00);
-    setFlag(FlagIndex::Zero,     res == 0x00);
-    setFlag(FlagIndex::Negative, res  & 0x80);
+    setNZ(res);
     return 0x00;
 }
 
@@ -219,103 +203,95 @@ uint8_t Cpu::OpINC()
 {
     uint8_t res = read(m_targetAddress) + 1;
     write(m_targetAddress, res);
-    setFlag(FlagIndex::Zero,     res == 0x00);
-    setFlag(FlagIndex::Negative, res & 0x80);
+    setNZ(res);
     return 0x00;
 }
 uint8_t Cpu::OpINX()
 {
     X = X + 1;
-    setFlag(FlagIndex::Zero,     X == 0x00);
-    setFlag(FlagIndex::Negative, X & 0x80);
+    setNZ(X);
     return 0x00;
 }
 uint8_t Cpu::OpINY()
 {
     Y = Y + 1;
-    setFlag(FlagIndex::Zero,     Y == 0x00);
-    setFlag(FlagIndex::Negative, Y & 0x80);
+    setNZ(Y);
     return 0x00;
 }
 uint8_t Cpu::OpDEC()
 {
     uint8_t res = read(m_targetAddress) - 1;
     write(m_targetAddress, res);
-    setFlag(FlagIndex::Zero,     res == 0x00);
-    setFlag(FlagIndex::Negative, res & 0x80);
+    setNZ(res);
     return 0x00;
 }
 uint8_t Cpu::OpDEX()
 {
     X = X - 1;
-    setFlag(FlagIndex::Zero,     X == 0x00);
-    setFlag(FlagIndex::Negative, X & 0x80);
+    setNZ(X);
     return 0x00;
 }
 uint8_t Cpu::OpDEY()
 {
     Y = Y - 1;
-    setFlag(FlagIndex::Zero,     Y == 0x00);
-    setFlag(FlagIndex::Negative, Y & 0x80);
+    setNZ(Y);
     return 0x00;
 }
 
 //-- Shifts --
+// read-modify-write operations are templated on the addressing mode,
+// the accumulator variant is resolved at compile time
+template<AddrMode mode>
 uint8_t Cpu::OpASL()
 {
-    if (m_currAddrMode == &Cpu::AddrACC) {
+    if constexpr (mode == AddrMode::ACC) {
         setFlag(FlagIndex::Carry, A & 0x80);
         A <<= 1;
-        setFlag(FlagIndex::Zero, A == 0x00);
-        setFlag(FlagIndex::Negative, A & 0x80);        
+        setNZ(A);
     }
     else
     {
         uint8_t value = read(m_targetAddress);
         setFlag(FlagIndex::Carry, value & 0x80);
         value <<= 1;
-        setFlag(FlagIndex::Zero, value == 0x00);
-        setFlag(FlagIndex::Negative, value & 0x80);
+        setNZ(value);
         write(m_targetAddress, value);
     }
 
     return 0x00;
 }
+template<AddrMode mode>
 uint8_t Cpu::OpLSR()
 {
-    if (m_currAddrMode == &Cpu::AddrACC) {
+    if constexpr (mode == AddrMode::ACC) {
         setFlag(FlagIndex::Carry, A & 0x01);
         A >>= 1;
-        setFlag(FlagIndex::Zero, A == 0x00);
-        //setFlag(FlagIndex::Negative, A & 0x80);        
+        setNZ(A); // N is always cleared
     }
     else
     {
         uint8_t value = read(m_targetAddress);
         setFlag(FlagIndex::Carry, value & 0x01);
         value >>= 1;
-        setFlag(FlagIndex::Zero, value == 0x00);
-        //setFlag(FlagIndex::Negative, value & 0x80);
+        setNZ(value); // N is always cleared
         write(m_targetAddress, value);
     }
 
-    setFlag(FlagIndex::Negative, 0x0);
-
     return 0x00;
 }
+template<AddrMode mode>
 uint8_t Cpu::OpROL()
 {
     uint8_t oldCarry = hasFlag(FlagIndex::Carry);
 
-    if (m_currAddrMode == &Cpu::AddrACC) {
+    if constexpr (mode == AddrMode::ACC) {
         setFlag(FlagIndex::Carry, A & 0x80);
         A <<= 1;
         if (oldCarry)
             A |= 0x01;
         else
             A &= (~0x01);
-        setFlag(FlagIndex::Zero, A == 0x00);
-        setFlag(FlagIndex::Negative, A & 0x80);
+        setNZ(A);
     }
     else
     {
@@ -326,26 +302,25 @@ uint8_t Cpu::OpROL()
             value |= 0x01;
         else
             value &= (~0x01);
-        setFlag(FlagIndex::Zero, value == 0x00);
-        setFlag(FlagIndex::Negative, value & 0x80);
+        setNZ(value);
         write(m_targetAddress, value);
     }
 
     return 0x00;
 }
+template<AddrMode mode>
 uint8_t Cpu::OpROR()
 {
     uint8_t oldCarry = hasFlag(FlagIndex::Carry);
 
-    if (m_currAddrMode == &Cpu::AddrACC) {
+    if constexpr (mode == AddrMode::ACC) {
         setFlag(FlagIndex::Carry, A & 0x01);
         A >>= 1;
         if (oldCarry)
             A |= 0x80;
         else
             A &= (~0x80);
-        setFlag(FlagIndex::Zero, A == 0x00);
-        setFlag(FlagIndex::Negative, A & 0x80);        
+        setNZ(A);
     }
     else
     {
@@ -356,13 +331,34 @@ uint8_t Cpu::OpROR()
             value |= 0x80;
         else
             value &= (~0x80);
-        setFlag(FlagIndex::Zero, value == 0x00);
-        setFlag(FlagIndex::Negative, value & 0x80);
+        setNZ(value);
         write(m_targetAddress, value);
     }
     return 0x00;
 }
 
+// instantiated for the addressing modes of instructionLookupTable
+template uint8_t Cpu::OpASL<AddrMode::ACC>();
+template uint8_t Cpu::OpASL<AddrMode::ZP0>();
+template uint8_t Cpu::OpASL<AddrMode::ZPX>();
+template uint8_t Cpu::OpASL<AddrMode::ABS>();
+template uint8_t Cpu::OpASL<AddrMode::ABX>();
+template uint8_t Cpu::OpLSR<AddrMode::ACC>();
+template uint8_t Cpu::OpLSR<AddrMode::ZP0>();
+template uint8_t Cpu::OpLSR<AddrMode::ZPX>();
+template uint8_t Cpu::OpLSR<AddrMode::ABS>();
+template uint8_t Cpu::OpLSR<AddrMode::ABX>();
+template uint8_t Cpu::OpROL<AddrMode::ACC>();
+template uint8_t Cpu::OpROL<AddrMode::ZP0>();
+template uint8_t Cpu::OpROL<AddrMode::ZPX>();
+template uint8_t Cpu::OpROL<AddrMode::ABS>();
+template uint8_t Cpu::OpROL<AddrMode::ABX>();
+template uint8_t Cpu::OpROR<AddrMode::ACC>();
+template uint8_t Cpu::OpROR<AddrMode::ZP0>();
+template uint8_t Cpu::OpROR<AddrMode::ZPX>();
+template uint8_t Cpu::OpROR<AddrMode::ABS>();
+template uint8_t Cpu::OpROR<AddrMode::ABX>();
+
 //-- Jumps & Calls --
 uint8_t Cpu::OpJMP()
 {
@@ -538,7 +534,7 @@ uint8_t Cpu::OpBRK()
     PC = PC + 2;
     pushStack((PC & 0xff00) >> 8);
     pushStack(PC & 0xff);
-    pushStack(P);
+    pushStack(status());
 
     uint16_t lo = m_bus->read(0xFFFE);
     uint16_t hi = m_bus->read(0xFFFF);
@@ -555,8 +551,10 @@ uint8_t Cpu::OpNOP()
 uint8_t Cpu::OpRTI()
 {
     uint8_t Pnew = popStack();
-    assignBits(&P, Pnew, 0, 0, 4);
-    assignBits(&P, Pnew, 6, 6, 2);
+    uint8_t value = status();
+    assignBits(&value, Pnew, 0, 0, 4);
+    assignBits(&value, Pnew, 6, 6, 2);
+    setStatus(value);
 
     //P |= 0b0010000;
     uint16_t lo = popStack();
@@ -572,8 +570,7 @@ uint8_t Cpu::OpLAX()
     //LDA + LDX
     A = read(m_targetAddress);
     X = A;
-    setFlag(FlagIndex::Zero,     A == 0x00);
-    setFlag(FlagIndex::Negative, A & 0x80);
+    setNZ(A);
 
     return 0x01;
 }
@@ -592,8 +589,7 @@ uint8_t Cpu::OpDCP()
     write(m_targetAddress, value);
 
     setFlag(FlagIndex::Carry,    res >= 0x00);
-    setFlag(FlagIndex::Zero,     res == 0x00);
-    setFlag(FlagIndex::Negative, res  & 0x80);
+    setNZ(res);
 
     return 0x00;
 }
@@ -611,8 +607,7 @@ uint8_t Cpu::OpISB()
     write(m_targetAddress, value);
 
     setFlag(FlagIndex::Carry,    !(res >= 0x0100));
-    setFlag(FlagIndex::Zero,     A == 0x00);
-    setFlag(FlagIndex::Negative, A  & 0x80);
+    setNZ(A);
     setFlag(FlagIndex::Overflow, overflowOut);
 
     return 0x00;
@@ -628,8 +623,7 @@ uint8_t Cpu::OpSLO()
     A = A | value;
     write(m_targetAddress, value);
 
-    setFlag(FlagIndex::Zero,     A == 0x00);
-    setFlag(FlagIndex::Negative, A  & 0x80);
+    setNZ(A);
 
     return 0x00;
 }
@@ -650,8 +644,7 @@ uint8_t Cpu::OpRLA()
     A = A & value;
     write(m_targetAddress, value);
     
-    setFlag(FlagIndex::Zero,     A == 0x00);
-    setFlag(FlagIndex::Negative, A  & 0x80);
+    setNZ(A);
 
     return 0x00;
 }
@@ -666,8 +659,7 @@ uint8_t Cpu::OpSRE()
     A = A ^ value;
     write(m_targetAddress, value);
 
-    setFlag(FlagIndex::Zero,     A == 0x00);
-    setFlag(FlagIndex::Negative, A  & 0x80);
+    setNZ(A);
 
     return 0x00;
 }
@@ -695,8 +687,7 @@ uint8_t Cpu::OpRRA()
     write(m_targetAddress, value);
     
     setFlag(FlagIndex::Carry,  res >= 0x0100);
-    setFlag(FlagIndex::Zero,     A == 0x00);
-    setFlag(FlagIndex::Negative, A  & 0x80);
+    setNZ(A);
     setFlag(FlagIndex::Overflow, overflowOut);
 
     return 0x00;
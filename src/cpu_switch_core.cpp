@@ -0,0 +1,291 @@
+#include "cpu.hpp"
+
+#include "bus.hpp"
+#include "instructions.hpp"
+
+
+//---- switch interpreter core ----
+// one dispatch per opcode: addressing mode, operation and cycle count
+// are read from the constexpr instructionLookupTable at compile time
+// for every case, so the calls are direct and can be inlined instead
+// of going through the cpuAddrModes/cpuOpcodeOperations member pointers.
+// The cases are generated by scripts/write_instruction_table.py --switch
+
+
+template<uint8_t opcode>
+inline void Cpu::fused()
+{
+    constexpr Instruction instr = instructionLookupTable[opcode];
+    constexpr auto addrMode = cpuAddrModes[(int)instr.addrMode];
+    constexpr auto operate  = cpuOpcodeOperations[opcode];
+
+    m_nWaitCycles = instr.nCycles;
+
+    uint8_t extraCycles = (this->*addrMode)();
+    extraCycles &= (this->*operate)();
+    m_nWaitCycles += extraCycles;
+}
+
+
+void Cpu::executeSwitch(uint8_t opcode)
+{
+    switch (opcode)
+    {
+        case 0x00: fused<0x00>(); break;
+        case 0x01: fused<0x01>(); break;
+        case 0x02: fused<0x02>(); break;
+        case 0x03: fused<0x03>(); break;
+        case 0x04: fused<0x04>(); break;
+        case 0x05: fused<0x05>(); break;
+        case 0x06: fused<0x06>(); break;
+        case 0x07: fused<0x07>(); break;
+        case 0x08: fused<0x08>(); break;
+        case 0x09: fused<0x09>(); break;
+        case 0x0A: fused<0x0A>(); break;
+        case 0x0B: fused<0x0B>(); break;
+        case 0x0C: fused<0x0C>(); break;
+        case 0x0D: fused<0x0D>(); break;
+        case 0x0E: fused<0x0E>(); break;
+        case 0x0F: fused<0x0F>(); break;
+        case 0x10: fused<0x10>(); break;
+        case 0x11: fused<0x11>(); break;
+        case 0x12: fused<0x12>(); break;
+        case 0x13: fused<0x13>(); break;
+        case 0x14: fused<0x14>(); break;
+        case 0x15: fused<0x15>(); break;
+        case 0x16: fused<0x16>(); break;
+        case 0x17: fused<0x17>(); break;
+        case 0x18: fused<0x18>(); break;
+        case 0x19: fused<0x19>(); break;
+        case 0x1A: fused<0x1A>(); break;
+        case 0x1B: fused<0x1B>(); break;
+        case 0x1C: fused<0x1C>(); break;
+        case 0x1D: fused<0x1D>(); break;
+        case 0x1E: fused<0x1E>(); break;
+        case 0x1F: fused<0x1F>(); break;
+        case 0x20: fused<0x20>(); break;
+        case 0x21: fused<0x21>(); break;
+        case 0x22: fused<0x22>(); break;
+        case 0x23: fused<0x23>(); break;
+        case 0x24: fused<0x24>(); break;
+        case 0x25: fused<0x25>(); break;
+        case 0x26: fused<0x26>(); break;
+        case 0x27: fused<0x27>(); break;
+        case 0x28: fused<0x28>(); break;
+        case 0x29: fused<0x29>(); break;
+        case 0x2A: fused<0x2A>(); break;
+        case 0x2B: fused<0x2B>(); break;
+        case 0x2C: fused<0x2C>(); break;
+        case 0x2D: fused<0x2D>(); break;
+        case 0x2E: fused<0x2E>(); break;
+        case 0x2F: fused<0x2F>(); break;
+        case 0x30: fused<0x30>(); break;
+        case 0x31: fused<0x31>(); break;
+        case 0x32: fused<0x32>(); break;
+        case 0x33: fused<0x33>(); break;
+        case 0x34: fused<0x34>(); break;
+        case 0x35: fused<0x35>(); break;
+        case 0x36: fused<0x36>(); break;
+        case 0x37: fused<0x37>(); break;
+        case 0x38: fused<0x38>(); break;
+        case 0x39: fused<0x39>(); break;
+        case 0x3A: fused<0x3A>(); break;
+        case 0x3B: fused<0x3B>(); break;
+        case 0x3C: fused<0x3C>(); break;
+        case 0x3D: fused<0x3D>(); break;
+        case 0x3E: fused<0x3E>(); break;
+        case 0x3F: fused<0x3F>(); break;
+        case 0x40: fused<0x40>(); break;
+        case 0x41: fused<0x41>(); break;
+        case 0x42: fused<0x42>(); break;
+        case 0x43: fused<0x43>(); break;
+        case 0x44: fused<0x44>(); break;
+        case 0x45: fused<0x45>(); break;
+        case 0x46: fused<0x46>(); break;
+        case 0x47: fused<0x47>(); break;
+        case 0x48: fused<0x48>(); break;
+        case 0x49: fused<0x49>(); break;
+        case 0x4A: fused<0x4A>(); break;
+        case 0x4B: fused<0x4B>(); break;
+        case 0x4C: fused<0x4C>(); break;
+        case 0x4D: fused<0x4D>(); break;
+        case 0x4E: fused<0x4E>(); break;
+        case 0x4F: fused<0x4F>(); break;
+        case 0x50: fused<0x50>(); break;
+        case 0x51: fused<0x51>(); break;
+        case 0x52: fused<0x52>(); break;
+        case 0x53: fused<0x53>(); break;
+        case 0x54: fused<0x54>(); break;
+        case 0x55: fused<0x55>(); break;
+        case 0x56: fused<0x56>(); break;
+        case 0x57: fused<0x57>(); break;
+        case 0x58: fused<0x58>(); break;
+        case 0x59: fused<0x59>(); break;
+        case 0x5A: fused<0x5A>(); break;
+        case 0x5B: fused<0x5B>(); break;
+        case 0x5C: fused<0x5C>(); break;
+        case 0x5D: fused<0x5D>(); break;
+        case 0x5E: fused<0x5E>(); break;
+        case 0x5F: fused<0x5F>(); break;
+        case 0x60: fused<0x60>(); break;
+        case 0x61: fused<0x61>(); break;
+        case 0x62: fused<0x62>(); break;
+        case 0x63: fused<0x63>(); break;
+        case 0x64: fused<0x64>(); break;
+        case 0x65: fused<0x65>(); break;
+        case 0x66: fused<0x66>(); break;
+        case 0x67: fused<0x67>(); break;
+        case 0x68: fused<0x68>(); break;
+        case 0x69: fused<0x69>(); break;
+        case 0x6A: fused<0x6A>(); break;
+        case 0x6B: fused<0x6B>(); break;
+        case 0x6C: fused<0x6C>(); break;
+        case 0x6D: fused<0x6D>(); break;
+        case 0x6E: fused<0x6E>(); break;
+        case 0x6F: fused<0x6F>(); break;
+        case 0x70: fused<0x70>(); break;
+        case 0x71: fused<0x71>(); break;
+        case 0x72: fused<0x72>(); break;
+        case 0x73: fused<0x73>(); break;
+        case 0x74: fused<0x74>(); break;
+        case 0x75: fused<0x75>(); break;
+        case 0x76: fused<0x76>(); break;
+        case 0x77: fused<0x77>(); break;
+        case 0x78: fused<0x78>(); break;
+        case 0x79: fused<0x79>(); break;
+        case 0x7A: fused<0x7A>(); break;
+        case 0x7B: fused<0x7B>(); break;
+        case 0x7C: fused<0x7C>(); break;
+        case 0x7D: fused<0x7D>(); break;
+        case 0x7E: fused<0x7E>(); break;
+        case 0x7F: fused<0x7F>(); break;
+        case 0x80: fused<0x80>(); break;
+        case 0x81: fused<0x81>(); break;
+        case 0x82: fused<0x82>(); break;
+        case 0x83: fused<0x83>(); break;
+        case 0x84: fused<0x84>(); break;
+        case 0x85: fused<0x85>(); break;
+        case 0x86: fused<0x86>(); break;
+        case 0x87: fused<0x87>(); break;
+        case 0x88: fused<0x88>(); break;
+        case 0x89: fused<0x89>(); break;
+        case 0x8A: fused<0x8A>(); break;
+        case 0x8B: fused<0x8B>(); break;
+        case 0x8C: fused<0x8C>(); break;
+        case 0x8D: fused<0x8D>(); break;
+        case 0x8E: fused<0x8E>(); break;
+        case 0x8F: fused<0x8F>(); break;
+        case 0x90: fused<0x90>(); break;
+        case 0x91: fused<0x91>(); break;
+        case 0x92: fused<0x92>(); break;
+        case 0x93: fused<0x93>(); break;
+        case 0x94: fused<0x94>(); break;
+        case 0x95: fused<0x95>(); break;
+        case 0x96: fused<0x96>(); break;
+        case 0x97: fused<0x97>(); break;
+        case 0x98: fused<0x98>(); break;
+        case 0x99: fused<0x99>(); break;
+        case 0x9A: fused<0x9A>(); break;
+        case 0x9B: fused<0x9B>(); break;
+        case 0x9C: fused<0x9C>(); break;
+        case 0x9D: fused<0x9D>(); break;
+        case 0x9E: fused<0x9E>(); break;
+        case 0x9F: fused<0x9F>(); break;
+        case 0xA0: fused<0xA0>(); break;
+        case 0xA1: fused<0xA1>(); break;
+        case 0xA2: fused<0xA2>(); break;
+        case 0xA3: fused<0xA3>(); break;
+        case 0xA4: fused<0xA4>(); break;
+        case 0xA5: fused<0xA5>(); break;
+        case 0xA6: fused<0xA6>(); break;
+        case 0xA7: fused<0xA7>(); break;
+        case 0xA8: fused<0xA8>(); break;
+        case 0xA9: fused<0xA9>(); break;
+        case 0xAA: fused<0xAA>(); break;
+        case 0xAB: fused<0xAB>(); break;
+        case 0xAC: fused<0xAC>(); break;
+        case 0xAD: fused<0xAD>(); break;
+        case 0xAE: fused<0xAE>(); break;
+        case 0xAF: fused<0xAF>(); break;
+        case 0xB0: fused<0xB0>(); break;
+        case 0xB1: fused<0xB1>(); break;
+        case 0xB2: fused<0xB2>(); break;
+        case 0xB3: fused<0xB3>(); break;
+        case 0xB4: fused<0xB4>(); break;
+        case 0xB5: fused<0xB5>(); break;
+        case 0xB6: fused<0xB6>(); break;
+        case 0xB7: fused<0xB7>(); break;
+        case 0xB8: fused<0xB8>(); break;
+        case 0xB9: fused<0xB9>(); break;
+        case 0xBA: fused<0xBA>(); break;
+        case 0xBB: fused<0xBB>(); break;
+        case 0xBC: fused<0xBC>(); break;
+        case 0xBD: fused<0xBD>(); break;
+        case 0xBE: fused<0xBE>(); break;
+        case 0xBF: fused<0xBF>(); break;
+        case 0xC0: fused<0xC0>(); break;
+        case 0xC1: fused<0xC1>(); break;
+        case 0xC2: fused<0xC2>(); break;
+        case 0xC3: fused<0xC3>(); break;
+        case 0xC4: fused<0xC4>(); break;
+        case 0xC5: fused<0xC5>(); break;
+        case 0xC6: fused<0xC6>(); break;
+        case 0xC7: fused<0xC7>(); break;
+        case 0xC8: fused<0xC8>(); break;
+        case 0xC9: fused<0xC9>(); break;
+        case 0xCA: fused<0xCA>(); break;
+        case 0xCB: fused<0xCB>(); break;
+        case 0xCC: fused<0xCC>(); break;
+        case 0xCD: fused<0xCD>(); break;
+        case 0xCE: fused<0xCE>(); break;
+        case 0xCF: fused<0xCF>(); break;
+        case 0xD0: fused<0xD0>(); break;
+        case 0xD1: fused<0xD1>(); break;
+        case 0xD2: fused<0xD2>(); break;
+        case 0xD3: fused<0xD3>(); break;
+        case 0xD4: fused<0xD4>(); break;
+        case 0xD5: fused<0xD5>(); break;
+        case 0xD6: fused<0xD6>(); break;
+        case 0xD7: fused<0xD7>(); break;
+        case 0xD8: fused<0xD8>(); break;
+        case 0xD9: fused<0xD9>(); break;
+        case 0xDA: fused<0xDA>(); break;
+        case 0xDB: fused<0xDB>(); break;
+        case 0xDC: fused<0xDC>(); break;
+        case 0xDD: fused<0xDD>(); break;
+        case 0xDE: fused<0xDE>(); break;
+        case 0xDF: fused<0xDF>(); break;
+        case 0xE0: fused<0xE0>(); break;
+        case 0xE1: fused<0xE1>(); break;
+        case 0xE2: fused<0xE2>(); break;
+        case 0xE3: fused<0xE3>(); break;
+        case 0xE4: fused<0xE4>(); break;
+        case 0xE5: fused<0xE5>(); break;
+        case 0xE6: fused<0xE6>(); break;
+        case 0xE7: fused<0xE7>(); break;
+        case 0xE8: fused<0xE8>(); break;
+        case 0xE9: fused<0xE9>(); break;
+        case 0xEA: fused<0xEA>(); break;
+        case 0xEB: fused<0xEB>(); break;
+        case 0xEC: fused<0xEC>(); break;
+        case 0xED: fused<0xED>(); break;
+        case 0xEE: fused<0xEE>(); break;
+        case 0xEF: fused<0xEF>(); break;
+        case 0xF0: fused<0xF0>(); break;
+        case 0xF1: fused<0xF1>(); break;
+        case 0xF2: fused<0xF2>(); break;
+        case 0xF3: fused<0xF3>(); break;
+        case 0xF4: fused<0xF4>(); break;
+        case 0xF5: fused<0xF5>(); break;
+        case 0xF6: fused<0xF6>(); break;
+        case 0xF7: fused<0xF7>(); break;
+        case 0xF8: fused<0xF8>(); break;
+        case 0xF9: fused<0xF9>(); break;
+        case 0xFA: fused<0xFA>(); break;
+        case 0xFB: fused<0xFB>(); break;
+        case 0xFC: fused<0xFC>(); break;
+        case 0xFD: fused<0xFD>(); break;
+        case 0xFE: fused<0xFE>(); break;
+        case 0xFF: fused<0xFF>(); break;
+    }
+}
@@ -4,6 +4,8 @@
 
 #include <print>
 #include <cstdio>
+#include <cstring>
+#include <chrono>
 
 
 
@@ -24,6 +26,12 @@ bool Display::initSystemPalette(const char* palFile)
         return false;
     }
 
+    for (int i=0; i < 64; i++)
+    {
+        uint8_t* color = m_systemPalette + 3*i;
+        m_rgbaPalette[i] = (color[0] << 24) | (color[1] << 16) | (color[2] << 8) | 0xff;
+    }
+
     // dumpSystemPaletteEntry(0x0F);
     // dumpSystemPaletteEntry(0x15);
     // dumpSystemPaletteEntry(0x2C);
@@ -59,12 +67,29 @@ bool Display::initSdl()
 
     renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
     if (!renderer)
+    {
+        // no GPU: the texture path works the same on the software renderer
+        std::println("Accelerated renderer not available, falling back to software");
+        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
+    }
+    if (!renderer)
     {
         std::println("Renderer could not be created!");
         std::println("SDL_Error: {}", SDL_GetError());
         return false;
     }
 
+    // nearest-pixel scaling of the frame to the window
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "0");
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING,
+                                Ppu::SCREEN_WIDTH, Ppu::SCREEN_HEIGHT);
+    if (!texture)
+    {
+        std::println("Texture could not be created!");
+        std::println("SDL_Error: {}", SDL_GetError());
+        return false;
+    }
+
     clear();
 
     return true;
@@ -72,6 +97,9 @@ bool Display::initSdl()
 
 void Display::shutdownSdl()
 {
+    if (texture)
+        SDL_DestroyTexture(texture);
+
     if (renderer)
         SDL_DestroyRenderer(renderer);
 
@@ -91,24 +119,29 @@ void Display::clear()
 }
 
 
-void Display::render(const uint8_t *pixels)
+void Display::render(const uint32_t *pixels)
 {
-    //clear();
+    auto start = std::chrono::high_resolution_clock::now();
 
-    for (auto x=0; x < Ppu::SCREEN_WIDTH; x++)
+    void* texturePixels;
+    int pitch;
+    if (SDL_LockTexture(texture, nullptr, &texturePixels, &pitch) == 0)
     {
+        // rows can be padded in the texture
+        static const int rowSize = Ppu::SCREEN_WIDTH * sizeof(uint32_t);
         for (auto y=0; y < Ppu::SCREEN_HEIGHT; y++)
-        {
-            uint8_t colorIndex = pixels[x*Ppu::SCREEN_HEIGHT + y];
-            uint8_t* color = m_systemPalette + 3*colorIndex;
-            SDL_SetRenderDrawColor(renderer, color[0], color[1], color[2], 0xff);
-
-            SDL_Rect rect(x*SCALE_FACTOR, y*SCALE_FACTOR, SCALE_FACTOR, SCALE_FACTOR);
-            SDL_RenderFillRect(renderer, &rect);
-        }
+            memcpy((uint8_t*)texturePixels + y*pitch, pixels + y*Ppu::SCREEN_WIDTH, rowSize);
+
+        SDL_UnlockTexture(texture);
     }
-    
+
+    SDL_RenderCopy(renderer, texture, nullptr, nullptr);
     SDL_RenderPresent(renderer);
+
+    auto end = std::chrono::high_resolution_clock::now();
+    m_lastRenderMicros = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    m_totRenderMicros += m_lastRenderMicros;
+    m_nRenderedFrames ++;
 }
 
 
@@ -119,6 +152,16 @@ void Display::refresh()
 }
 
 
+void Display::printStats()
+{
+    if (m_nRenderedFrames == 0)
+        return;
+
+    std::println("display: {} frames rendered, {:.1f} us per frame on average",
+        m_nRenderedFrames, (double)m_totRenderMicros / m_nRenderedFrames);
+}
+
+
 void Display::dumpSystemPaletteEntry(uint8_t paletteIndex)
 {
     std::println("system palette entry 0x{:02X}: (0x{:02X}, 0x{:02X}, 0x{:02X})", paletteIndex, 
@@ -1,15 +1,25 @@
 #include <print>
+#include <algorithm>
 #include <chrono>
+#include <cstring>
+#include <string>
 
 #include "cartridge.hpp"
 #include "display.hpp"
 #include "keyboard.hpp"
 #include "bus.hpp"
+#include "mapper.hpp"
+#include "log.hpp"
 
 
 const int targetFps = 60;
 const int frameDelay = 1000 / targetFps;
 
+// CPU cycles run between two checks of the main loop, about one frame:
+// runCycles() returns early on frame completion anyway, and the PPU
+// renders in longer stretches when the CPU runs longer batches
+const uint32_t cyclesPerBatch = 29781;
+
 
 int main(int argc, char* argv[])
 {
@@ -17,9 +27,56 @@ int main(int argc, char* argv[])
 
     if (argc < 2) {
         std::println("!! Missing ROM path");
+        std::println("usage: {} <rom> [--core=table|switch|cached|jit] [--per-cycle] [--no-idle-skip] [--trace=<file>] [--profile=<file>] [--log=<category>,...]", argv[0]);
+        std::println("log categories: cpu, ppu-reg, vram, dma, nmi, irq");
         exit(1);
     }
 
+    CpuCore cpuCore = CpuCore::Table;
+    bool perCycle = false;
+    bool idleLoopSkipping = true;
+    const char* tracePath = nullptr;
+    const char* profilePath = nullptr;
+    for (int i=2; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--core=switch"))
+            cpuCore = CpuCore::Switch;
+        else if (!strcmp(argv[i], "--core=cached"))
+            cpuCore = CpuCore::Cached;
+        else if (!strcmp(argv[i], "--core=jit"))
+            cpuCore = CpuCore::Jit;
+        else if (!strcmp(argv[i], "--core=table"))
+            cpuCore = CpuCore::Table;
+        else if (!strcmp(argv[i], "--per-cycle"))
+            perCycle = true;
+        else if (!strcmp(argv[i], "--no-idle-skip"))
+            idleLoopSkipping = false;
+        else if (!strncmp(argv[i], "--trace=", 8))
+            tracePath = argv[i] + 8;
+        else if (!strncmp(argv[i], "--profile=", 10))
+            profilePath = argv[i] + 10;
+        else if (!strncmp(argv[i], "--log=", 6))
+        {
+            std::string categories = argv[i] + 6;
+            size_t start = 0;
+            while (start <= categories.size())
+            {
+                size_t end = std::min(categories.find(',', start), categories.size());
+                std::string name = categories.substr(start, end - start);
+
+                LogCategory category;
+                if (parseLogCategory(name.c_str(), category))
+                    Log::enableCategory(category);
+                else
+                    std::println("!! Ignoring unknown log category {}", name);
+
+                start = end + 1;
+            }
+        }
+        else
+            std::println("!! Ignoring unknown option {}", argv[i]);
+    }
+
     Cartridge* cart;
     try {
         cart = new Cartridge(argv[1]);
@@ -31,9 +88,38 @@ int main(int argc, char* argv[])
     cart->printDiagnostics();
 
     auto bus = new Bus();
-    bus->insertCartridge(cart);
+    try {
+        bus->insertCartridge(cart);
+    } catch (const std::exception& e)  {
+        std::println("!! Error inserting cartridge: {}", e.what());
+        exit(1);
+    }
+    std::println("Mapper: {}", bus->mapper()->name());
     //bus->reset(true);
     bus->reset(false);
+    bus->cpu()->setCore(cpuCore);
+    bus->cpu()->setIdleLoopSkipping(idleLoopSkipping);
+
+    // binary trace, see trace-formatter to read it
+    TraceWriter* traceWriter = nullptr;
+    if (tracePath != nullptr)
+    {
+        traceWriter = new TraceWriter(tracePath);
+        bus->cpu()->setTraceWriter(traceWriter);
+    }
+
+    // report at exit, plus a binary dump of the counters
+    Profiler* profiler = nullptr;
+    if (profilePath != nullptr)
+    {
+        if (Profiler::isCompiledIn())
+        {
+            profiler = new Profiler();
+            bus->cpu()->setProfiler(profiler);
+        }
+        else
+            std::println("!! Ignoring --profile, configure with -DCPU_PROFILER=ON to build the profiler in");
+    }
 
     
     Display* display = new Display();
@@ -51,7 +137,10 @@ int main(int argc, char* argv[])
         return 1;
     }
 
-    Keyboard* keyboard = new Keyboard();
+    // the PPU hands out frames the display can take as they are
+    bus->ppu()->setRgbaPalette(display->rgbaPalette());
+
+    Keyboard* keyboard = new Keyboard(&bus->controller(0));
     
     
     //bus->cpu()->setTracing(true);
@@ -63,16 +152,24 @@ int main(int argc, char* argv[])
 
     // Main loop
     bool running = true;
+    uint64_t nIdleCyclesSkipped = 0;
     std::chrono::time_point<std::chrono::high_resolution_clock> frameStart, frameEnd;
 
     while (running) {
         frameStart = std::chrono::high_resolution_clock::now();
 
-        bus->cpu()->clock();
+        if (perCycle)
+        {
+            bus->cpu()->clock();
 
-        // //PPU clock is 3x CPU clock
-        for (int i=0; i < 3; ++i)
-            bus->ppu()->clock();
+            // //PPU clock is 3x CPU clock
+            for (int i=0; i < 3; ++i)
+                bus->ppu()->clock();
+        }
+        else
+        {
+            bus->runCycles(cyclesPerBatch);
+        }
 
 
         if (bus->ppu()->isFrameComplete()) {
@@ -80,26 +177,64 @@ int main(int argc, char* argv[])
             //bus->ppu()->dumpNameTable();
             //bus->ppu()->dumpPalette();
 
-            display->render(bus->ppu()->frameBuffer());
+            display->render(bus->ppu()->rgbaFrameBuffer());
             bus->ppu()->clearFrameComplete();
 
+            Log::drain(stdout);
+
             frameEnd = std::chrono::high_resolution_clock::now();
             auto frameTime = std::chrono::duration_cast<std::chrono::milliseconds>(frameEnd - frameStart).count();
 
-            std::println("rendered frame; frameTime={}", frameTime);
+            uint64_t nFrameIdleCycles = bus->cpu()->nIdleCyclesSkipped() - nIdleCyclesSkipped;
+            nIdleCyclesSkipped = bus->cpu()->nIdleCyclesSkipped();
+
+            std::println("rendered frame; frameTime={}, renderTime={}us, idle cycles skipped={}",
+                frameTime, display->lastRenderMicros(), nFrameIdleCycles);
 
             if (frameDelay > frameTime) {
                 //display->delay(frameDelay - frameTime);
             }
 
+            // input once per frame, games poll the controllers once per frame anyway
+            running = keyboard->handleEvents();
+            if (!running)
+                std::println("Got SDL quit");
+
             frameStart = std::chrono::high_resolution_clock::now();
         }
+    }
+
+    display->printStats();
+    if (!perCycle)
+        bus->ppu()->printStats();
+    if (cpuCore == CpuCore::Cached)
+        bus->cpu()->blockCache().printStats();
+    if (cpuCore == CpuCore::Jit && bus->cpu()->jit() != nullptr)
+        bus->cpu()->jit()->printStats();
+
+    if (traceWriter != nullptr)
+    {
+        bus->cpu()->setTraceWriter(nullptr);
+        traceWriter->close();
+        std::println("trace: {} instructions written to {}", traceWriter->nRecords(), tracePath);
+        delete traceWriter;
+    }
 
-        running = keyboard->handleEvents();
-        if (!running)
-            std::println("Got SDL quit");
+    Log::drain(stdout);
+    if (Log::nDropped() > 0)
+        std::println("log: {} messages dropped on a full ring", Log::nDropped());
+
+    if (profiler != nullptr)
+    {
+        bus->cpu()->setProfiler(nullptr);
+        profiler->printReport(20);
+        profiler->writeDump(profilePath);
+        std::println("profile: counters written to {}", profilePath);
+        delete profiler;
     }
 
+    if (!cart->flushPrgRam())
+        std::println("!! Error writing save file");
     display->shutdownSdl();
     return 0;
 }
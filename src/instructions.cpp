@@ -1,283 +1,24 @@
 #include "instructions.hpp"
 
-#include "cpu.hpp"
+#include <iterator>
 
 
-struct Instruction instructionLookupTable[256];
+// cold data: only needed for disassembly and tracing
+static const char* const OPERATION_NAMES[] = {
+    "ADC", "AND", "ASL", "BCC", "BCS", "BEQ", "BIT", "BMI", "BNE", "BPL", "BRK", "BVC", "BVS", "CLC",
+    "CLD", "CLI", "CLV", "CMP", "CPX", "CPY", "DEC", "DEX", "DEY", "EOR", "INC", "INX", "INY", "JMP",
+    "JSR", "LDA", "LDX", "LDY", "LSR", "NOP", "ORA", "PHA", "PHP", "PLA", "PLP", "ROL", "ROR", "RTI",
+    "RTS", "SBC", "SEC", "SED", "SEI", "STA", "STX", "STY", "TAX", "TAY", "TSX", "TXA", "TXS", "TYA",
 
+    "LAX", "SAX", "DCP", "ISB", "SLO", "RLA", "SRE", "RRA",
 
-void initInstrLookupTable()
-{
-    for (auto& inst: instructionLookupTable)
-        inst = { "???", &Cpu::OpNOP, &Cpu::AddrIMP, 2 };
-
-    //standard opcodes
-    instructionLookupTable[0x69] = { "ADC", &Cpu::OpADC, &Cpu::AddrIMM, 2, 2 };
-    instructionLookupTable[0x65] = { "ADC", &Cpu::OpADC, &Cpu::AddrZP0, 2, 3 };
-    instructionLookupTable[0x75] = { "ADC", &Cpu::OpADC, &Cpu::AddrZPX, 2, 4 };
-    instructionLookupTable[0x6D] = { "ADC", &Cpu::OpADC, &Cpu::AddrABS, 3, 4 };
-    instructionLookupTable[0x7D] = { "ADC", &Cpu::OpADC, &Cpu::AddrABX, 3, 4 };
-    instructionLookupTable[0x79] = { "ADC", &Cpu::OpADC, &Cpu::AddrABY, 3, 4 };
-    instructionLookupTable[0x61] = { "ADC", &Cpu::OpADC, &Cpu::AddrIZX, 2, 6 };
-    instructionLookupTable[0x71] = { "ADC", &Cpu::OpADC, &Cpu::AddrIZY, 2, 5 };
-    instructionLookupTable[0x29] = { "AND", &Cpu::OpAND, &Cpu::AddrIMM, 2, 2 };
-    instructionLookupTable[0x25] = { "AND", &Cpu::OpAND, &Cpu::AddrZP0, 2, 3 };
-    instructionLookupTable[0x35] = { "AND", &Cpu::OpAND, &Cpu::AddrZPX, 2, 4 };
-    instructionLookupTable[0x2D] = { "AND", &Cpu::OpAND, &Cpu::AddrABS, 3, 4 };
-    instructionLookupTable[0x3D] = { "AND", &Cpu::OpAND, &Cpu::AddrABX, 3, 4 };
-    instructionLookupTable[0x39] = { "AND", &Cpu::OpAND, &Cpu::AddrABY, 3, 4 };
-    instructionLookupTable[0x21] = { "AND", &Cpu::OpAND, &Cpu::AddrIZX, 2, 6 };
-    instructionLookupTable[0x31] = { "AND", &Cpu::OpAND, &Cpu::AddrIZY, 2, 5 };
-    instructionLookupTable[0x0A] = { "ASL", &Cpu::OpASL, &Cpu::AddrACC, 1, 2 };
-    instructionLookupTable[0x06] = { "ASL", &Cpu::OpASL, &Cpu::AddrZP0, 2, 5 };
-    instructionLookupTable[0x16] = { "ASL", &Cpu::OpASL, &Cpu::AddrZPX, 2, 6 };
-    instructionLookupTable[0x0E] = { "ASL", &Cpu::OpASL, &Cpu::AddrABS, 3, 6 };
-    instructionLookupTable[0x1E] = { "ASL", &Cpu::OpASL, &Cpu::AddrABX, 3, 7 };
-    instructionLookupTable[0x24] = { "BIT", &Cpu::OpBIT, &Cpu::AddrZP0, 2, 3 };
-    instructionLookupTable[0x2C] = { "BIT", &Cpu::OpBIT, &Cpu::AddrABS, 3, 4 };
-    instructionLookupTable[0x00] = { "BRK", &Cpu::OpBRK, &Cpu::AddrIMP, 1, 7 };
-    instructionLookupTable[0xC9] = { "CMP", &Cpu::OpCMP, &Cpu::AddrIMM, 2, 2 };
-    instructionLookupTable[0xC5] = { "CMP", &Cpu::OpCMP, &Cpu::AddrZP0, 2, 3 };
-    instructionLookupTable[0xD5] = { "CMP", &Cpu::OpCMP, &Cpu::AddrZPX, 2, 4 };
-    instructionLookupTable[0xCD] = { "CMP", &Cpu::OpCMP, &Cpu::AddrABS, 3, 4 };
-    instructionLookupTable[0xDD] = { "CMP", &Cpu::OpCMP, &Cpu::AddrABX, 3, 4 };
-    instructionLookupTable[0xD9] = { "CMP", &Cpu::OpCMP, &Cpu::AddrABY, 3, 4 };
-    instructionLookupTable[0xC1] = { "CMP", &Cpu::OpCMP, &Cpu::AddrIZX, 2, 6 };
-    instructionLookupTable[0xD1] = { "CMP", &Cpu::OpCMP, &Cpu::AddrIZY, 2, 5 };
-    instructionLookupTable[0xE0] = { "CPX", &Cpu::OpCPX, &Cpu::AddrIMM, 2, 2 };
-    instructionLookupTable[0xE4] = { "CPX", &Cpu::OpCPX, &Cpu::AddrZP0, 2, 3 };
-    instructionLookupTable[0xEC] = { "CPX", &Cpu::OpCPX, &Cpu::AddrABS, 3, 4 };
-    instructionLookupTable[0xC0] = { "CPY", &Cpu::OpCPY, &Cpu::AddrIMM, 2, 2 };
-    instructionLookupTable[0xC4] = { "CPY", &Cpu::OpCPY, &Cpu::AddrZP0, 2, 3 };
-    instructionLookupTable[0xCC] = { "CPY", &Cpu::OpCPY, &Cpu::AddrABS, 3, 4 };
-    instructionLookupTable[0xC6] = { "DEC", &Cpu::OpDEC, &Cpu::AddrZP0, 2, 5 };
-    instructionLookupTable[0xD6] = { "DEC", &Cpu::OpDEC, &Cpu::AddrZPX, 2, 6 };
-    instructionLookupTable[0xCE] = { "DEC", &Cpu::OpDEC, &Cpu::AddrABS, 3, 6 };
-    instructionLookupTable[0xDE] = { "DEC", &Cpu::OpDEC, &Cpu::AddrABX, 3, 7 };
-    instructionLookupTable[0x49] = { "EOR", &Cpu::OpEOR, &Cpu::AddrIMM, 2, 2 };
-    instructionLookupTable[0x45] = { "EOR", &Cpu::OpEOR, &Cpu::AddrZP0, 2, 3 };
-    instructionLookupTable[0x55] = { "EOR", &Cpu::OpEOR, &Cpu::AddrZPX, 2, 4 };
-    instructionLookupTable[0x4D] = { "EOR", &Cpu::OpEOR, &Cpu::AddrABS, 3, 4 };
-    instructionLookupTable[0x5D] = { "EOR", &Cpu::OpEOR, &Cpu::AddrABX, 3, 4 };
-    instructionLookupTable[0x59] = { "EOR", &Cpu::OpEOR, &Cpu::AddrABY, 3, 4 };
-    instructionLookupTable[0x41] = { "EOR", &Cpu::OpEOR, &Cpu::AddrIZX, 2, 6 };
-    instructionLookupTable[0x51] = { "EOR", &Cpu::OpEOR, &Cpu::AddrIZY, 2, 5 };
-    instructionLookupTable[0xE6] = { "INC", &Cpu::OpINC, &Cpu::AddrZP0, 2, 5 };
-    instructionLookupTable[0xF6] = { "INC", &Cpu::OpINC, &Cpu::AddrZPX, 2, 6 };
-    instructionLookupTable[0xEE] = { "INC", &Cpu::OpINC, &Cpu::AddrABS, 3, 6 };
-    instructionLookupTable[0xFE] = { "INC", &Cpu::OpINC, &Cpu::AddrABX, 3, 7 };
-    instructionLookupTable[0x4C] = { "JMP", &Cpu::OpJMP, &Cpu::AddrABS, 3, 3 };
-    instructionLookupTable[0x6C] = { "JMP", &Cpu::OpJMP, &Cpu::AddrIND, 3, 5 };
-    instructionLookupTable[0x20] = { "JSR", &Cpu::OpJSR, &Cpu::AddrABS, 3, 6 };
-    instructionLookupTable[0xA9] = { "LDA", &Cpu::OpLDA, &Cpu::AddrIMM, 2, 2 };
-    instructionLookupTable[0xA5] = { "LDA", &Cpu::OpLDA, &Cpu::AddrZP0, 2, 3 };
-    instructionLookupTable[0xB5] = { "LDA", &Cpu::OpLDA, &Cpu::AddrZPX, 2, 4 };
-    instructionLookupTable[0xAD] = { "LDA", &Cpu::OpLDA, &Cpu::AddrABS, 3, 4 };
-    instructionLookupTable[0xBD] = { "LDA", &Cpu::OpLDA, &Cpu::AddrABX, 3, 4 };
-    instructionLookupTable[0xB9] = { "LDA", &Cpu::OpLDA, &Cpu::AddrABY, 3, 4 };
-    instructionLookupTable[0xA1] = { "LDA", &Cpu::OpLDA, &Cpu::AddrIZX, 2, 6 };
-    instructionLookupTable[0xB1] = { "LDA", &Cpu::OpLDA, &Cpu::AddrIZY, 2, 5 };
-    instructionLookupTable[0xA2] = { "LDX", &Cpu::OpLDX, &Cpu::AddrIMM, 2, 2 };
-    instructionLookupTable[0xA6] = { "LDX", &Cpu::OpLDX, &Cpu::AddrZP0, 2, 3 };
-    instructionLookupTable[0xB6] = { "LDX", &Cpu::OpLDX, &Cpu::AddrZPY, 2, 4 };
-    instructionLookupTable[0xAE] = { "LDX", &Cpu::OpLDX, &Cpu::AddrABS, 3, 4 };
-    instructionLookupTable[0xBE] = { "LDX", &Cpu::OpLDX, &Cpu::AddrABY, 3, 4 };
-    instructionLookupTable[0xA0] = { "LDY", &Cpu::OpLDY, &Cpu::AddrIMM, 2, 2 };
-    instructionLookupTable[0xA4] = { "LDY", &Cpu::OpLDY, &Cpu::AddrZP0, 2, 3 };
-    instructionLookupTable[0xB4] = { "LDY", &Cpu::OpLDY, &Cpu::AddrZPX, 2, 4 };
-    instructionLookupTable[0xAC] = { "LDY", &Cpu::OpLDY, &Cpu::AddrABS, 3, 4 };
-    instructionLookupTable[0xBC] = { "LDY", &Cpu::OpLDY, &Cpu::AddrABX, 3, 4 };
-    instructionLookupTable[0x4A] = { "LSR", &Cpu::OpLSR, &Cpu::AddrACC, 1, 2 };
-    instructionLookupTable[0x46] = { "LSR", &Cpu::OpLSR, &Cpu::AddrZP0, 2, 5 };
-    instructionLookupTable[0x56] = { "LSR", &Cpu::OpLSR, &Cpu::AddrZPX, 2, 6 };
-    instructionLookupTable[0x4E] = { "LSR", &Cpu::OpLSR, &Cpu::AddrABS, 3, 6 };
-    instructionLookupTable[0x5E] = { "LSR", &Cpu::OpLSR, &Cpu::AddrABX, 3, 7 };
-    instructionLookupTable[0xEA] = { "NOP", &Cpu::OpNOP, &Cpu::AddrIMP, 1, 2 };
-    instructionLookupTable[0x09] = { "ORA", &Cpu::OpORA, &Cpu::AddrIMM, 2, 2 };
-    instructionLookupTable[0x05] = { "ORA", &Cpu::OpORA, &Cpu::AddrZP0, 2, 3 };
-    instructionLookupTable[0x15] = { "ORA", &Cpu::OpORA, &Cpu::AddrZPX, 2, 4 };
-    instructionLookupTable[0x0D] = { "ORA", &Cpu::OpORA, &Cpu::AddrABS, 3, 4 };
-    instructionLookupTable[0x1D] = { "ORA", &Cpu::OpORA, &Cpu::AddrABX, 3, 4 };
-    instructionLookupTable[0x19] = { "ORA", &Cpu::OpORA, &Cpu::AddrABY, 3, 4 };
-    instructionLookupTable[0x01] = { "ORA", &Cpu::OpORA, &Cpu::AddrIZX, 2, 6 };
-    instructionLookupTable[0x11] = { "ORA", &Cpu::OpORA, &Cpu::AddrIZY, 2, 5 };
-    instructionLookupTable[0x2A] = { "ROL", &Cpu::OpROL, &Cpu::AddrACC, 1, 2 };
-    instructionLookupTable[0x26] = { "ROL", &Cpu::OpROL, &Cpu::AddrZP0, 2, 5 };
-    instructionLookupTable[0x36] = { "ROL", &Cpu::OpROL, &Cpu::AddrZPX, 2, 6 };
-    instructionLookupTable[0x2E] = { "ROL", &Cpu::OpROL, &Cpu::AddrABS, 3, 6 };
-    instructionLookupTable[0x3E] = { "ROL", &Cpu::OpROL, &Cpu::AddrABX, 3, 7 };
-    instructionLookupTable[0x6A] = { "ROR", &Cpu::OpROR, &Cpu::AddrACC, 1, 2 };
-    instructionLookupTable[0x66] = { "ROR", &Cpu::OpROR, &Cpu::AddrZP0, 2, 5 };
-    instructionLookupTable[0x76] = { "ROR", &Cpu::OpROR, &Cpu::AddrZPX, 2, 6 };
-    instructionLookupTable[0x6E] = { "ROR", &Cpu::OpROR, &Cpu::AddrABS, 3, 6 };
-    instructionLookupTable[0x7E] = { "ROR", &Cpu::OpROR, &Cpu::AddrABX, 3, 7 };
-    instructionLookupTable[0x40] = { "RTI", &Cpu::OpRTI, &Cpu::AddrIMP, 1, 6 };
-    instructionLookupTable[0x60] = { "RTS", &Cpu::OpRTS, &Cpu::AddrIMP, 1, 6 };
-    instructionLookupTable[0xE9] = { "SBC", &Cpu::OpSBC, &Cpu::AddrIMM, 2, 2 };
-    instructionLookupTable[0xEB] = { "SBC", &Cpu::OpSBC, &Cpu::AddrIMM, 2, 2 };
-    instructionLookupTable[0xE5] = { "SBC", &Cpu::OpSBC, &Cpu::AddrZP0, 2, 3 };
-    instructionLookupTable[0xF5] = { "SBC", &Cpu::OpSBC, &Cpu::AddrZPX, 2, 4 };
-    instructionLookupTable[0xED] = { "SBC", &Cpu::OpSBC, &Cpu::AddrABS, 3, 4 };
-    instructionLookupTable[0xFD] = { "SBC", &Cpu::OpSBC, &Cpu::AddrABX, 3, 4 };
-    instructionLookupTable[0xF9] = { "SBC", &Cpu::OpSBC, &Cpu::AddrABY, 3, 4 };
-    instructionLookupTable[0xE1] = { "SBC", &Cpu::OpSBC, &Cpu::AddrIZX, 2, 6 };
-    instructionLookupTable[0xF1] = { "SBC", &Cpu::OpSBC, &Cpu::AddrIZY, 2, 5 };
-    instructionLookupTable[0x85] = { "STA", &Cpu::OpSTA, &Cpu::AddrZP0, 2, 3 };
-    instructionLookupTable[0x95] = { "STA", &Cpu::OpSTA, &Cpu::AddrZPX, 2, 4 };
-    instructionLookupTable[0x8D] = { "STA", &Cpu::OpSTA, &Cpu::AddrABS, 3, 4 };
-    instructionLookupTable[0x9D] = { "STA", &Cpu::OpSTA, &Cpu::AddrABX, 3, 5 };
-    instructionLookupTable[0x99] = { "STA", &Cpu::OpSTA, &Cpu::AddrABY, 3, 5 };
-    instructionLookupTable[0x81] = { "STA", &Cpu::OpSTA, &Cpu::AddrIZX, 2, 6 };
-    instructionLookupTable[0x91] = { "STA", &Cpu::OpSTA, &Cpu::AddrIZY, 2, 6 };
-    instructionLookupTable[0x86] = { "STX", &Cpu::OpSTX, &Cpu::AddrZP0, 2, 3 };
-    instructionLookupTable[0x96] = { "STX", &Cpu::OpSTX, &Cpu::AddrZPY, 2, 4 };
-    instructionLookupTable[0x8E] = { "STX", &Cpu::OpSTX, &Cpu::AddrABS, 3, 4 };
-    instructionLookupTable[0x84] = { "STY", &Cpu::OpSTY, &Cpu::AddrZP0, 2, 3 };
-    instructionLookupTable[0x94] = { "STY", &Cpu::OpSTY, &Cpu::AddrZPX, 2, 4 };
-    instructionLookupTable[0x8C] = { "STY", &Cpu::OpSTY, &Cpu::AddrABS, 3, 4 };
-    instructionLookupTable[0x10] = { "BPL", &Cpu::OpBPL, &Cpu::AddrREL, 2, 2 };
-    instructionLookupTable[0x30] = { "BMI", &Cpu::OpBMI, &Cpu::AddrREL, 2, 2 };
-    instructionLookupTable[0x50] = { "BVC", &Cpu::OpBVC, &Cpu::AddrREL, 2, 2 };
-    instructionLookupTable[0x70] = { "BVS", &Cpu::OpBVS, &Cpu::AddrREL, 2, 2 };
-    instructionLookupTable[0x90] = { "BCC", &Cpu::OpBCC, &Cpu::AddrREL, 2, 2 };
-    instructionLookupTable[0xB0] = { "BCS", &Cpu::OpBCS, &Cpu::AddrREL, 2, 2 };
-    instructionLookupTable[0xD0] = { "BNE", &Cpu::OpBNE, &Cpu::AddrREL, 2, 2 };
-    instructionLookupTable[0xF0] = { "BEQ", &Cpu::OpBEQ, &Cpu::AddrREL, 2, 2 };
-    instructionLookupTable[0x18] = { "CLC", &Cpu::OpCLC, &Cpu::AddrIMP, 1, 2 };
-    instructionLookupTable[0x38] = { "SEC", &Cpu::OpSEC, &Cpu::AddrIMP, 1, 2 };
-    instructionLookupTable[0x58] = { "CLI", &Cpu::OpCLI, &Cpu::AddrIMP, 1, 2 };
-    instructionLookupTable[0x78] = { "SEI", &Cpu::OpSEI, &Cpu::AddrIMP, 1, 2 };
-    instructionLookupTable[0xB8] = { "CLV", &Cpu::OpCLV, &Cpu::AddrIMP, 1, 2 };
-    instructionLookupTable[0xD8] = { "CLD", &Cpu::OpCLD, &Cpu::AddrIMP, 1, 2 };
-    instructionLookupTable[0xF8] = { "SED", &Cpu::OpSED, &Cpu::AddrIMP, 1, 2 };
-    instructionLookupTable[0xAA] = { "TAX", &Cpu::OpTAX, &Cpu::AddrIMP, 1, 2 };
-    instructionLookupTable[0x8A] = { "TXA", &Cpu::OpTXA, &Cpu::AddrIMP, 1, 2 };
-    instructionLookupTable[0xCA] = { "DEX", &Cpu::OpDEX, &Cpu::AddrIMP, 1, 2 };
-    instructionLookupTable[0xE8] = { "INX", &Cpu::OpINX, &Cpu::AddrIMP, 1, 2 };
-    instructionLookupTable[0xA8] = { "TAY", &Cpu::OpTAY, &Cpu::AddrIMP, 1, 2 };
-    instructionLookupTable[0x98] = { "TYA", &Cpu::OpTYA, &Cpu::AddrIMP, 1, 2 };
-    instructionLookupTable[0x88] = { "DEY", &Cpu::OpDEY, &Cpu::AddrIMP, 1, 2 };
-    instructionLookupTable[0xC8] = { "INY", &Cpu::OpINY, &Cpu::AddrIMP, 1, 2 };
-    instructionLookupTable[0x9A] = { "TXS", &Cpu::OpTXS, &Cpu::AddrIMP, 1, 2 };
-    instructionLookupTable[0xBA] = { "TSX", &Cpu::OpTSX, &Cpu::AddrIMP, 1, 2 };
-    instructionLookupTable[0x48] = { "PHA", &Cpu::OpPHA, &Cpu::AddrIMP, 1, 3 };
-    instructionLookupTable[0x68] = { "PLA", &Cpu::OpPLA, &Cpu::AddrIMP, 1, 4 };
-    instructionLookupTable[0x08] = { "PHP", &Cpu::OpPHP, &Cpu::AddrIMP, 1, 3 };
-    instructionLookupTable[0x28] = { "PLP", &Cpu::OpPLP, &Cpu::AddrIMP, 1, 4 };
+    "???",
+};
 
-    
-    //illegal opcodes
-    // instructionLookupTable[0x4B] = { "ALR", &Cpu::OpALR, &Cpu::AddrIMM, 2, 2 };
-    // instructionLookupTable[0x0B] = { "ANC", &Cpu::OpANC, &Cpu::AddrIMM, 2, 2 };
-    // instructionLookupTable[0x2B] = { "ANC", &Cpu::OpANC, &Cpu::AddrIMM, 2, 2 };
-    // instructionLookupTable[0x8B] = { "ANE", &Cpu::OpANE, &Cpu::AddrIMM, 2, 2 };
-    // instructionLookupTable[0x6B] = { "ARR", &Cpu::OpARR, &Cpu::AddrIMM, 2, 2 };
-    instructionLookupTable[0xC7] = { "DCP", &Cpu::OpDCP, &Cpu::AddrZP0, 2, 5 };
-    instructionLookupTable[0xD7] = { "DCP", &Cpu::OpDCP, &Cpu::AddrZPX, 2, 6 };
-    instructionLookupTable[0xCF] = { "DCP", &Cpu::OpDCP, &Cpu::AddrABS, 3, 6 };
-    instructionLookupTable[0xDF] = { "DCP", &Cpu::OpDCP, &Cpu::AddrABX, 3, 7 };
-    instructionLookupTable[0xDB] = { "DCP", &Cpu::OpDCP, &Cpu::AddrABY, 3, 7 };
-    instructionLookupTable[0xC3] = { "DCP", &Cpu::OpDCP, &Cpu::AddrIZX, 2, 8 };
-    instructionLookupTable[0xD3] = { "DCP", &Cpu::OpDCP, &Cpu::AddrIZY, 2, 8 };
-    instructionLookupTable[0xE7] = { "ISB", &Cpu::OpISB, &Cpu::AddrZP0, 2, 5 };
-    instructionLookupTable[0xF7] = { "ISB", &Cpu::OpISB, &Cpu::AddrZPX, 2, 6 };
-    instructionLookupTable[0xEF] = { "ISB", &Cpu::OpISB, &Cpu::AddrABS, 3, 6 };
-    instructionLookupTable[0xFF] = { "ISB", &Cpu::OpISB, &Cpu::AddrABX, 3, 7 };
-    instructionLookupTable[0xFB] = { "ISB", &Cpu::OpISB, &Cpu::AddrABY, 3, 7 };
-    instructionLookupTable[0xE3] = { "ISB", &Cpu::OpISB, &Cpu::AddrIZX, 2, 8 };
-    instructionLookupTable[0xF3] = { "ISB", &Cpu::OpISB, &Cpu::AddrIZY, 2, 8 };
-    // instructionLookupTable[0xBB] = { "LAS", &Cpu::OpLAS, &Cpu::AddrABY, 3, 4 };
-    instructionLookupTable[0xA7] = { "LAX", &Cpu::OpLAX, &Cpu::AddrZP0, 2, 3 };
-    instructionLookupTable[0xB7] = { "LAX", &Cpu::OpLAX, &Cpu::AddrZPY, 2, 4 };
-    instructionLookupTable[0xAF] = { "LAX", &Cpu::OpLAX, &Cpu::AddrABS, 3, 4 };
-    instructionLookupTable[0xBF] = { "LAX", &Cpu::OpLAX, &Cpu::AddrABY, 3, 4 };
-    instructionLookupTable[0xA3] = { "LAX", &Cpu::OpLAX, &Cpu::AddrIZX, 2, 6 };
-    instructionLookupTable[0xB3] = { "LAX", &Cpu::OpLAX, &Cpu::AddrIZY, 2, 5 };
-    // instructionLookupTable[0xAB] = { "LXA", &Cpu::OpLXA, &Cpu::AddrIMM, 2, 2 };
-    instructionLookupTable[0x27] = { "RLA", &Cpu::OpRLA, &Cpu::AddrZP0, 2, 5 };
-    instructionLookupTable[0x37] = { "RLA", &Cpu::OpRLA, &Cpu::AddrZPX, 2, 6 };
-    instructionLookupTable[0x2F] = { "RLA", &Cpu::OpRLA, &Cpu::AddrABS, 3, 6 };
-    instructionLookupTable[0x3F] = { "RLA", &Cpu::OpRLA, &Cpu::AddrABX, 3, 7 };
-    instructionLookupTable[0x3B] = { "RLA", &Cpu::OpRLA, &Cpu::AddrABY, 3, 7 };
-    instructionLookupTable[0x23] = { "RLA", &Cpu::OpRLA, &Cpu::AddrIZX, 2, 8 };
-    instructionLookupTable[0x33] = { "RLA", &Cpu::OpRLA, &Cpu::AddrIZY, 2, 8 };
-    instructionLookupTable[0x67] = { "RRA", &Cpu::OpRRA, &Cpu::AddrZP0, 2, 5 };
-    instructionLookupTable[0x77] = { "RRA", &Cpu::OpRRA, &Cpu::AddrZPX, 2, 6 };
-    instructionLookupTable[0x6F] = { "RRA", &Cpu::OpRRA, &Cpu::AddrABS, 3, 6 };
-    instructionLookupTable[0x7F] = { "RRA", &Cpu::OpRRA, &Cpu::AddrABX, 3, 7 };
-    instructionLookupTable[0x7B] = { "RRA", &Cpu::OpRRA, &Cpu::AddrABY, 3, 7 };
-    instructionLookupTable[0x63] = { "RRA", &Cpu::OpRRA, &Cpu::AddrIZX, 2, 8 };
-    instructionLookupTable[0x73] = { "RRA", &Cpu::OpRRA, &Cpu::AddrIZY, 2, 8 };
-    instructionLookupTable[0x87] = { "SAX", &Cpu::OpSAX, &Cpu::AddrZP0, 2, 3 };
-    instructionLookupTable[0x97] = { "SAX", &Cpu::OpSAX, &Cpu::AddrZPY, 2, 4 };
-    instructionLookupTable[0x8F] = { "SAX", &Cpu::OpSAX, &Cpu::AddrABS, 3, 4 };
-    instructionLookupTable[0x83] = { "SAX", &Cpu::OpSAX, &Cpu::AddrIZX, 2, 6 };
-    // instructionLookupTable[0xCB] = { "SBX", &Cpu::OpSBX, &Cpu::AddrIMM, 2, 2 };
-    // instructionLookupTable[0x9F] = { "SHA", &Cpu::OpSHA, &Cpu::AddrABY, 3, 5 };
-    // instructionLookupTable[0x93] = { "SHA", &Cpu::OpSHA, &Cpu::AddrIZY, 2, 6 };
-    // instructionLookupTable[0x9E] = { "SHX", &Cpu::OpSHX, &Cpu::AddrABY, 3, 5 };
-    // instructionLookupTable[0x9C] = { "SHY", &Cpu::OpSHY, &Cpu::AddrABX, 3, 5 };
-    instructionLookupTable[0x07] = { "SLO", &Cpu::OpSLO, &Cpu::AddrZP0, 2, 5 };
-    instructionLookupTable[0x17] = { "SLO", &Cpu::OpSLO, &Cpu::AddrZPX, 2, 6 };
-    instructionLookupTable[0x0F] = { "SLO", &Cpu::OpSLO, &Cpu::AddrABS, 3, 6 };
-    instructionLookupTable[0x1F] = { "SLO", &Cpu::OpSLO, &Cpu::AddrABX, 3, 7 };
-    instructionLookupTable[0x1B] = { "SLO", &Cpu::OpSLO, &Cpu::AddrABY, 3, 7 };
-    instructionLookupTable[0x03] = { "SLO", &Cpu::OpSLO, &Cpu::AddrIZX, 2, 8 };
-    instructionLookupTable[0x13] = { "SLO", &Cpu::OpSLO, &Cpu::AddrIZY, 2, 8 };
-    instructionLookupTable[0x47] = { "SRE", &Cpu::OpSRE, &Cpu::AddrZP0, 2, 5 };
-    instructionLookupTable[0x57] = { "SRE", &Cpu::OpSRE, &Cpu::AddrZPX, 2, 6 };
-    instructionLookupTable[0x4F] = { "SRE", &Cpu::OpSRE, &Cpu::AddrABS, 3, 6 };
-    instructionLookupTable[0x5F] = { "SRE", &Cpu::OpSRE, &Cpu::AddrABX, 3, 7 };
-    instructionLookupTable[0x5B] = { "SRE", &Cpu::OpSRE, &Cpu::AddrABY, 3, 7 };
-    instructionLookupTable[0x43] = { "SRE", &Cpu::OpSRE, &Cpu::AddrIZX, 2, 8 };
-    instructionLookupTable[0x53] = { "SRE", &Cpu::OpSRE, &Cpu::AddrIZY, 2, 8 };
-    // instructionLookupTable[0x9B] = { "TAS", &Cpu::OpTAS, &Cpu::AddrABY, 3, 5 };
-    instructionLookupTable[0x6A] = { "ROR", &Cpu::OpROR, &Cpu::AddrACC, 1, 2 };
-    instructionLookupTable[0x66] = { "ROR", &Cpu::OpROR, &Cpu::AddrZP0, 2, 5 };
-    instructionLookupTable[0x76] = { "ROR", &Cpu::OpROR, &Cpu::AddrZPX, 2, 6 };
-    instructionLookupTable[0x6E] = { "ROR", &Cpu::OpROR, &Cpu::AddrABS, 3, 6 };
-    instructionLookupTable[0x7E] = { "ROR", &Cpu::OpROR, &Cpu::AddrABX, 3, 7 };
-    // instructionLookupTable[0x80] = { "BRA", &Cpu::OpBRA, &Cpu::AddrREL, 2, 3 };
-    instructionLookupTable[0xFA] = { "PLA", &Cpu::OpPLA, &Cpu::AddrIMP, 1, 4 };
-    instructionLookupTable[0x7A] = { "PLA", &Cpu::OpPLA, &Cpu::AddrIMP, 1, 4 };
-    // instructionLookupTable[0xDB] = { "STP", &Cpu::OpSTP, &Cpu::AddrIMP, 1, 3 };
-    // instructionLookupTable[0x64] = { "STZ", &Cpu::OpSTZ, &Cpu::AddrZP0, 2, 3 };
-    // instructionLookupTable[0x74] = { "STZ", &Cpu::OpSTZ, &Cpu::AddrZPX, 2, 4 };
-    // instructionLookupTable[0x9C] = { "STZ", &Cpu::OpSTZ, &Cpu::AddrABS, 3, 4 };
-    // instructionLookupTable[0x9E] = { "STZ", &Cpu::OpSTZ, &Cpu::AddrABX, 3, 4 };
-    // instructionLookupTable[0x1C] = { "TRB", &Cpu::OpTRB, &Cpu::AddrABS, 3, 6 };
-    // instructionLookupTable[0x14] = { "TRB", &Cpu::OpTRB, &Cpu::AddrZP0, 2, 5 };
-    // instructionLookupTable[0x0C] = { "TRB", &Cpu::OpTRB, &Cpu::AddrABS, 3, 6 };
-    // instructionLookupTable[0x04] = { "TRB", &Cpu::OpTRB, &Cpu::AddrZP0, 2, 5 };
-    // instructionLookupTable[0xCB] = { "WAI", &Cpu::OpWAI, &Cpu::AddrIMP, 1, 3 };
+static_assert(std::size(OPERATION_NAMES) == (std::size_t)Operation::N_OPERATIONS);
 
 
-    //nops
-    instructionLookupTable[0x04] = { "NOP", &Cpu::OpNOP, &Cpu::AddrZP0, 2, 3 };
-    instructionLookupTable[0x0C] = { "NOP", &Cpu::OpNOP, &Cpu::AddrABS, 3, 4 };
-    instructionLookupTable[0x14] = { "NOP", &Cpu::OpNOP, &Cpu::AddrZPX, 2, 4 };
-    instructionLookupTable[0x1A] = { "NOP", &Cpu::OpNOP, &Cpu::AddrIMP, 1, 2 };
-    instructionLookupTable[0x1C] = { "NOP", &Cpu::OpNOP, &Cpu::AddrABX, 3, 4 };
-    instructionLookupTable[0x34] = { "NOP", &Cpu::OpNOP, &Cpu::AddrZPX, 3, 4 };
-    instructionLookupTable[0x3A] = { "NOP", &Cpu::OpNOP, &Cpu::AddrIMP, 1, 2 };
-    instructionLookupTable[0x3C] = { "NOP", &Cpu::OpNOP, &Cpu::AddrABX, 3, 4 };
-    instructionLookupTable[0x44] = { "NOP", &Cpu::OpNOP, &Cpu::AddrZP0, 2, 3 };
-    instructionLookupTable[0x54] = { "NOP", &Cpu::OpNOP, &Cpu::AddrZPX, 3, 4 };
-    instructionLookupTable[0x5A] = { "NOP", &Cpu::OpNOP, &Cpu::AddrIMP, 1, 2 };
-    instructionLookupTable[0x5C] = { "NOP", &Cpu::OpNOP, &Cpu::AddrABX, 3, 4 };
-    instructionLookupTable[0x64] = { "NOP", &Cpu::OpNOP, &Cpu::AddrZP0, 2, 3 };
-    instructionLookupTable[0x74] = { "NOP", &Cpu::OpNOP, &Cpu::AddrZPX, 3, 4 };
-    instructionLookupTable[0x7A] = { "NOP", &Cpu::OpNOP, &Cpu::AddrIMP, 1, 2 };
-    instructionLookupTable[0x7C] = { "NOP", &Cpu::OpNOP, &Cpu::AddrABX, 3, 4 };
-    instructionLookupTable[0x80] = { "NOP", &Cpu::OpNOP, &Cpu::AddrIMM, 1, 2 };
-    instructionLookupTable[0x82] = { "NOP", &Cpu::OpNOP, &Cpu::AddrIMM, 1, 2 };
-    instructionLookupTable[0x89] = { "NOP", &Cpu::OpNOP, &Cpu::AddrIMM, 1, 2 };
-    instructionLookupTable[0xC2] = { "NOP", &Cpu::OpNOP, &Cpu::AddrIMM, 1, 2 };
-    instructionLookupTable[0xD4] = { "NOP", &Cpu::OpNOP, &Cpu::AddrZPX, 3, 4 };
-    instructionLookupTable[0xDA] = { "NOP", &Cpu::OpNOP, &Cpu::AddrIMP, 1, 2 };
-    instructionLookupTable[0xDC] = { "NOP", &Cpu::OpNOP, &Cpu::AddrABX, 3, 4 };
-    instructionLookupTable[0xE2] = { "NOP", &Cpu::OpNOP, &Cpu::AddrIMM, 1, 2 };
-    instructionLookupTable[0xF4] = { "NOP", &Cpu::OpNOP, &Cpu::AddrZPX, 3, 4 };
-    instructionLookupTable[0xFA] = { "NOP", &Cpu::OpNOP, &Cpu::AddrIMP, 1, 2 };
-    instructionLookupTable[0xFC] = { "NOP", &Cpu::OpNOP, &Cpu::AddrABX, 3, 4 };
+const char* operationName(Operation operation)
+{
+    return OPERATION_NAMES[(int)operation];
 }
@@ -0,0 +1,1022 @@
+#include "jit.hpp"
+
+#include "block_cache.hpp"
+#include "bus.hpp"
+#include "cpu.hpp"
+#include "x86_emitter.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <functional>
+#include <print>
+
+#ifdef JIT_SUPPORTED
+#include <sys/mman.h>
+#endif
+
+
+bool isCompilable(const DecodedInstr& instr, Bus* bus, uint16_t pc);
+uint8_t maxExtraCycles(const DecodedInstr& instr);
+bool isPageCrossCounted(Operation operation);
+
+
+//---- block compiler ----
+// The 6502 registers live in host registers for the whole block, and are
+// only stored back into the Cpu when leaving it or calling a thunk.
+// N and Z are lazy: the last result stays in REG_NZ and is only folded
+// into P when P is needed. Cycles and instructions are summed at compile
+// time and added to the Cpu counters on the same occasions.
+// Memory operands go straight to internal RAM, or through the page tables
+// of the bus; a page behind a handler takes a slow path calling the thunk
+// of the instruction, which runs it or bails out as usual
+
+static const X86Reg REG_CPU = RBX;
+static const X86Reg REG_A = R12;
+static const X86Reg REG_X = R13;
+static const X86Reg REG_Y = R14;
+static const X86Reg REG_P = R15;
+static const X86Reg REG_NZ = RBP;
+// caller-saved: reloaded after every call
+static const X86Reg REG_RAM = R8;
+static const X86Reg REG_READ_PAGES = R9;
+static const X86Reg REG_WRITE_PAGES = R10;
+
+static const int32_t STACK_PAGE = 0x0100;
+static const int32_t INTERNAL_RAM_MASK = 0x07FF;
+static const uint16_t INTERNAL_RAM_END = 0x2000;
+
+// the native code at some point of a block
+struct BlockState
+{
+    int32_t nCycles;    // static cycles not yet added to the Cpu counters
+    int32_t nInstr;
+    bool isNZLazy;      // N and Z are those of REG_NZ, not of REG_P
+};
+
+enum class Access { Read, Write, Modify };
+
+
+class BlockCompiler
+{
+public:
+    BlockCompiler(Bus* bus, const JitCpuLayout& layout);
+
+    void compileInstr(const DecodedInstr& instr, uint16_t pc);
+    // leaves the block at pc, or where the last thunk left the Cpu
+    std::vector<uint8_t> finish(uint16_t pc, bool isPCSet);
+
+private:
+    Bus* m_bus;
+    JitCpuLayout m_layout;
+    X86Emitter m_asm;
+
+    BlockState m_state;
+    BlockState m_before;        // before the instruction being compiled
+    X86Label m_instrEnd;
+    X86Label m_exit;            // stores the registers, then leaves
+    X86Label m_leave;           // the registers already stored
+    std::vector<std::function<void()>> m_stubs;  // slow paths and side exits, emitted after the block
+
+    X86Mem cpuField(int32_t offset) { return { REG_CPU, offset }; }
+
+    bool compileNative(const DecodedInstr& instr, uint16_t pc);
+    void compileBranch(const DecodedInstr& instr, uint16_t pc);
+    void compileShift(const DecodedInstr& instr, AddrMode addrMode, uint16_t pc);
+    void compilePush(const DecodedInstr& instr, uint16_t pc, std::initializer_list<X86Reg> values);
+    void compilePull(const DecodedInstr& instr, uint16_t pc, X86Reg dst);
+
+    void readOperand(const DecodedInstr& instr, AddrMode addrMode, uint16_t pc);
+    X86Mem operand(const DecodedInstr& instr, AddrMode addrMode, uint16_t pc, Access access);
+    X86Mem pageOperand(Access access, X86Mem readEntry, X86Mem writeEntry, X86Label slow);
+    X86Label slowPath(const DecodedInstr& instr, uint16_t pc);
+
+    void callThunk(const DecodedInstr& instr, uint16_t pc, const BlockState& before, const BlockState& after);
+    void exitTo(uint16_t pc, const BlockState& state);
+    void addCounters(int32_t nCycles, int32_t nInstr);
+    void foldNZ(const BlockState& state);
+    void unfoldNZ();
+    void setNZ(X86Reg result) { m_asm.mov(REG_NZ, result); }
+    void setCarry(X86Cond carry);
+    void loadRegisters();
+    void storeRegisters();
+};
+
+
+Jit::Jit(Bus* bus)
+{
+    m_bus = bus;
+    m_layout = bus->cpu()->jitLayout();
+    m_codeBuffer = nullptr;
+    m_codeSize = 0;
+
+#ifdef JIT_SUPPORTED
+    // mapped read-write while emitting, read-exec while running
+    void* buffer = mmap(nullptr, CODE_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer != MAP_FAILED)
+        m_codeBuffer = (uint8_t*)buffer;
+#endif
+
+    m_blockStarts.resize(END_ADDR - START_ADDR);
+    m_hotness.resize(END_ADDR - START_ADDR);
+    invalidate();
+
+    m_nCompiledInstr = 0;
+    m_nRuns = 0;
+    m_nBailouts = 0;
+    m_nFallbacks = 0;
+}
+
+Jit::~Jit()
+{
+#ifdef JIT_SUPPORTED
+    if (m_codeBuffer != nullptr)
+        munmap(m_codeBuffer, CODE_BUFFER_SIZE);
+#endif
+}
+
+bool Jit::isSupported()
+{
+#ifdef JIT_SUPPORTED
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Dropped blocks are only unlinked, their code staying in the buffer
+// until it fills up
+void Jit::invalidate(CodeWindows windows)
+{
+    if (windows == ALL_CODE_WINDOWS || m_blocks.size() >= MAX_BLOCKS)
+    {
+        m_blocks.clear();
+        std::fill(m_blockStarts.begin(), m_blockStarts.end(), NO_BLOCK);
+        std::fill(m_hotness.begin(), m_hotness.end(), 0);
+        for (auto& blocks: m_windowBlocks)
+            blocks.clear();
+        m_codeSize = 0;
+        return;
+    }
+
+    for (int i=0; i < N_CODE_WINDOWS; i++)
+    {
+        if (!(windows & (1 << i)))
+            continue;
+
+        for (uint16_t startPC: m_windowBlocks[i])
+            m_blockStarts[startPC - START_ADDR] = NO_BLOCK;
+        m_windowBlocks[i].clear();
+    }
+}
+
+// blocks not compilable included, the new bank may be
+void Jit::addToWindows(uint16_t startPC, CodeWindows windows)
+{
+    for (int i=0; i < N_CODE_WINDOWS; i++)
+    {
+        if (windows & (1 << i))
+            m_windowBlocks[i].push_back(startPC);
+    }
+}
+
+void Jit::printStats()
+{
+    std::println("jit: {} blocks, {} instructions compiled into {} bytes; {} block runs, {} bailouts, {} fallbacks near frame events",
+        m_blocks.size(), m_nCompiledInstr, m_codeSize, m_nRuns, m_nBailouts, m_nFallbacks);
+}
+
+
+// slow path of lookup()
+const JitBlock* Jit::compileIfHot(uint16_t pc)
+{
+    if (m_codeBuffer == nullptr)
+        return nullptr;
+
+    uint16_t offset = pc - START_ADDR;
+    if (m_blockStarts[offset] == NOT_COMPILABLE)
+        return nullptr;
+
+    if (++m_hotness[offset] < HOT_THRESHOLD)
+        return nullptr;
+
+    int32_t iBlock = compile(pc);
+    if (iBlock < 0)
+        return nullptr;
+
+    return &m_blocks[iBlock];
+}
+
+
+int32_t Jit::compile(uint16_t startPC)
+{
+    BlockCompiler compiler(m_bus, m_layout);
+
+    uint32_t pc = startPC;
+    uint16_t nInstr = 0;
+    uint16_t maxCycles = 0;
+    CodeWindows windows = 0;
+    bool isPCSet = false;
+    std::vector<uint16_t> instrPCs;
+
+    while (nInstr < MAX_BLOCK_LEN && pc + 3 <= END_ADDR)
+    {
+        DecodedInstr instr = BlockCache::decodeInstr(m_bus, pc);
+        if (!isCompilable(instr, m_bus, pc))
+            break;
+
+        uint16_t instrMaxCycles = instr.nCycles + maxExtraCycles(instr);
+        if (maxCycles + instrMaxCycles > MAX_BLOCK_CYCLES)
+            break;
+
+        compiler.compileInstr(instr, pc);
+        instrPCs.push_back(pc);
+
+        nInstr ++;
+        maxCycles += instrMaxCycles;
+        windows |= codeWindows(pc, pc + instr.nBytes - 1);
+
+        const Instruction& info = instructionLookupTable[instr.opcode];
+        if ((instr.operation == Operation::JMP || instr.operation == Operation::JSR)
+            && info.addrMode == AddrMode::ABS)
+        {
+            // keep compiling at the jump target, unless it is in RAM or
+            // already in the block: unrolling a loop only makes the block
+            // less likely to fit before the next event
+            pc = instr.targetAddress;
+            if (pc >= START_ADDR && std::find(instrPCs.begin(), instrPCs.end(), pc) == instrPCs.end())
+                continue;
+            break;
+        }
+
+        if (info.addrMode != AddrMode::REL && endsBlock(instr.operation))
+        {
+            // RTS, RTI, JMP ($xxxx): run by their thunk
+            isPCSet = true;
+            break;
+        }
+
+        pc += instr.nBytes;
+
+        // may unmask a pending IRQ, taken before the next instruction
+        if (instr.operation == Operation::CLI || instr.operation == Operation::PLP)
+            break;
+    }
+
+    uint16_t offset = startPC - START_ADDR;
+    if (nInstr == 0)
+    {
+        m_blockStarts[offset] = NOT_COMPILABLE;
+        addToWindows(startPC, codeWindows(startPC, startPC));
+        return NOT_COMPILABLE;
+    }
+
+    std::vector<uint8_t> code = compiler.finish(pc, isPCSet);
+
+    JitCode nativeCode = emit(code);
+    if (nativeCode == nullptr)
+    {
+        // code buffer full: start over
+        invalidate();
+        nativeCode = emit(code);
+    }
+
+    m_blocks.push_back({ nativeCode, nInstr, maxCycles });
+    m_nCompiledInstr += nInstr;
+
+    int32_t iBlock = m_blocks.size() - 1;
+    m_blockStarts[offset] = iBlock;
+    addToWindows(startPC, windows);
+    return iBlock;
+}
+
+
+JitCode Jit::emit(const std::vector<uint8_t>& code)
+{
+    if (m_codeSize + code.size() > CODE_BUFFER_SIZE)
+        return nullptr;
+
+    uint8_t* dest = m_codeBuffer + m_codeSize;
+
+#ifdef JIT_SUPPORTED
+    // only the pages being written change protection
+    uint8_t* pageStart = m_codeBuffer + (m_codeSize & ~(size_t)(PAGE_SIZE - 1));
+    size_t protectSize = dest + code.size() - pageStart;
+
+    mprotect(pageStart, protectSize, PROT_READ | PROT_WRITE);
+    memcpy(dest, code.data(), code.size());
+    mprotect(pageStart, protectSize, PROT_READ | PROT_EXEC);
+#endif
+
+    m_codeSize += code.size();
+    return (JitCode)dest;
+}
+
+
+bool isJitSafeAccess(Operation operation, uint16_t addr)
+{
+    // internal RAM, PRG RAM
+    if (addr < 0x2000 || (addr >= 0x6000 && addr < 0x8000))
+        return true;
+
+    if (addr < 0x8000)
+        return false;
+
+    switch (operation)
+    {
+        case Operation::LDA: case Operation::LDX: case Operation::LDY: case Operation::LAX:
+        case Operation::AND: case Operation::ORA: case Operation::EOR: case Operation::BIT:
+        case Operation::ADC: case Operation::SBC:
+        case Operation::CMP: case Operation::CPX: case Operation::CPY:
+        case Operation::NOP:
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+bool isCompilable(const DecodedInstr& instr, Bus* bus, uint16_t pc)
+{
+    if (instr.operation == Operation::BRK || instr.operation == Operation::Unknown)
+        return false;
+
+    const Instruction& info = instructionLookupTable[instr.opcode];
+    if (info.addrMode == AddrMode::ABS && instr.operation != Operation::JMP && instr.operation != Operation::JSR)
+        return isJitSafeAccess(instr.operation, instr.targetAddress);
+
+    if (info.addrMode == AddrMode::IND)
+    {
+        // JMP ($xxxx) reads its target from memory
+        uint16_t pointer = (bus->read(pc + 2) << 8) | bus->read(pc + 1);
+        return isJitSafeAccess(Operation::LDA, pointer) && isJitSafeAccess(Operation::LDA, pointer + 1);
+    }
+
+    return true;
+}
+
+// the operations taking one more cycle when indexing crosses a page
+bool isPageCrossCounted(Operation operation)
+{
+    switch (operation)
+    {
+        case Operation::LDA: case Operation::LDX: case Operation::LDY:
+        case Operation::AND: case Operation::ORA: case Operation::EOR:
+        case Operation::ADC: case Operation::SBC: case Operation::CMP:
+            return true;
+        default:
+            return false;
+    }
+}
+
+uint8_t maxExtraCycles(const DecodedInstr& instr)
+{
+    const Instruction& info = instructionLookupTable[instr.opcode];
+    switch (info.addrMode)
+    {
+        case AddrMode::REL:
+            return 2;  // branch taken to another page
+        case AddrMode::ABX:
+        case AddrMode::ABY:
+        case AddrMode::IZY:
+            return 1;  // page crossing
+        default:
+            return 0;
+    }
+}
+
+
+BlockCompiler::BlockCompiler(Bus* bus, const JitCpuLayout& layout)
+{
+    m_bus = bus;
+    m_layout = layout;
+    m_state = { 0, 0, false };
+    m_before = m_state;
+    m_exit = m_asm.newLabel();
+    m_leave = m_asm.newLabel();
+    m_instrEnd = m_asm.newLabel();
+
+    for (X86Reg reg: { RBX, RBP, R12, R13, R14, R15 })
+        m_asm.push(reg);
+    m_asm.aluImm64(X86Alu::Sub, RSP, 8);     // for 16-byte aligned calls
+    m_asm.mov64(REG_CPU, RDI);
+    loadRegisters();
+}
+
+void BlockCompiler::compileInstr(const DecodedInstr& instr, uint16_t pc)
+{
+    m_before = m_state;
+    m_state.nCycles += instr.nCycles;
+    m_state.nInstr ++;
+    m_instrEnd = m_asm.newLabel();
+
+    if (!compileNative(instr, pc))
+    {
+        callThunk(instr, pc, m_before, { 0, 0, false });
+        m_state = { 0, 0, false };
+    }
+
+    m_asm.bind(m_instrEnd);
+}
+
+std::vector<uint8_t> BlockCompiler::finish(uint16_t pc, bool isPCSet)
+{
+    if (isPCSet)
+        m_asm.jmp(m_exit);
+    else
+        exitTo(pc, m_state);
+
+    m_asm.bind(m_exit);
+    storeRegisters();
+    m_asm.bind(m_leave);
+    m_asm.aluImm64(X86Alu::Add, RSP, 8);
+    for (X86Reg reg: { R15, R14, R13, R12, RBP, RBX })
+        m_asm.pop(reg);
+    m_asm.ret();
+
+    // stubs may add stubs
+    for (size_t i=0; i < m_stubs.size(); i++)
+        m_stubs[i]();
+
+    m_asm.finish();
+    return m_asm.code();
+}
+
+
+// false when left to the thunk
+bool BlockCompiler::compileNative(const DecodedInstr& instr, uint16_t pc)
+{
+    AddrMode addrMode = instructionLookupTable[instr.opcode].addrMode;
+    switch (instr.operation)
+    {
+        case Operation::LDA: case Operation::LDX: case Operation::LDY:
+        {
+            X86Reg dst = (instr.operation == Operation::LDA ? REG_A : instr.operation == Operation::LDX ? REG_X : REG_Y);
+            m_state.isNZLazy = true;
+            readOperand(instr, addrMode, pc);
+            m_asm.mov(dst, RAX);
+            setNZ(dst);
+            return true;
+        }
+
+        case Operation::STA: case Operation::STX: case Operation::STY:
+        {
+            X86Reg src = (instr.operation == Operation::STA ? REG_A : instr.operation == Operation::STX ? REG_X : REG_Y);
+            m_asm.store8(operand(instr, addrMode, pc, Access::Write), src);
+            return true;
+        }
+
+        case Operation::AND: case Operation::ORA: case Operation::EOR:
+        {
+            X86Alu op = (instr.operation == Operation::AND ? X86Alu::And : instr.operation == Operation::ORA ? X86Alu::Or : X86Alu::Xor);
+            m_state.isNZLazy = true;
+            readOperand(instr, addrMode, pc);
+            m_asm.alu8(op, REG_A, RAX);
+            setNZ(REG_A);
+            return true;
+        }
+
+        case Operation::ADC: case Operation::SBC:
+        {
+            m_state.isNZLazy = true;
+            readOperand(instr, addrMode, pc);
+            m_asm.btImm(REG_P, FlagIndex::Carry);
+            if (instr.operation == Operation::ADC)
+                m_asm.alu8(X86Alu::Adc, REG_A, RAX);
+            else
+            {
+                // the 6502 carry is the complement of the x86 borrow
+                m_asm.cmc();
+                m_asm.alu8(X86Alu::Sbb, REG_A, RAX);
+                m_asm.cmc();
+            }
+            m_asm.setcc(X86Cond::B, RCX);
+            m_asm.setcc(X86Cond::O, RDX);
+            m_asm.movzx8(RCX, RCX);
+            m_asm.movzx8(RDX, RDX);
+            m_asm.shiftImm(X86Shift::Shl, RDX, FlagIndex::Overflow);
+            m_asm.alu(X86Alu::Or, RCX, RDX);
+            m_asm.aluImm(X86Alu::And, REG_P, ~((1 << FlagIndex::Carry) | (1 << FlagIndex::Overflow)));
+            m_asm.alu(X86Alu::Or, REG_P, RCX);
+            setNZ(REG_A);
+            return true;
+        }
+
+        case Operation::CMP: case Operation::CPX: case Operation::CPY:
+        {
+            X86Reg reg = (instr.operation == Operation::CMP ? REG_A : instr.operation == Operation::CPX ? REG_X : REG_Y);
+            m_state.isNZLazy = true;
+            readOperand(instr, addrMode, pc);
+            setNZ(reg);
+            m_asm.alu8(X86Alu::Sub, REG_NZ, RAX);
+            setCarry(X86Cond::AE);
+            return true;
+        }
+
+        case Operation::BIT:
+        {
+            // N and V from the operand, Z from A & operand: nothing lazy left
+            m_state.isNZLazy = false;
+            readOperand(instr, addrMode, pc);
+            m_asm.aluImm(X86Alu::And, REG_P, ~((1 << FlagIndex::Negative) | (1 << FlagIndex::Overflow) | (1 << FlagIndex::Zero)));
+            m_asm.mov(RCX, RAX);
+            m_asm.aluImm(X86Alu::And, RCX, (1 << FlagIndex::Negative) | (1 << FlagIndex::Overflow));
+            m_asm.alu(X86Alu::Or, REG_P, RCX);
+            m_asm.test(RAX, REG_A);
+            m_asm.setcc(X86Cond::E, RCX);
+            m_asm.movzx8(RCX, RCX);
+            m_asm.shiftImm(X86Shift::Shl, RCX, FlagIndex::Zero);
+            m_asm.alu(X86Alu::Or, REG_P, RCX);
+            return true;
+        }
+
+        case Operation::INC: case Operation::DEC:
+        {
+            m_state.isNZLazy = true;
+            X86Mem mem = operand(instr, addrMode, pc, Access::Modify);
+            m_asm.movzx8(RAX, mem);
+            m_asm.aluImm(instr.operation == Operation::INC ? X86Alu::Add : X86Alu::Sub, RAX, 1);
+            m_asm.store8(mem, RAX);
+            m_asm.movzx8(REG_NZ, RAX);
+            return true;
+        }
+
+        case Operation::INX: case Operation::INY: case Operation::DEX: case Operation::DEY:
+        {
+            X86Reg reg = (instr.operation == Operation::INX || instr.operation == Operation::DEX ? REG_X : REG_Y);
+            bool isIncrement = (instr.operation == Operation::INX || instr.operation == Operation::INY);
+            m_state.isNZLazy = true;
+            m_asm.alu8Imm(isIncrement ? X86Alu::Add : X86Alu::Sub, reg, 1);
+            setNZ(reg);
+            return true;
+        }
+
+        case Operation::ASL: case Operation::LSR: case Operation::ROL: case Operation::ROR:
+            m_state.isNZLazy = true;
+            compileShift(instr, addrMode, pc);
+            return true;
+
+        case Operation::TAX: case Operation::TAY: case Operation::TXA: case Operation::TYA:
+        {
+            X86Reg src = (instr.operation == Operation::TXA ? REG_X : instr.operation == Operation::TYA ? REG_Y : REG_A);
+            X86Reg dst = (instr.operation == Operation::TAX ? REG_X : instr.operation == Operation::TAY ? REG_Y : REG_A);
+            m_state.isNZLazy = true;
+            m_asm.mov(dst, src);
+            setNZ(dst);
+            return true;
+        }
+
+        case Operation::TSX:
+            m_state.isNZLazy = true;
+            m_asm.movzx8(REG_X, cpuField(m_layout.SP));
+            setNZ(REG_X);
+            return true;
+
+        case Operation::TXS:
+            m_asm.store8(cpuField(m_layout.SP), REG_X);
+            return true;
+
+        case Operation::CLC: case Operation::CLD: case Operation::CLI: case Operation::CLV:
+        case Operation::SEC: case Operation::SED: case Operation::SEI:
+        {
+            FlagIndex flag;
+            switch (instr.operation)
+            {
+                case Operation::CLC: case Operation::SEC: flag = FlagIndex::Carry; break;
+                case Operation::CLD: case Operation::SED: flag = FlagIndex::Decimal; break;
+                case Operation::CLI: case Operation::SEI: flag = FlagIndex::InterruptDisable; break;
+                default:                                  flag = FlagIndex::Overflow; break;
+            }
+
+            bool isSet = (instr.operation == Operation::SEC || instr.operation == Operation::SED || instr.operation == Operation::SEI);
+            if (isSet)
+                m_asm.aluImm(X86Alu::Or, REG_P, 1 << flag);
+            else
+                m_asm.aluImm(X86Alu::And, REG_P, ~(1 << flag));
+            return true;
+        }
+
+        case Operation::PHA:
+            compilePush(instr, pc, { REG_A });
+            return true;
+
+        case Operation::PHP:
+            // the B flag and extra bit are pushed as 1
+            foldNZ(m_state);
+            m_asm.mov(RCX, REG_P);
+            m_asm.aluImm(X86Alu::Or, RCX, 0b00110000);
+            compilePush(instr, pc, { RCX });
+            return true;
+
+        case Operation::PLA:
+            m_state.isNZLazy = true;
+            compilePull(instr, pc, REG_A);
+            setNZ(REG_A);
+            return true;
+
+        case Operation::PLP:
+            // B cleared and extra bit set, as OpPLP()
+            m_state.isNZLazy = false;
+            compilePull(instr, pc, REG_P);
+            m_asm.aluImm(X86Alu::And, REG_P, ~0b00010000);
+            m_asm.aluImm(X86Alu::Or, REG_P, 0b00100000);
+            return true;
+
+        case Operation::JSR:
+        {
+            // the return address minus one, high byte first
+            if (addrMode != AddrMode::ABS)
+                return false;
+
+            uint16_t returnAddr = pc + 2;
+            m_asm.movImm(RCX, returnAddr >> 8);
+            m_asm.movImm(RDX, returnAddr & 0xFF);
+            compilePush(instr, pc, { RCX, RDX });
+            return true;
+        }
+
+        case Operation::JMP:
+            // followed by the compiler
+            return (addrMode == AddrMode::ABS);
+
+        case Operation::NOP:
+            // unofficial NOPs with an operand still read it
+            return (addrMode == AddrMode::IMP);
+
+        case Operation::BCC: case Operation::BCS: case Operation::BEQ: case Operation::BMI:
+        case Operation::BNE: case Operation::BPL: case Operation::BVC: case Operation::BVS:
+            compileBranch(instr, pc);
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+// A side exit when taken
+void BlockCompiler::compileBranch(const DecodedInstr& instr, uint16_t pc)
+{
+    bool isLazy = m_before.isNZLazy;
+    X86Reg reg = REG_P;
+    uint32_t mask;
+    bool isTakenIfSet;
+
+    switch (instr.operation)
+    {
+        case Operation::BCC: mask = 1 << FlagIndex::Carry;    isTakenIfSet = false; break;
+        case Operation::BCS: mask = 1 << FlagIndex::Carry;    isTakenIfSet = true;  break;
+        case Operation::BVC: mask = 1 << FlagIndex::Overflow; isTakenIfSet = false; break;
+        case Operation::BVS: mask = 1 << FlagIndex::Overflow; isTakenIfSet = true;  break;
+        case Operation::BPL: mask = 1 << FlagIndex::Negative; isTakenIfSet = false; break;
+        case Operation::BMI: mask = 1 << FlagIndex::Negative; isTakenIfSet = true;  break;
+        case Operation::BNE: mask = 1 << FlagIndex::Zero;     isTakenIfSet = false; break;
+        default:             mask = 1 << FlagIndex::Zero;     isTakenIfSet = true;  break;
+    }
+
+    X86Cond taken = (isTakenIfSet ? X86Cond::NE : X86Cond::E);
+    if (isLazy && mask == (1 << FlagIndex::Negative))
+        reg = REG_NZ;
+    else if (isLazy && mask == (1 << FlagIndex::Zero))
+    {
+        // Z set when the last result is zero
+        reg = REG_NZ;
+        mask = 0xFF;
+        taken = (isTakenIfSet ? X86Cond::E : X86Cond::NE);
+    }
+
+    m_asm.testImm(reg, mask);
+
+    X86Label sideExit = m_asm.newLabel();
+    m_asm.jcc(taken, sideExit);
+
+    BlockState exitState = m_state;
+    exitState.nCycles += (isPageBreak(pc + 2, instr.targetAddress) ? 2 : 1);
+    uint16_t target = instr.targetAddress;
+    m_stubs.push_back([this, sideExit, target, exitState]() {
+        m_asm.bind(sideExit);
+        exitTo(target, exitState);
+    });
+}
+
+void BlockCompiler::compileShift(const DecodedInstr& instr, AddrMode addrMode, uint16_t pc)
+{
+    X86Shift op;
+    switch (instr.operation)
+    {
+        case Operation::ASL: op = X86Shift::Shl; break;
+        case Operation::LSR: op = X86Shift::Shr; break;
+        case Operation::ROL: op = X86Shift::Rcl; break;
+        default:             op = X86Shift::Rcr; break;
+    }
+    bool isRotate = (op == X86Shift::Rcl || op == X86Shift::Rcr);
+
+    if (addrMode == AddrMode::ACC)
+    {
+        if (isRotate)
+            m_asm.btImm(REG_P, FlagIndex::Carry);
+        m_asm.shift8(op, REG_A);
+        setCarry(X86Cond::B);
+        setNZ(REG_A);
+        return;
+    }
+
+    X86Mem mem = operand(instr, addrMode, pc, Access::Modify);
+    m_asm.movzx8(RAX, mem);
+    if (isRotate)
+        m_asm.btImm(REG_P, FlagIndex::Carry);
+    m_asm.shift8(op, RAX);
+    // ecx may index the operand
+    m_asm.setcc(X86Cond::B, RSI);
+    m_asm.store8(mem, RAX);
+    m_asm.movzx8(REG_NZ, RAX);
+    m_asm.movzx8(RSI, RSI);
+    m_asm.aluImm(X86Alu::And, REG_P, ~(1 << FlagIndex::Carry));
+    m_asm.alu(X86Alu::Or, REG_P, RSI);
+}
+
+// values pushed in order; the thunk throws on a stack overflow, as pushStack()
+void BlockCompiler::compilePush(const DecodedInstr& instr, uint16_t pc, std::initializer_list<X86Reg> values)
+{
+    m_asm.movzx8(RAX, cpuField(m_layout.SP));
+    m_asm.aluImm(X86Alu::Cmp, RAX, values.size());
+    m_asm.jcc(X86Cond::B, slowPath(instr, pc));
+
+    int32_t offset = 0;
+    for (X86Reg value: values)
+        m_asm.store8({ REG_RAM, STACK_PAGE + offset--, RAX }, value);
+
+    m_asm.aluImm(X86Alu::Sub, RAX, values.size());
+    m_asm.store8(cpuField(m_layout.SP), RAX);
+}
+
+// the thunk throws on a stack underflow, as popStack()
+void BlockCompiler::compilePull(const DecodedInstr& instr, uint16_t pc, X86Reg dst)
+{
+    m_asm.movzx8(RAX, cpuField(m_layout.SP));
+    m_asm.aluImm(X86Alu::Cmp, RAX, 0xFF);
+    m_asm.jcc(X86Cond::E, slowPath(instr, pc));
+
+    m_asm.aluImm(X86Alu::Add, RAX, 1);
+    m_asm.store8(cpuField(m_layout.SP), RAX);
+    m_asm.movzx8(dst, { REG_RAM, STACK_PAGE, RAX });
+}
+
+
+// into eax
+void BlockCompiler::readOperand(const DecodedInstr& instr, AddrMode addrMode, uint16_t pc)
+{
+    if (addrMode == AddrMode::IMM)
+        m_asm.movImm(RAX, m_bus->read(instr.targetAddress));
+    else
+        m_asm.movzx8(RAX, operand(instr, addrMode, pc, Access::Read));
+}
+
+// The page crossing cycle of reads is counted once the access cannot
+// take the slow path any more, where the thunk counts it
+X86Mem BlockCompiler::operand(const DecodedInstr& instr, AddrMode addrMode, uint16_t pc, Access access)
+{
+    uint8_t lo = m_bus->read(pc + 1);
+    uint8_t hi = m_bus->read(pc + 2);
+    uint16_t base = (hi << 8) | lo;
+    bool isPageCrossRead = (access == Access::Read && isPageCrossCounted(instr.operation));
+    bool hasPageCross = false;  // esi is 1 when indexing crosses a page
+
+    switch (addrMode)
+    {
+        case AddrMode::ZP0:
+            return { REG_RAM, lo };
+
+        case AddrMode::ZPX: case AddrMode::ZPY:
+            m_asm.lea(RCX, { (addrMode == AddrMode::ZPX ? REG_X : REG_Y), lo });
+            m_asm.movzx8(RCX, RCX);
+            return { REG_RAM, 0, RCX };
+
+        case AddrMode::ABS:
+        {
+            if (base < INTERNAL_RAM_END)
+                return { REG_RAM, base & INTERNAL_RAM_MASK };
+
+            int32_t entry = (base >> 8) * sizeof(uint8_t*);
+            X86Mem mem = pageOperand(access, { REG_READ_PAGES, entry }, { REG_WRITE_PAGES, entry }, slowPath(instr, pc));
+            mem.disp = lo;
+            return mem;
+        }
+
+        case AddrMode::ABX: case AddrMode::ABY:
+        {
+            X86Reg index = (addrMode == AddrMode::ABX ? REG_X : REG_Y);
+            if (isPageCrossRead && lo != 0x00)
+            {
+                hasPageCross = true;
+                m_asm.lea(RSI, { index, lo });
+                m_asm.shiftImm(X86Shift::Shr, RSI, 8);
+            }
+
+            m_asm.lea(RCX, { index, base });
+            if (base + 0xFF < INTERNAL_RAM_END)
+            {
+                if (hasPageCross)
+                    m_asm.aluMem(X86Alu::Add, cpuField(m_layout.jitCycles), RSI);
+                m_asm.aluImm(X86Alu::And, RCX, INTERNAL_RAM_MASK);
+                return { REG_RAM, 0, RCX };
+            }
+
+            m_asm.movzx16(RCX, RCX);
+            break;
+        }
+
+        case AddrMode::IZX:
+            m_asm.lea(RAX, { REG_X, lo });
+            m_asm.movzx8(RCX, RAX);
+            m_asm.aluImm(X86Alu::Add, RAX, 1);
+            m_asm.movzx8(RAX, RAX);
+            m_asm.movzx8(RCX, { REG_RAM, 0, RCX });
+            m_asm.movzx8(RAX, { REG_RAM, 0, RAX });
+            m_asm.shiftImm(X86Shift::Shl, RAX, 8);
+            m_asm.alu(X86Alu::Or, RCX, RAX);
+            break;
+
+        case AddrMode::IZY:
+            m_asm.movzx8(RCX, { REG_RAM, lo });
+            m_asm.movzx8(RAX, { REG_RAM, (uint8_t)(lo + 1) });
+            if (isPageCrossRead)
+            {
+                hasPageCross = true;
+                m_asm.lea(RSI, { RCX, 0, REG_Y });
+                m_asm.shiftImm(X86Shift::Shr, RSI, 8);
+            }
+            m_asm.shiftImm(X86Shift::Shl, RAX, 8);
+            m_asm.alu(X86Alu::Or, RCX, RAX);
+            m_asm.alu(X86Alu::Add, RCX, REG_Y);
+            m_asm.movzx16(RCX, RCX);
+            break;
+
+        default:
+            assert(false);
+            return { REG_RAM, 0 };
+    }
+
+    // run-time address in ecx
+    m_asm.mov(RAX, RCX);
+    m_asm.shiftImm(X86Shift::Shr, RAX, 8);
+    X86Mem mem = pageOperand(access, { REG_READ_PAGES, 0, RAX, 8 }, { REG_WRITE_PAGES, 0, RAX, 8 }, slowPath(instr, pc));
+    m_asm.movzx8(RCX, RCX);
+    mem.index = RCX;
+
+    if (hasPageCross)
+        m_asm.aluMem(X86Alu::Add, cpuField(m_layout.jitCycles), RSI);
+
+    return mem;
+}
+
+// Host page into rdx; plain memory unless the page goes through a
+// handler, and for a read-modify-write unless it reads and writes
+// different memory
+X86Mem BlockCompiler::pageOperand(Access access, X86Mem readEntry, X86Mem writeEntry, X86Label slow)
+{
+    m_asm.load64(RDX, (access == Access::Write ? writeEntry : readEntry));
+    if (access == Access::Modify)
+    {
+        m_asm.load64(R11, writeEntry);
+        m_asm.cmp64(RDX, R11);
+        m_asm.jcc(X86Cond::NE, slow);
+    }
+    m_asm.test64(RDX, RDX);
+    m_asm.jcc(X86Cond::E, slow);
+
+    return { RDX, 0 };
+}
+
+// The thunk runs the instruction instead, then the native code goes on
+// after it; taken before the instruction has changed anything
+X86Label BlockCompiler::slowPath(const DecodedInstr& instr, uint16_t pc)
+{
+    X86Label label = m_asm.newLabel();
+    X86Label resume = m_instrEnd;
+    BlockState before = m_before;
+    BlockState after = m_state;
+
+    m_stubs.push_back([this, label, resume, instr, pc, before, after]() {
+        m_asm.bind(label);
+        callThunk(instr, pc, before, after);
+        m_asm.jmp(resume);
+    });
+
+    return label;
+}
+
+
+// Leaves the block when the thunk returns false, otherwise goes on in
+// the state after, whose counters are subtracted now for the thunk
+// counts the instruction itself
+void BlockCompiler::callThunk(const DecodedInstr& instr, uint16_t pc, const BlockState& before, const BlockState& after)
+{
+    foldNZ(before);
+    storeRegisters();
+    addCounters(before.nCycles - after.nCycles, before.nInstr - after.nInstr);
+
+    m_asm.mov64(RDI, REG_CPU);
+    m_asm.movImm(RSI, instr.targetAddress);
+    m_asm.movImm(RDX, pc);
+    m_asm.movImm64(RAX, (uint64_t)Cpu::jitThunk(instr.opcode));
+    m_asm.call(RAX);
+
+    // a bool: only al is defined
+    X86Label resume = m_asm.newLabel();
+    m_asm.movzx8(RAX, RAX);
+    m_asm.test(RAX, RAX);
+    m_asm.jcc(X86Cond::NE, resume);
+    addCounters(after.nCycles, after.nInstr);
+    m_asm.jmp(m_leave);
+
+    m_asm.bind(resume);
+    loadRegisters();
+    if (after.isNZLazy)
+        unfoldNZ();
+}
+
+void BlockCompiler::exitTo(uint16_t pc, const BlockState& state)
+{
+    foldNZ(state);
+    addCounters(state.nCycles, state.nInstr);
+    m_asm.store16Imm(cpuField(m_layout.PC), pc);
+    m_asm.jmp(m_exit);
+}
+
+void BlockCompiler::addCounters(int32_t nCycles, int32_t nInstr)
+{
+    if (nCycles != 0)
+        m_asm.aluMemImm(X86Alu::Add, cpuField(m_layout.jitCycles), nCycles);
+    if (nInstr != 0)
+        m_asm.aluMemImm(X86Alu::Add, cpuField(m_layout.nProcessedInstr), nInstr);
+}
+
+void BlockCompiler::foldNZ(const BlockState& state)
+{
+    if (!state.isNZLazy)
+        return;
+
+    m_asm.aluImm(X86Alu::And, REG_P, ~((1 << FlagIndex::Negative) | (1 << FlagIndex::Zero)));
+    m_asm.mov(RAX, REG_NZ);
+    m_asm.aluImm(X86Alu::And, RAX, 1 << FlagIndex::Negative);
+    m_asm.alu(X86Alu::Or, REG_P, RAX);
+    m_asm.test(REG_NZ, REG_NZ);
+    m_asm.setcc(X86Cond::E, RAX);
+    m_asm.movzx8(RAX, RAX);
+    m_asm.shiftImm(X86Shift::Shl, RAX, FlagIndex::Zero);
+    m_asm.alu(X86Alu::Or, REG_P, RAX);
+}
+
+// a value with the N and Z of P
+void BlockCompiler::unfoldNZ()
+{
+    m_asm.mov(REG_NZ, REG_P);
+    m_asm.aluImm(X86Alu::And, REG_NZ, 1 << FlagIndex::Negative);
+    m_asm.mov(RAX, REG_P);
+    m_asm.shiftImm(X86Shift::Shr, RAX, FlagIndex::Zero);
+    m_asm.aluImm(X86Alu::And, RAX, 1);
+    m_asm.aluImm(X86Alu::Xor, RAX, 1);
+    m_asm.alu(X86Alu::Or, REG_NZ, RAX);
+}
+
+void BlockCompiler::setCarry(X86Cond carry)
+{
+    m_asm.setcc(carry, RCX);
+    m_asm.movzx8(RCX, RCX);
+    m_asm.aluImm(X86Alu::And, REG_P, ~(1 << FlagIndex::Carry));
+    m_asm.alu(X86Alu::Or, REG_P, RCX);
+}
+
+void BlockCompiler::loadRegisters()
+{
+#ifdef LAZY_FLAGS
+    m_asm.mov64(RDI, REG_CPU);
+    m_asm.movImm64(RAX, (uint64_t)&Cpu::jitStatus);
+    m_asm.call(RAX);
+    m_asm.mov(REG_P, RAX);
+#else
+    m_asm.movzx8(REG_P, cpuField(m_layout.P));
+#endif
+    m_asm.movzx8(REG_A, cpuField(m_layout.A));
+    m_asm.movzx8(REG_X, cpuField(m_layout.X));
+    m_asm.movzx8(REG_Y, cpuField(m_layout.Y));
+
+    m_asm.movImm64(REG_RAM, (uint64_t)m_bus->writePages()[0]);
+    m_asm.movImm64(REG_READ_PAGES, (uint64_t)m_bus->readPages());
+    m_asm.movImm64(REG_WRITE_PAGES, (uint64_t)m_bus->writePages());
+}
+
+void BlockCompiler::storeRegisters()
+{
+    m_asm.store8(cpuField(m_layout.A), REG_A);
+    m_asm.store8(cpuField(m_layout.X), REG_X);
+    m_asm.store8(cpuField(m_layout.Y), REG_Y);
+#ifdef LAZY_FLAGS
+    m_asm.mov64(RDI, REG_CPU);
+    m_asm.mov(RSI, REG_P);
+    m_asm.movImm64(RAX, (uint64_t)&Cpu::jitSetStatus);
+    m_asm.call(RAX);
+#else
+    m_asm.store8(cpuField(m_layout.P), REG_P);
+#endif
+}
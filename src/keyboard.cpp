@@ -3,36 +3,54 @@
 #include <SDL.h>
 
 
+static const Button NO_BUTTON = Button::N_BUTTONS;
 
-bool Keyboard::handleEvents()
-{
-    SDL_Event e;
 
-    auto hasEvent = SDL_PollEvent(&e);
-    if (!hasEvent)
-        return true;
+Button mapKey(int keyCode)
+{
+    switch (keyCode)
+    {
+        case SDLK_x:        return Button::A;
+        case SDLK_z:        return Button::B;
+        case SDLK_RSHIFT:   return Button::Select;
+        case SDLK_RETURN:   return Button::Start;
+        case SDLK_UP:       return Button::Up;
+        case SDLK_DOWN:     return Button::Down;
+        case SDLK_LEFT:     return Button::Left;
+        case SDLK_RIGHT:    return Button::Right;
+        default:            return NO_BUTTON;
+    }
+}
 
-    switch (e.type) {
-        case SDL_QUIT:
-            return false;
 
-        case SDL_KEYDOWN:
-        {
-            // auto keyValue = mapKey(e.key.keysym.sym);
-            // if (keyValue != NoKey)
-            //     keysDown[keyValue] = true;
-            break;
-        }
+bool Keyboard::handleEvents()
+{
+    SDL_Event e;
 
-        case SDL_KEYUP:
-        {
-            // auto keyValue = mapKey(e.key.keysym.sym);
-            // if (keyValue != NoKey)
-            //     keysDown[keyValue] = false;
-            break;
+    while (SDL_PollEvent(&e))
+    {
+        switch (e.type) {
+            case SDL_QUIT:
+                return false;
+
+            case SDL_KEYDOWN:
+            {
+                auto button = mapKey(e.key.keysym.sym);
+                if (button != NO_BUTTON)
+                    m_buttons |= Controller::buttonBit(button);
+                break;
+            }
+
+            case SDL_KEYUP:
+            {
+                auto button = mapKey(e.key.keysym.sym);
+                if (button != NO_BUTTON)
+                    m_buttons &= ~Controller::buttonBit(button);
+                break;
+            }
         }
     }
 
+    m_controller->setButtons(m_buttons);
     return true;
 }
-
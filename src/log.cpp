@@ -0,0 +1,56 @@
+#include "log.hpp"
+
+#include <cstring>
+#include <format>
+#include <print>
+
+
+static const char* CATEGORY_NAMES[(int)LogCategory::N_CATEGORIES] = {
+    "cpu", "ppu-reg", "vram", "dma", "nmi", "irq"
+};
+
+static const size_t DRAIN_CHUNK = 256;
+
+
+const char* logCategoryName(LogCategory category)
+{
+    return CATEGORY_NAMES[(int)category];
+}
+
+bool parseLogCategory(const char* name, LogCategory& category)
+{
+    for (int i=0; i < (int)LogCategory::N_CATEGORIES; i++)
+    {
+        if (!strcmp(name, CATEGORY_NAMES[i]))
+        {
+            category = (LogCategory)i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+size_t Log::drain(FILE* file)
+{
+    LogRecord records[DRAIN_CHUNK];
+    size_t nDrained = 0;
+
+    size_t nPopped;
+    while ((nPopped = s_ring.popBulk(records, DRAIN_CHUNK)) > 0)
+    {
+        for (size_t i=0; i < nPopped; i++)
+        {
+            const LogRecord& record = records[i];
+            std::string message = std::vformat(record.format,
+                std::make_format_args(record.args[0], record.args[1], record.args[2]));
+
+            std::println(file, "[{}] {}", logCategoryName(record.category), message);
+        }
+
+        nDrained += nPopped;
+    }
+
+    return nDrained;
+}
@@ -0,0 +1,231 @@
+#include "mapper.hpp"
+
+#include "bus.hpp"
+#include "cartridge.hpp"
+#include "save_state.hpp"
+
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+
+
+static const uint32_t KBYTES_4  = 0x1000;
+static const uint32_t KBYTES_8  = 0x2000;
+static const uint32_t KBYTES_16 = 0x4000;
+static const uint32_t KBYTES_32 = 0x8000;
+
+
+Mapper* Mapper::create(Cartridge* cart, Bus* bus)
+{
+    switch (cart->mapperNumber())
+    {
+        case NROM:  return new NromMapper(cart, bus);
+        case MMC1:  return new Mmc1Mapper(cart, bus);
+        case UXROM: return new UxromMapper(cart, bus);
+        case CNROM: return new CnromMapper(cart, bus);
+        case MMC3:  return new Mmc3Mapper(cart, bus);
+        default:
+            throw std::runtime_error(std::format("unsupported mapper {}", cart->mapperNumber()));
+    }
+}
+
+
+void Mapper::mapPrg(uint16_t addr, uint32_t size, int32_t iBank)
+{
+    // a ROM smaller than the window, e.g. 16KB in 32KB, is mirrored
+    uint32_t romSize = m_cart->prgRomSize();
+    uint32_t bankSize = std::min(size, romSize);
+    int32_t nBanks = romSize / bankSize;
+    int32_t iWrapped = ((iBank % nBanks) + nBanks) % nBanks;
+
+    for (uint32_t offset = 0; offset < size; offset += bankSize)
+        m_bus->mapPrgRom(addr + offset, bankSize, m_cart->prgRom() + iWrapped * bankSize);
+}
+
+void Mapper::mapChr(uint16_t addr, uint32_t size, int32_t iBank)
+{
+    int32_t nBanks = m_cart->chrSize() / size;
+    int32_t iWrapped = ((iBank % nBanks) + nBanks) % nBanks;
+    m_bus->mapChr(addr, size, iWrapped * size);
+}
+
+void Mapper::setMirroring(Mirroring mirroring)
+{
+    m_bus->ppu()->setMirroring(mirroring);
+}
+
+Mirroring Mapper::headerMirroring()
+{
+    if (m_cart->hasFourScreenVram())
+        return Mirroring::FourScreen;
+
+    return (m_cart->hasVerticalMirroring() ? Mirroring::Vertical : Mirroring::Horizontal);
+}
+
+
+//---- NROM ----
+
+void NromMapper::reset()
+{
+    mapPrg(0x8000, KBYTES_32, 0);
+    mapChr(0x0000, KBYTES_8, 0);
+    setMirroring(headerMirroring());
+}
+
+
+//---- MMC1 ----
+// see https://www.nesdev.org/wiki/MMC1
+// Writes with bit 7 set reset the serial port and lock the last PRG bank
+// at $C000; otherwise bit 0 is shifted in, and the 5th write loads the
+// register selected by its address bits 13-14.
+// The CPU only writing once per RMW instruction, the hardware ignoring
+// writes on consecutive cycles is not emulated
+
+void Mmc1Mapper::reset()
+{
+    m_shiftRegister = 0x00;
+    m_nShifts = 0;
+    m_control = 0x0C;
+    m_chrBanks[0] = 0;
+    m_chrBanks[1] = 0;
+    m_prgBank = 0;
+
+    updateBanks();
+}
+
+void Mmc1Mapper::writeRegister(uint16_t addr, uint8_t value)
+{
+    if (value & 0x80)
+    {
+        m_shiftRegister = 0x00;
+        m_nShifts = 0;
+        m_control |= 0x0C;
+        updateBanks();
+        return;
+    }
+
+    m_shiftRegister |= (value & 0x01) << m_nShifts;
+    m_nShifts ++;
+    if (m_nShifts < 5)
+        return;
+
+    switch ((addr >> 13) & 0x03)
+    {
+        case 0: m_control = m_shiftRegister; break;
+        case 1: m_chrBanks[0] = m_shiftRegister; break;
+        case 2: m_chrBanks[1] = m_shiftRegister; break;
+        case 3: m_prgBank = m_shiftRegister & 0x0F; break;
+    }
+
+    m_shiftRegister = 0x00;
+    m_nShifts = 0;
+    updateBanks();
+}
+
+void Mmc1Mapper::saveState(StateWriter& writer)
+{
+    writer.write(m_shiftRegister);
+    writer.write(m_nShifts);
+    writer.write(m_control);
+    writer.write(m_chrBanks);
+    writer.write(m_prgBank);
+}
+
+void Mmc1Mapper::loadState(StateReader& reader)
+{
+    reader.read(m_shiftRegister);
+    reader.read(m_nShifts);
+    reader.read(m_control);
+    reader.read(m_chrBanks);
+    reader.read(m_prgBank);
+    updateBanks();
+}
+
+void Mmc1Mapper::updateBanks()
+{
+    static const Mirroring MIRRORINGS[] = {
+        Mirroring::SingleScreenLow, Mirroring::SingleScreenHigh, Mirroring::Vertical, Mirroring::Horizontal
+    };
+    setMirroring(MIRRORINGS[m_control & 0x03]);
+
+    switch ((m_control >> 2) & 0x03)
+    {
+        case 0: case 1:
+            // 32KB, the low bit ignored
+            mapPrg(0x8000, KBYTES_32, m_prgBank >> 1);
+            break;
+        case 2:
+            mapPrg(0x8000, KBYTES_16, 0);
+            mapPrg(0xC000, KBYTES_16, m_prgBank);
+            break;
+        case 3:
+            mapPrg(0x8000, KBYTES_16, m_prgBank);
+            mapPrg(0xC000, KBYTES_16, -1);
+            break;
+    }
+
+    if (m_control & 0x10)
+    {
+        mapChr(0x0000, KBYTES_4, m_chrBanks[0]);
+        mapChr(0x1000, KBYTES_4, m_chrBanks[1]);
+    }
+    else
+        mapChr(0x0000, KBYTES_8, m_chrBanks[0] >> 1);
+}
+
+
+//---- UxROM ----
+
+void UxromMapper::reset()
+{
+    m_prgBank = 0;
+    mapPrg(0x8000, KBYTES_16, m_prgBank);
+    mapPrg(0xC000, KBYTES_16, -1);
+    mapChr(0x0000, KBYTES_8, 0);
+    setMirroring(headerMirroring());
+}
+
+void UxromMapper::writeRegister(uint16_t, uint8_t value)
+{
+    m_prgBank = value;
+    mapPrg(0x8000, KBYTES_16, m_prgBank);
+}
+
+void UxromMapper::saveState(StateWriter& writer)
+{
+    writer.write(m_prgBank);
+}
+
+void UxromMapper::loadState(StateReader& reader)
+{
+    reader.read(m_prgBank);
+    mapPrg(0x8000, KBYTES_16, m_prgBank);
+}
+
+
+//---- CNROM ----
+
+void CnromMapper::reset()
+{
+    m_chrBank = 0;
+    mapPrg(0x8000, KBYTES_32, 0);
+    mapChr(0x0000, KBYTES_8, m_chrBank);
+    setMirroring(headerMirroring());
+}
+
+void CnromMapper::writeRegister(uint16_t, uint8_t value)
+{
+    m_chrBank = value;
+    mapChr(0x0000, KBYTES_8, m_chrBank);
+}
+
+void CnromMapper::saveState(StateWriter& writer)
+{
+    writer.write(m_chrBank);
+}
+
+void CnromMapper::loadState(StateReader& reader)
+{
+    reader.read(m_chrBank);
+    mapChr(0x0000, KBYTES_8, m_chrBank);
+}
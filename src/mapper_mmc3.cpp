@@ -0,0 +1,158 @@
+#include "mapper.hpp"
+
+#include "bus.hpp"
+#include "cartridge.hpp"
+#include "log.hpp"
+#include "save_state.hpp"
+
+
+//---- MMC3 ----
+// see https://www.nesdev.org/wiki/MMC3
+// Registers in pairs, even and odd addresses: bank select/data ($8000),
+// mirroring/PRG RAM protect ($A000), IRQ latch/reload ($C000),
+// IRQ disable/enable ($E000).
+//
+// The scanline counter is clocked by the PPU itself at dot 260 of the
+// lines it fetches on (see Ppu::SCANLINE_COUNTER_DOT), but since the PPU
+// lags behind the CPU, the line it asserts the IRQ on would only be
+// reached at the next sync: whenever the IRQ is enabled, an
+// Event::ScanlineIrq is scheduled right after the clock expected to
+// reach zero, which makes the PPU catch up then. The prediction assumes
+// rendering stays enabled: it can only be early, and is made again when
+// the event fires
+
+static const uint32_t KBYTES_1 = 0x0400;
+static const uint32_t KBYTES_2 = 0x0800;
+static const uint32_t KBYTES_8 = 0x2000;
+
+
+void Mmc3Mapper::reset()
+{
+    m_bankSelect = 0x00;
+    static const uint8_t POWER_ON_BANKS[8] = { 0, 2, 4, 5, 6, 7, 0, 1 };
+    for (int i=0; i < 8; i++)
+        m_banks[i] = POWER_ON_BANKS[i];
+
+    m_irqLatch = 0;
+    m_irqCounter = 0;
+    m_isIrqReload = false;
+    m_isIrqEnabled = false;
+    m_bus->cpu()->setIrqLine(false);
+    m_bus->scheduler().cancel(Event::ScanlineIrq);
+
+    setMirroring(headerMirroring());
+    updateBanks();
+}
+
+void Mmc3Mapper::writeRegister(uint16_t addr, uint8_t value)
+{
+    bool isOdd = (addr & 0x01);
+    switch (addr & 0xE000)
+    {
+        case 0x8000:
+            if (isOdd)
+                m_banks[m_bankSelect & 0x07] = value;
+            else
+                m_bankSelect = value;
+            updateBanks();
+            break;
+
+        case 0xA000:
+            // PRG RAM protect (odd) ignored
+            if (!isOdd && !m_cart->hasFourScreenVram())
+                setMirroring((value & 0x01) ? Mirroring::Horizontal : Mirroring::Vertical);
+            break;
+
+        case 0xC000:
+            if (isOdd)
+                m_isIrqReload = true;
+            else
+                m_irqLatch = value;
+            logDebug(LogCategory::Irq, "MMC3 IRQ latch=${0:02X}, reload={1}", m_irqLatch, m_isIrqReload);
+            scheduleIrq();
+            break;
+
+        case 0xE000:
+            // disabling also acknowledges a pending IRQ
+            m_isIrqEnabled = isOdd;
+            if (!isOdd)
+                m_bus->cpu()->setIrqLine(false);
+            scheduleIrq();
+            break;
+    }
+}
+
+void Mmc3Mapper::updateBanks()
+{
+    // PRG: R6 and the second to last bank swap places with bit 6
+    bool isPrgSwapped = (m_bankSelect & 0x40);
+    mapPrg(0x8000, KBYTES_8, isPrgSwapped ? -2 : m_banks[6]);
+    mapPrg(0xA000, KBYTES_8, m_banks[7]);
+    mapPrg(0xC000, KBYTES_8, isPrgSwapped ? m_banks[6] : -2);
+    mapPrg(0xE000, KBYTES_8, -1);
+
+    // CHR: the 2KB banks R0, R1 and the 1KB banks R2-R5 swap halves with bit 7
+    uint16_t chr2k = (m_bankSelect & 0x80) ? 0x1000 : 0x0000;
+    uint16_t chr1k = chr2k ^ 0x1000;
+    mapChr(chr2k,          KBYTES_2, m_banks[0] >> 1);
+    mapChr(chr2k + 0x0800, KBYTES_2, m_banks[1] >> 1);
+    for (int i=0; i < 4; i++)
+        mapChr(chr1k + i * KBYTES_1, KBYTES_1, m_banks[2 + i]);
+}
+
+
+// the mirroring is the PPU's, and a scheduled IRQ the scheduler's
+void Mmc3Mapper::saveState(StateWriter& writer)
+{
+    writer.write(m_bankSelect);
+    writer.write(m_banks);
+    writer.write(m_irqLatch);
+    writer.write(m_irqCounter);
+    writer.write(m_isIrqReload);
+    writer.write(m_isIrqEnabled);
+}
+
+void Mmc3Mapper::loadState(StateReader& reader)
+{
+    reader.read(m_bankSelect);
+    reader.read(m_banks);
+    reader.read(m_irqLatch);
+    reader.read(m_irqCounter);
+    reader.read(m_isIrqReload);
+    reader.read(m_isIrqEnabled);
+    updateBanks();
+}
+
+
+void Mmc3Mapper::clockScanline()
+{
+    if (m_irqCounter == 0 || m_isIrqReload)
+    {
+        m_irqCounter = m_irqLatch;
+        m_isIrqReload = false;
+    }
+    else
+        m_irqCounter --;
+
+    if (m_irqCounter == 0 && m_isIrqEnabled)
+        m_bus->cpu()->setIrqLine(true);
+}
+
+void Mmc3Mapper::handleScanlineIrq()
+{
+    scheduleIrq();
+}
+
+// with the PPU in sync
+void Mmc3Mapper::scheduleIrq()
+{
+    Scheduler& scheduler = m_bus->scheduler();
+    if (!m_isIrqEnabled)
+    {
+        scheduler.cancel(Event::ScanlineIrq);
+        return;
+    }
+
+    uint32_t nClocks = (m_irqCounter == 0 || m_isIrqReload) ? m_irqLatch + 1 : m_irqCounter;
+    scheduler.schedule(Event::ScanlineIrq, scheduler.now() + m_bus->ppu()->dotsUntilScanlineClock(nClocks));
+}
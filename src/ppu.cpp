@@ -2,8 +2,12 @@
 
 #include "bus.hpp"
 #include "bit_operations.hpp"
+#include "tile_decode.hpp"
+#include "log.hpp"
+#include "save_state.hpp"
 
 #include <print>
+#include <algorithm>
 #include <cstring>
 #include <cassert>
 
@@ -21,6 +25,8 @@ static uint8_t N_TILES_Y = 30;
 void Ppu::reset(bool isAutoTest)
 {
     memset(m_frameBuffer, 0x00, sizeof(m_frameBuffer));
+    for (int i=0; i < SCREEN_HEIGHT; i++)
+        resolveRgbaLine(i);
     memset(m_vram, 0x00, sizeof(m_vram));
     memset(m_paletteRam,  0x00, sizeof(m_paletteRam));
     
@@ -34,6 +40,7 @@ void Ppu::reset(bool isAutoTest)
     m_internalRegisterX = 0x00;
     m_internalRegisterW = 0x00;
 
+    m_patternRow = 0;
     m_patternShiftHi = 0x0000;
     m_patternShiftLo = 0x0000;
     m_attrShiftHi = 0x0000;
@@ -51,6 +58,136 @@ void Ppu::reset(bool isAutoTest)
     }
     m_frameComplete = false;
     m_oddFrame = false;
+
+    scheduleFrameEvents();
+}
+
+// the frame events are the scheduler's, saved with the Bus
+void Ppu::saveState(StateWriter& writer)
+{
+    writer.write(m_registers);
+    writer.write(m_internalRegisterV);
+    writer.write(m_internalRegisterT);
+    writer.write(m_internalRegisterX);
+    writer.write(m_internalRegisterW);
+
+    writer.write(m_vram);
+    writer.write(m_nameTableOffsets);
+    writer.write(m_paletteRam);
+    writer.write(m_oamData);
+
+    writer.write(m_scanline);
+    writer.write(m_dot);
+    writer.write(m_frameComplete);
+    writer.write(m_oddFrame);
+
+    // mid-line rendering
+    writer.write(m_patternRow);
+    writer.write(m_patternShiftHi);
+    writer.write(m_patternShiftLo);
+    writer.write(m_attrShiftHi);
+    writer.write(m_attrShiftLo);
+    writer.write(m_ntEntry);
+    writer.write(m_attrEntry);
+    writer.write(m_ppuDataBuffer);
+    writer.write(m_bgPixels);
+}
+
+void Ppu::loadState(StateReader& reader)
+{
+    reader.read(m_registers);
+    reader.read(m_internalRegisterV);
+    reader.read(m_internalRegisterT);
+    reader.read(m_internalRegisterX);
+    reader.read(m_internalRegisterW);
+
+    reader.read(m_vram);
+    reader.read(m_nameTableOffsets);
+    for (auto& offset: m_nameTableOffsets)
+        offset &= (INTERNAL_RAM_SIZE - NAME_TABLE_SIZE);
+    reader.read(m_paletteRam);
+    reader.read(m_oamData);
+
+    reader.read(m_scanline);
+    reader.read(m_dot);
+    if (m_scanline >= SCANLINES_PER_FRAME || m_dot >= DOTS_PER_SCANLINE)
+        throw std::runtime_error(std::format("invalid PPU position in save state; scanline={}, dot={}", m_scanline, m_dot));
+    reader.read(m_frameComplete);
+    reader.read(m_oddFrame);
+
+    reader.read(m_patternRow);
+    reader.read(m_patternShiftHi);
+    reader.read(m_patternShiftLo);
+    reader.read(m_attrShiftHi);
+    reader.read(m_attrShiftLo);
+    reader.read(m_ntEntry);
+    reader.read(m_attrEntry);
+    reader.read(m_ppuDataBuffer);
+    reader.read(m_bgPixels);
+}
+
+void Ppu::setRgbaPalette(const uint32_t* palette)
+{
+    memcpy(m_rgbaPalette, palette, sizeof(m_rgbaPalette));
+    m_isRgbaEnabled = true;
+
+    for (int i=0; i < SCREEN_HEIGHT; i++)
+        resolveRgbaLine(i);
+}
+
+void Ppu::resolveRgbaLine(uint16_t scanline)
+{
+    if (!m_isRgbaEnabled)
+        return;
+
+    uint32_t lineStart = SCREEN_WIDTH * scanline;
+    for (uint32_t i=lineStart; i < lineStart + SCREEN_WIDTH; i++)
+        m_rgbaFrameBuffer[i] = m_rgbaPalette[m_frameBuffer[i] & (N_SYSTEM_COLORS - 1)];
+}
+
+
+// first occurrence of each frame event, from the current position
+void Ppu::scheduleFrameEvents()
+{
+    static const uint32_t vblankPos = VBLANK_SCANLINE * DOTS_PER_SCANLINE + 1;
+    static const uint32_t preRenderPos = PRE_RENDER_SCANLINE * DOTS_PER_SCANLINE + 1;
+    static const uint32_t lastDotPos = DOTS_PER_FRAME - 1;
+
+    Scheduler& scheduler = m_bus->scheduler();
+    uint32_t pos = m_scanline * DOTS_PER_SCANLINE + m_dot;
+    auto dotsUntil = [pos](uint32_t eventPos) { return (eventPos + DOTS_PER_FRAME - pos) % DOTS_PER_FRAME; };
+
+    scheduler.schedule(Event::VBlankStart, scheduler.now() + dotsUntil(vblankPos));
+    scheduler.schedule(Event::PreRenderLine, scheduler.now() + dotsUntil(preRenderPos));
+    scheduler.schedule(Event::FrameComplete, scheduler.now() + dotsUntil(lastDotPos));
+}
+
+// The counter is clocked on the visible lines and the pre-render line,
+// see fetchAndRender()
+uint32_t Ppu::dotsUntilScanlineClock(uint32_t nClocks)
+{
+    uint32_t pos = m_scanline * DOTS_PER_SCANLINE + m_dot;
+
+    // may run past the end of the frame
+    uint32_t scanline = m_scanline + (m_dot > SCANLINE_COUNTER_DOT ? 1 : 0);
+    while (true)
+    {
+        uint16_t frameLine = scanline % SCANLINES_PER_FRAME;
+        bool isCounterLine = (frameLine < SCREEN_HEIGHT || frameLine == PRE_RENDER_SCANLINE);
+        if (isCounterLine && --nClocks == 0)
+            return scanline * DOTS_PER_SCANLINE + SCANLINE_COUNTER_DOT + 1 - pos;
+
+        scanline ++;
+    }
+}
+
+
+// frames all have the same length, there is no odd frame dot skip
+void Ppu::positionAfter(uint32_t nDots, uint16_t& scanline, uint16_t& dot)
+{
+    uint32_t pos = (m_scanline * DOTS_PER_SCANLINE + m_dot + nDots) % DOTS_PER_FRAME;
+    scanline = pos / DOTS_PER_SCANLINE;
+    dot = pos % DOTS_PER_SCANLINE;
 }
 
 
@@ -75,10 +212,7 @@ uint8_t Ppu::read(uint16_t addr)
     if (addr >= 0x2000)
     {
         //access internal vram
-        addr = addr - 0x2000;
-        assert(addr < INTERNAL_RAM_SIZE);
-
-        return m_vram[addr];
+        return m_vram[mapNameTable(addr)];
     }
 
     //access bus chr rom
@@ -95,7 +229,7 @@ void Ppu::write(uint16_t addr, uint8_t value)
     if (addr >= 0x3F00)
     {
         //access palette ram
-        std::println("writing to palette RAM; addr=${:04X}, value=${:02X}", addr, value);
+        logDebug(LogCategory::Vram, "writing to palette RAM; addr=${0:04X}, value=${1:02X}", addr, value);
         //TODO: peculiar behaviour where palette index is shared between background and sprites
         m_paletteRam[(addr - 0x3F00) % PALETTE_RAM_SIZE] = value;
         return;
@@ -103,19 +237,26 @@ void Ppu::write(uint16_t addr, uint8_t value)
 
     if (addr >= 0x2000)
     {
-        addr = addr - 0x2000;
-        if (addr > 0x1000)
-            addr = addr - 0x1000;
-            
-        assert(addr < INTERNAL_RAM_SIZE);
-
-        std::println("writing to VRAM; addr=${:04X}, value=${:02X}", addr, value);
-        m_vram[addr] = value;
+        logDebug(LogCategory::Vram, "writing to VRAM; addr=${0:04X}, value=${1:02X}", addr, value);
+        m_vram[mapNameTable(addr)] = value;
         return;
     }
 
-    //access bus chr rom
-    throw std::runtime_error("error: writing to ROM");
+    //access bus chr (ignored unless CHR RAM)
+    m_bus->writeChr(addr, value);
+}
+
+void Ppu::setMirroring(Mirroring mirroring)
+{
+    static const uint16_t OFFSETS[][4] = {
+        { 0x0000, 0x0000, 0x0400, 0x0400 },     // Horizontal
+        { 0x0000, 0x0400, 0x0000, 0x0400 },     // Vertical
+        { 0x0000, 0x0000, 0x0000, 0x0000 },     // SingleScreenLow
+        { 0x0400, 0x0400, 0x0400, 0x0400 },     // SingleScreenHigh
+        { 0x0000, 0x0400, 0x0800, 0x0C00 },     // FourScreen
+    };
+
+    memcpy(m_nameTableOffsets, OFFSETS[(int)mirroring], sizeof(m_nameTableOffsets));
 }
 
 bool Ppu::isPaletteAddress(uint16_t addr)
@@ -162,12 +303,12 @@ void Ppu::writeRegister(Register reg, uint8_t value)
     // see https://www.nesdev.org/wiki/PPU_scrolling#Summary
     if (reg == Register::PPUCTRL)
     {
-        std::println("writing to PPUCTRL; value=${:02X}", value);
+        logDebug(LogCategory::PpuReg, "writing to PPUCTRL; value=${0:02X}", value);
         assignBits(&m_internalRegisterT, value, 10, 0, 2);
     }
     else if (reg == Register::PPUSCROLL)
     {
-        std::println("writing to PPUSCROLL; value=${:02X}", value);
+        logDebug(LogCategory::PpuReg, "writing to PPUSCROLL; value=${0:02X}", value);
         if (m_internalRegisterW == 0x00)
         {
             //first write
@@ -190,14 +331,14 @@ void Ppu::writeRegister(Register reg, uint8_t value)
         {
             //first write
             assignBits(&m_internalRegisterT, value, 8, 0, 6);
-            std::println("writing to PPUADDR; first  write=${:02X}, t=${:04X}", value, m_internalRegisterT);
+            logDebug(LogCategory::PpuReg, "writing to PPUADDR; first  write=${0:02X}, t=${1:04X}", value, m_internalRegisterT);
             m_internalRegisterT &= ~(1 << 14); //clear Z bit            
             m_internalRegisterW = 0x01;
         }
         else
         {
             //second write
-            std::println("writing to PPUADDR; second write=${:02X}, t=${:04X}", value, m_internalRegisterT);
+            logDebug(LogCategory::PpuReg, "writing to PPUADDR; second write=${0:02X}, t=${1:04X}", value, m_internalRegisterT);
             assignBits(&m_internalRegisterT, value, 0, 0, 8);
             m_internalRegisterV = m_internalRegisterT;
             m_internalRegisterW = 0x00;
@@ -205,7 +346,7 @@ void Ppu::writeRegister(Register reg, uint8_t value)
     }
     else if (reg == Register::PPUDATA)
     {
-        std::println("writing to PPUDATA; v=${:04X}, value=${:02X}", m_internalRegisterV, value);
+        logDebug(LogCategory::PpuReg, "writing to PPUDATA; v=${0:04X}, value=${1:02X}", m_internalRegisterV, value);
         write(m_internalRegisterV, value);
         if (m_registers[Register::PPUCTRL] & 0x04)
             m_internalRegisterV += 32;
@@ -214,24 +355,107 @@ void Ppu::writeRegister(Register reg, uint8_t value)
     }
     else if (reg == Register::PPUMASK)
     {
-        std::println("writing to PPUMASK; value=${:02X}", value);
+        logDebug(LogCategory::PpuReg, "writing to PPUMASK; value=${0:02X}", value);
     }
     else if (reg == Register::OAMADDR)
     {
-        std::println("writing to OAMADDR; value=${:02X}", value);
+        logDebug(LogCategory::PpuReg, "writing to OAMADDR; value=${0:02X}", value);
     }
     else if (reg == Register::OAMDATA)
     {
-        std::println("writing to OAMDATA; value=${:02X}", value);
         m_oamData[m_registers[Register::OAMADDR]] = value;
         m_registers[Register::OAMADDR] ++;
     }
 }
 
 
+// Same as 256 writes to OAMDATA: starts at OAMADDR, wrapping around,
+// which is left unchanged
+void Ppu::writeOamDma(const uint8_t* data)
+{
+    uint8_t oamAddr = m_registers[Register::OAMADDR];
+    uint16_t nFirst = sizeof(m_oamData) - oamAddr;
+
+    memcpy(m_oamData + oamAddr, data, nFirst);
+    memcpy(m_oamData, data + nFirst, oamAddr);
+}
+
+
 void Ppu::clock()
 {
-    fetchAndRender();
+    run(1);
+}
+
+// Renders nDots dots, advancing the master clock; events are dispatched
+// right before the dot they are scheduled at, so the dots in between
+// run without checking for them
+void Ppu::run(uint32_t nDots)
+{
+    Scheduler& scheduler = m_bus->scheduler();
+    uint64_t endTime = scheduler.now() + nDots;
+
+    while (scheduler.now() < endTime)
+    {
+        if (scheduler.nextTimestamp() <= scheduler.now())
+            m_bus->dispatchEvents();
+
+        uint64_t time = scheduler.now();
+        uint64_t runUntil = std::min(endTime, scheduler.nextTimestamp());
+        while (time < runUntil)
+        {
+            // whole scanlines in one pass when neither an event nor a
+            // register access (see Bus::syncPpu()) happens in between
+            if (m_dot == 0 && runUntil - time >= DOTS_PER_SCANLINE)
+            {
+                renderScanline();
+                time += DOTS_PER_SCANLINE;
+                m_nFastLines ++;
+            }
+            else
+            {
+                fetchAndRender();
+                time ++;
+            }
+        }
+
+        scheduler.advanceTo(runUntil);
+    }
+}
+
+
+void Ppu::printStats()
+{
+    uint64_t nLines = m_nFastLines + m_nDotLines;
+    std::println("ppu: {} of {} scanlines rendered in one pass ({:.2f}%)",
+        m_nFastLines, nLines, (nLines == 0 ? 0.0 : 100.0 * m_nFastLines / nLines));
+}
+
+
+// (241, 1)
+void Ppu::startVBlank(uint64_t timestamp)
+{
+    m_registers[Register::PPUSTATUS] |= (1 << StatusFlag::VBlank);
+
+    if (m_registers[Register::PPUCTRL] & 0x80)
+        m_bus->cpu()->requestNMI();
+
+    m_bus->scheduler().schedule(Event::VBlankStart, timestamp + DOTS_PER_FRAME);
+}
+
+// (261, 1)
+void Ppu::startPreRenderLine(uint64_t timestamp)
+{
+    m_registers[Register::PPUSTATUS] = 0x00;
+
+    m_bus->scheduler().schedule(Event::PreRenderLine, timestamp + DOTS_PER_FRAME);
+}
+
+// (261, 340), the last dot of the frame
+void Ppu::completeFrame(uint64_t timestamp)
+{
+    m_frameComplete = true;
+
+    m_bus->scheduler().schedule(Event::FrameComplete, timestamp + DOTS_PER_FRAME);
 }
 
 
@@ -344,29 +568,27 @@ void Ppu::renderFullFrame()
 
             for (auto dy=0; dy < 8; dy++)
             {
-                uint8_t rowDataPlane1 = read(ptOffset + dy);
-                uint8_t rowDataPlane2 = read(ptOffset + dy + 8);
+                // pixels with the palette offset of the tile already in
+                uint64_t row = decodeTileRow(read(ptOffset + dy), read(ptOffset + dy + 8), paletteIndex << 2);
 
                 uint8_t y = 8*yTile + dy;
                 for (auto dx=0; dx < 8; dx++)
                 {
-                    uint8_t x = 8*xTile + (8 - dx - 1);
-                    uint8_t valuePlane1 = (rowDataPlane1 >> dx) & 0x1;
-                    uint8_t valuePlane2 = (rowDataPlane2 >> dx) & 0x1;
+                    uint8_t x = 8*xTile + dx;
 
                     //std::println("setting pixel ({}, {})", x, y);
 
-                    uint8_t pixel = (valuePlane2 << 1) + valuePlane1;
-                    uint8_t colorIndex = read(START_PALETTE_RAM + paletteIndex + pixel);
-                    // std::println("paletteIndex: {:02X}, pixel: {}, colorIndex: 0x{:02X}", 
-                    //    paletteIndex, pixel, colorIndex);
+                    uint8_t colorIndex = read(START_PALETTE_RAM + ((row >> (8 * dx)) & 0xFF));
                     //m_frameBuffer[x*SCREEN_HEIGHT + y] = pixel * 10; //rough "palette indexing"
-                    m_frameBuffer[x*SCREEN_HEIGHT + y] = colorIndex;
+                    m_frameBuffer[SCREEN_WIDTH*y + x] = colorIndex;
                 }
             }
         }
     }
 
+    for (int i=0; i < SCREEN_HEIGHT; i++)
+        resolveRgbaLine(i);
+
     m_frameComplete = true;
 }
 
@@ -374,11 +596,11 @@ void Ppu::renderFullFrame()
 void Ppu::dumpFrameBuffer()
 {
     std::println("-- Ppu::dumpFrameBuffer");
-    for (auto x=0; x < SCREEN_WIDTH; x++)
+    for (auto y=0; y < SCREEN_HEIGHT; y++)
     {
-        for (auto y=0; y < SCREEN_HEIGHT; y++)
+        for (auto x=0; x < SCREEN_WIDTH; x++)
         {
-            std::print("{:02X} ", m_frameBuffer[SCREEN_HEIGHT*x + y]);
+            std::print("{:02X} ", m_frameBuffer[SCREEN_WIDTH*y + x]);
         }
         std::println();
     }
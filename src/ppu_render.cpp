@@ -4,6 +4,7 @@
 #include "bit_operations.hpp"
 
 #include <print>
+#include <cstring>
 #include <cassert>
 
 static const uint16_t START_NAME_TABLES = 0x2000;
@@ -28,10 +29,7 @@ void Ppu::fetchAndRender()
     uint8_t xTile = m_dot / 8;
     uint8_t dy = m_scanline % 8;
 
-    if (m_scanline == 261 && m_dot == 1)
-    {
-        m_registers[Register::PPUSTATUS] = 0x00;
-    }
+    // status changes at (241, 1) and (261, 1) are scheduled events, see Ppu::run()
 
     bool rendering_enabled = ( (m_registers[Register::PPUMASK] & 0x18) != 0 );
     if (rendering_enabled)
@@ -69,10 +67,7 @@ void Ppu::fetchAndRender()
                     //NT (first)
                     //m_ntEntry = read(START_NAME_TABLES + ntDataOffset());
                     uint8_t ntEntry = read(startNameTable + yTile*N_TILES_X + xTile);
-                    uint16_t rowDataPlane1 = read(0x1000 + (ntEntry << 4) + dy);
-                    assignBits(&m_patternShiftLo, rowDataPlane1, 0, 0, 8);
-                    uint16_t rowDataPlane2 = read(0x1000 + (ntEntry << 4) + dy + 8);
-                    assignBits(&m_patternShiftHi, rowDataPlane2, 0, 0, 8);
+                    m_patternRow = m_bus->chrTileRow(0x1000 + (ntEntry << 4) + dy);
                     break;
                 }
                 case 2:
@@ -123,29 +118,125 @@ void Ppu::fetchAndRender()
             //hori(v) = hori(t);
             m_internalRegisterV = (m_internalRegisterV & 0xFBE0) | (m_internalRegisterT & 0x041F);
         }
+        else if (m_dot == SCANLINE_COUNTER_DOT && ((m_scanline >= 0 && m_scanline <= 239) || (m_scanline == 261))) {
+            m_bus->clockScanlineCounter();
+        }
     }
 
-    //post-render scanline
-    if (m_scanline == 241 && m_dot == 1)
-    {
-        m_registers[Register::PPUSTATUS] |= (1 << StatusFlag::VBlank);
-
-        if (m_registers[Register::PPUCTRL] & 0x80)
-            m_bus->cpu()->requestNMI();
-    }
-
-
     m_dot ++;
     if (m_dot > 340) {
+        if (m_scanline <= 239)
+        {
+            if (rendering_enabled)
+                renderSprites();
+            resolveRgbaLine(m_scanline);
+        }
+
         m_dot = 0;
         m_scanline++;
+        m_nDotLines ++;
 
-        if (m_scanline > 261) {
+        if (m_scanline > 261)
             m_scanline = 0;
-            m_frameComplete = true;
+    }
+
+}
+
+// Same as the 341 calls to fetchAndRender() of a whole scanline from
+// dot 0, as long as no register changes in the meantime: the pixels of
+// a visible line are emitted tile by tile in one pass, while v and the
+// shift registers end up as after the last dot
+void Ppu::renderScanline()
+{
+    static const int iNameTable = 0;
+    static const uint16_t startNameTable = START_NAME_TABLES + iNameTable * NAME_TABLE_SIZE;
+    static const uint8_t N_FETCHED_TILES = 43;  // fetched at dots 1, 9, ..., 337
+
+    bool rendering_enabled = ( (m_registers[Register::PPUMASK] & 0x18) != 0 );
+    if (rendering_enabled)
+    {
+        uint8_t yTile = m_scanline / 8;
+        uint8_t dy = m_scanline % 8;
+
+        auto fetchPattern = [&](uint8_t xTile) -> uint64_t {
+            uint8_t ntEntry = read(startNameTable + yTile*N_TILES_X + xTile);
+            return m_bus->chrTileRow(0x1000 + (ntEntry << 4) + dy);
+        };
+        auto fetchAttr = [&](uint8_t xTile) -> uint8_t {
+            uint8_t atEntry = read(startNameTable + ATTR_TABLE_OFFSET + (yTile / 4) * 8 + (xTile / 4));
+            return atEntry  >> (((yTile % 4) / 2) * 2 + ((xTile % 4) / 2) * 2) & 0x03;
+        };
+
+        bool isFetchLine = (m_scanline <= 239 || m_scanline == 261);
+        if (m_scanline <= 239)
+        {
+            // renderPixel() reads the palette through read() on every dot
+            uint8_t palette[7];
+            for (int i=0; i < 7; i++)
+                palette[i] = read(START_PALETTE_RAM + i);
+
+            uint8_t* pixels = m_frameBuffer + SCREEN_WIDTH * m_scanline;
+            uint64_t prevRow = m_patternRow;
+
+            for (uint8_t xTile=0; xTile < N_TILES_X; xTile++)
+            {
+                // the first dot of a tile comes before its fetch, showing
+                // the first pixel of the previous pattern
+                pixels[0] = palette[prevRow & 0xFF];
+
+                uint64_t row = fetchPattern(xTile);
+                uint8_t atTileBits = fetchAttr(xTile);
+
+                for (uint8_t dx=1; dx < 7; dx++)
+                    pixels[dx] = palette[(row >> (8 * dx)) & 0xFF];
+
+                // attribute bits only reach the last dot of a tile
+                pixels[7] = palette[atTileBits + (row >> 56)];
+
+                uint64_t bgPixels = (row & ~(uint64_t)0xFF) | (prevRow & 0xFF);
+                memcpy(m_bgPixels + 8 * xTile, &bgPixels, sizeof(bgPixels));
+
+                prevRow = row;
+                pixels += 8;
+            }
+
+            renderSprites();
+            resolveRgbaLine(m_scanline);
+        }
+
+        if (isFetchLine)
+        {
+            // coarse X incremented every 8 dots up to 256, then from 264
+            for (int i=0; i < 32; i++)
+                incrementCoarseX();
+            incrementY();
+            m_internalRegisterV = (m_internalRegisterV & 0xFBE0) | (m_internalRegisterT & 0x041F);
+            for (int i=0; i < 10; i++)
+                incrementCoarseX();
+
+            if (m_scanline == 261)
+                m_internalRegisterV = (m_internalRegisterV & 0x841F) | (m_internalRegisterV & 0x7BE0);
+
+            // pattern and attributes as left by the last fetches
+            m_patternRow = fetchPattern(N_FETCHED_TILES - 1);
+
+            uint8_t atTileBits = fetchAttr(N_FETCHED_TILES - 1);
+            memset(&m_attrShiftHi, atTileBits >> 1, sizeof(m_attrShiftHi));
+            memset(&m_attrShiftLo, atTileBits & 0x01, sizeof(m_attrShiftLo));
+
+            // nothing can observe that it is later than at its dot
+            m_bus->clockScanlineCounter();
+        }
+        else
+        {
+            incrementY();
+            m_internalRegisterV = (m_internalRegisterV & 0xFBE0) | (m_internalRegisterT & 0x041F);
         }
     }
 
+    m_scanline++;
+    if (m_scanline > 261)
+        m_scanline = 0;
 }
 
 void Ppu::fetchAndRender__no()
@@ -286,9 +377,8 @@ void Ppu::incrementY()
 
 void Ppu::renderPixel(uint8_t dx)
 {
-    uint8_t pixelHi = (m_patternShiftHi >> (7 - dx)) & 0x1;
-    uint8_t pixelLo = (m_patternShiftLo >> (7 - dx)) & 0x1;
-    uint8_t pixel = (pixelHi << 1) | pixelLo;
+    uint8_t pixel = (m_patternRow >> (8 * dx)) & 0xFF;
+    m_bgPixels[m_dot] = pixel;
 
     // 4bit0
     // -----
@@ -317,7 +407,7 @@ void Ppu::renderPixel(uint8_t dx)
 
     //uint16_t curr_dot, curr_scanline;
     //TODO: render pixels on m_dot >= 321
-    long int offset = SCREEN_HEIGHT * m_dot + m_scanline;
+    long int offset = SCREEN_WIDTH * m_scanline + m_dot;
     //std::println("renderPixel({}, {}); offset={}", m_dot, m_scanline, offset);
     //std::println("renderPixel({}, {}); pixel={:02X}, colorIndex={}", m_dot, m_scanline, pixel, colorIndex);
     assert(offset >= 0 && offset < SCREEN_HEIGHT*SCREEN_WIDTH);
@@ -333,16 +423,3 @@ void Ppu::updateShiftRegisters()
     m_attrShiftHi <<= 1;
     m_attrShiftLo <<= 1;
 }
-
-void Ppu::renderOAMs()
-{
-    for (int iOAM=0; iOAM < 64; iOAM++)
-    {
-        uint8_t y    = m_oamData[iOAM*4 + 0];
-        uint8_t tile = m_oamData[iOAM*4 + 1];
-        uint8_t attr = m_oamData[iOAM*4 + 2];
-        uint8_t x    = m_oamData[iOAM*4 + 3];
-
-        uint8_t paletteIndex = 4 + (attr & 0b11);
-    }
-}
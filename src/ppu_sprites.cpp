@@ -0,0 +1,147 @@
+#include "ppu.hpp"
+
+#include "bus.hpp"
+
+#include <algorithm>
+
+
+//---- sprites ----
+// Sprites are composited over a whole visible scanline at once, when its
+// background is complete: at the end of the line for the dot-by-dot
+// renderer, right after the background for renderScanline().
+// The line's sprites are evaluated as the hardware does on the previous
+// line: the first 8 sprites in OAM order covering it, a 9th setting the
+// overflow flag (without the hardware's diagonal scan bug). Their pattern
+// rows come from the predecoded CHR tiles, flipped horizontally as needed.
+// Lower OAM indices win over higher ones even when behind the background.
+// Sprite 0 hit is therefore set at the end of the line it happens on
+
+static const uint16_t START_SPRITE_PALETTES = 0x3F10;
+
+static const uint8_t SPRITE_ATTR_PALETTE = 0x03;
+static const uint8_t SPRITE_ATTR_BEHIND_BG = 0x20;
+static const uint8_t SPRITE_ATTR_FLIP_X = 0x40;
+static const uint8_t SPRITE_ATTR_FLIP_Y = 0x80;
+
+
+uint8_t Ppu::spriteHeight()
+{
+    return (m_registers[Register::PPUCTRL] & 0x20) ? 16 : 8;
+}
+
+
+// Secondary OAM of the scanline: sprites whose OAM Y + 1 is at most
+// height lines above it
+uint8_t Ppu::evaluateSprites(uint16_t scanline)
+{
+    uint8_t height = spriteHeight();
+    uint8_t nSprites = 0;
+
+    for (uint8_t iSprite=0; iSprite < N_SPRITES; iSprite++)
+    {
+        const uint8_t* entry = m_oamData + 4 * iSprite;
+        uint16_t row = scanline - (entry[0] + 1);
+        if (row >= height)
+            continue;
+
+        if (nSprites == MAX_LINE_SPRITES)
+        {
+            m_registers[Register::PPUSTATUS] |= (1 << StatusFlag::SpriteOverflow);
+            break;
+        }
+
+        uint8_t tile = entry[1];
+        uint8_t attr = entry[2];
+        if (attr & SPRITE_ATTR_FLIP_Y)
+            row = height - 1 - row;
+
+        uint16_t addr;
+        if (height == 8)
+        {
+            uint16_t patternTable = (m_registers[Register::PPUCTRL] & 0x08) ? 0x1000 : 0x0000;
+            addr = patternTable + (tile << 4) + row;
+        }
+        else
+        {
+            // 8x16: the pattern table from bit 0, the bottom half in the next tile
+            addr = ((tile & 0x01) << 12) + ((tile & 0xFE) << 4) + ((row & 0x08) << 1) + (row & 0x07);
+        }
+
+        LineSprite& sprite = m_lineSprites[nSprites++];
+        sprite.row = m_bus->chrTileRow(addr, (attr & SPRITE_ATTR_FLIP_X) != 0);
+        sprite.x = entry[3];
+        sprite.attr = attr;
+        sprite.isSpriteZero = (iSprite == 0);
+    }
+
+    return nSprites;
+}
+
+
+// Over the background of the scanline, whose pattern pixels are in m_bgPixels
+void Ppu::renderSprites()
+{
+    uint8_t mask = m_registers[Register::PPUMASK];
+    if (!(mask & 0x10))
+        return;
+
+    uint8_t nSprites = evaluateSprites(m_scanline);
+    if (nSprites == 0)
+        return;
+
+    bool isBgEnabled = (mask & 0x08) != 0;
+    uint8_t bgStartX = (mask & 0x02) ? 0 : 8;
+    uint8_t spriteStartX = (mask & 0x04) ? 0 : 8;
+
+    uint8_t palette[PALETTE_RAM_SIZE / 2];
+    for (int i=0; i < PALETTE_RAM_SIZE / 2; i++)
+        palette[i] = read(START_SPRITE_PALETTES + i);
+
+    // pixels already taken by a sprite with a lower OAM index
+    bool isTaken[SCREEN_WIDTH] = {};
+    uint8_t* pixels = m_frameBuffer + SCREEN_WIDTH * m_scanline;
+
+    for (uint8_t i=0; i < nSprites; i++)
+    {
+        const LineSprite& sprite = m_lineSprites[i];
+        uint8_t paletteOffset = (sprite.attr & SPRITE_ATTR_PALETTE) << 2;
+        bool isBehindBg = (sprite.attr & SPRITE_ATTR_BEHIND_BG) != 0;
+
+        for (uint16_t x=std::max<uint16_t>(sprite.x, spriteStartX); x < sprite.x + 8 && x < SCREEN_WIDTH; x++)
+        {
+            uint8_t pixel = (sprite.row >> (8 * (x - sprite.x))) & 0xFF;
+            if (pixel == 0 || isTaken[x])
+                continue;
+
+            isTaken[x] = true;
+            bool isBgOpaque = isBgEnabled && x >= bgStartX && m_bgPixels[x] != 0;
+
+            if (sprite.isSpriteZero && isBgOpaque && x != SCREEN_WIDTH - 1)
+                m_registers[Register::PPUSTATUS] |= (1 << StatusFlag::SpriteZeroHit);
+
+            if (!isBehindBg || !isBgOpaque)
+                pixels[x] = palette[paletteOffset + pixel];
+        }
+    }
+}
+
+
+// Idle loop skipping stops there, as a loop polling PPUSTATUS for the
+// hit would otherwise be skipped past it, see Cpu::skipIdleLoop()
+uint32_t Ppu::dotsUntilSpriteZeroLineEnd(uint64_t time)
+{
+    bool isHit = (m_registers[Register::PPUSTATUS] & (1 << StatusFlag::SpriteZeroHit)) != 0;
+    uint16_t firstLine = m_oamData[0] + 1;
+    uint16_t lastLine = std::min<uint16_t>(m_oamData[0] + spriteHeight(), SCREEN_HEIGHT - 1);
+    if (isHit || firstLine >= SCREEN_HEIGHT)
+        return UINT32_MAX;
+
+    uint64_t pos = m_scanline * DOTS_PER_SCANLINE + m_dot + (time - m_bus->scheduler().now());
+    uint32_t framePos = pos % DOTS_PER_FRAME;
+    uint16_t scanline = framePos / DOTS_PER_SCANLINE;
+    if (scanline > lastLine)
+        return UINT32_MAX;
+
+    uint16_t endLine = std::max(scanline, firstLine) + 1;
+    return endLine * DOTS_PER_SCANLINE - framePos;
+}
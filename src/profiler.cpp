@@ -0,0 +1,133 @@
+#include "profiler.hpp"
+
+#include "instructions.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <format>
+#include <numeric>
+#include <print>
+#include <stdexcept>
+
+
+// file layout: header, then the counters as little-endian uint64:
+// opcode counts [256], cycles per PC [65536]
+static const char PROFILE_MAGIC[8] = { 'N', 'E', 'S', 'P', 'R', 'O', 'F', 'L' };
+static const uint32_t PROFILE_VERSION = 1;
+
+struct ProfileFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t addrSpaceSize;
+    uint64_t nNmis;
+    uint64_t nMainCycles;
+    uint64_t nNmiCycles;
+};
+
+
+Profiler::Profiler()
+{
+    m_pcCycles.resize(ADDR_SPACE_SIZE);
+    reset();
+}
+
+bool Profiler::isCompiledIn()
+{
+#ifdef CPU_PROFILER
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Profiler::reset()
+{
+    std::fill(std::begin(m_opcodeCounts), std::end(m_opcodeCounts), 0);
+    std::fill(m_pcCycles.begin(), m_pcCycles.end(), 0);
+    m_contextCycles[0] = 0;
+    m_contextCycles[1] = 0;
+    m_nmiDepth = 0;
+    m_nNmis = 0;
+}
+
+uint64_t Profiler::nInstr()
+{
+    return std::accumulate(std::begin(m_opcodeCounts), std::end(m_opcodeCounts), (uint64_t)0);
+}
+
+
+void Profiler::printReport(uint32_t nTop)
+{
+    uint64_t nTotInstr = nInstr();
+    uint64_t nTotCycles = nCycles();
+    if (nTotCycles == 0)
+    {
+        std::println("profiler: nothing executed");
+        return;
+    }
+
+    auto percent = [](uint64_t value, uint64_t total) { return 100.0 * value / total; };
+
+    std::println("profiler: {} instructions, {} cycles", nTotInstr, nTotCycles);
+    std::println("  main loop: {:12d} cycles {:6.2f}%", m_contextCycles[0], percent(m_contextCycles[0], nTotCycles));
+    std::println("  NMI:       {:12d} cycles {:6.2f}%, {} handlers, {:.0f} cycles each",
+        m_contextCycles[1], percent(m_contextCycles[1], nTotCycles), m_nNmis,
+        (m_nNmis == 0 ? 0.0 : (double)m_contextCycles[1] / m_nNmis));
+
+    std::vector<uint16_t> opcodes(N_OPCODES);
+    std::iota(opcodes.begin(), opcodes.end(), 0);
+    std::stable_sort(opcodes.begin(), opcodes.end(),
+        [this](uint16_t a, uint16_t b) { return m_opcodeCounts[a] > m_opcodeCounts[b]; });
+
+    std::println("-- top opcodes by instructions");
+    for (uint32_t i=0; i < nTop && i < N_OPCODES && m_opcodeCounts[opcodes[i]] > 0; i++)
+    {
+        uint8_t opcode = opcodes[i];
+        std::println("  ${:02X} {} {:12d} {:6.2f}%", opcode,
+            operationName(instructionLookupTable[opcode].operation),
+            m_opcodeCounts[opcode], percent(m_opcodeCounts[opcode], nTotInstr));
+    }
+
+    // only the PCs actually executed are sorted
+    std::vector<uint16_t> pcs;
+    for (uint32_t pc=0; pc < ADDR_SPACE_SIZE; pc++)
+    {
+        if (m_pcCycles[pc] > 0)
+            pcs.push_back(pc);
+    }
+    std::sort(pcs.begin(), pcs.end(),
+        [this](uint16_t a, uint16_t b) { return m_pcCycles[a] > m_pcCycles[b]; });
+
+    std::println("-- top PCs by cycles, {} distinct", pcs.size());
+    uint64_t nCumCycles = 0;
+    for (uint32_t i=0; i < nTop && i < pcs.size(); i++)
+    {
+        uint16_t pc = pcs[i];
+        nCumCycles += m_pcCycles[pc];
+        std::println("  ${:04X} {:12d} {:6.2f}% {:6.2f}% cumulative", pc,
+            m_pcCycles[pc], percent(m_pcCycles[pc], nTotCycles), percent(nCumCycles, nTotCycles));
+    }
+}
+
+
+void Profiler::writeDump(const char* path)
+{
+    FILE* file = fopen(path, "wb");
+    if (file == nullptr)
+        throw std::runtime_error(std::format("cannot open profile file [{}]", path));
+
+    ProfileFileHeader header;
+    memcpy(header.magic, PROFILE_MAGIC, sizeof(header.magic));
+    header.version = PROFILE_VERSION;
+    header.addrSpaceSize = ADDR_SPACE_SIZE;
+    header.nNmis = m_nNmis;
+    header.nMainCycles = m_contextCycles[0];
+    header.nNmiCycles = m_contextCycles[1];
+
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(m_opcodeCounts, sizeof(uint64_t), N_OPCODES, file);
+    fwrite(m_pcCycles.data(), sizeof(uint64_t), ADDR_SPACE_SIZE, file);
+    fclose(file);
+}
@@ -0,0 +1,95 @@
+#include "rom_image.hpp"
+
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <mutex>
+
+#ifdef ROM_MMAP_SUPPORTED
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace fs = std::filesystem;
+
+
+// open images by canonical path; entries of released images expire
+static std::mutex s_cacheMutex;
+static std::map<std::string, std::weak_ptr<const RomImage>> s_cache;
+
+
+std::shared_ptr<const RomImage> RomImage::open(const char* path)
+{
+    std::error_code error;
+    std::string key = fs::weakly_canonical(path, error).string();
+    if (error)
+        key = path;
+
+    std::lock_guard<std::mutex> lock(s_cacheMutex);
+
+    auto it = s_cache.find(key);
+    if (it != s_cache.end())
+    {
+        if (auto image = it->second.lock())
+            return image;
+    }
+
+    std::shared_ptr<RomImage> image(new RomImage());
+    if (!image->load(path))
+        return nullptr;
+
+    s_cache[key] = image;
+    return image;
+}
+
+RomImage::~RomImage()
+{
+#ifdef ROM_MMAP_SUPPORTED
+    if (m_isMapped)
+        munmap((void*)m_data, m_size);
+#endif
+}
+
+
+// The file is opened once, a pipe could not be read twice
+bool RomImage::load(const char* path)
+{
+    FILE* f = fopen(path, "rb");
+    if (f == nullptr)
+        return false;
+
+#ifdef ROM_MMAP_SUPPORTED
+    int fd = fileno(f);
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        // the mapping outlives the file
+        void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED)
+        {
+            fclose(f);
+            m_data = (const uint8_t*)data;
+            m_size = st.st_size;
+            m_isMapped = true;
+            return true;
+        }
+    }
+#endif
+
+    bool ok = readAll(f);
+    fclose(f);
+    return ok;
+}
+
+bool RomImage::readAll(FILE* f)
+{
+    uint8_t chunk[4096];
+    size_t nRead;
+    while ((nRead = fread(chunk, sizeof(uint8_t), sizeof(chunk), f)) > 0)
+        m_buffer.insert(m_buffer.end(), chunk, chunk + nRead);
+
+    m_data = m_buffer.data();
+    m_size = m_buffer.size();
+    m_isMapped = false;
+    return !ferror(f);
+}
@@ -0,0 +1,158 @@
+#include "save_state.hpp"
+
+#include "bus.hpp"
+#include "mapper.hpp"
+
+#include <cstddef>
+#include <cstdio>
+#include <format>
+
+
+// layout: header, Cpu, Ppu, internal RAM, controllers, scheduler time and
+// event timestamps, Mapper, cartridge PRG RAM and CHR RAM
+static const char STATE_MAGIC[8] = { 'N', 'E', 'S', 'S', 'T', 'A', 'T', 'E' };
+static const uint32_t STATE_VERSION = 1;
+
+struct StateHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t stateSize;     // including the header
+    // the cartridge the state belongs to
+    uint32_t prgRomSize;
+    uint32_t chrSize;
+    uint32_t mapperNumber;
+};
+
+
+void Bus::saveState(std::vector<uint8_t>& buffer)
+{
+    if (m_cart == nullptr)
+        throw std::runtime_error("no cartridge to save the state of");
+
+    // the PPU state as the CPU sees it
+    syncPpu();
+
+    StateHeader header = {};
+    memcpy(header.magic, STATE_MAGIC, sizeof(header.magic));
+    header.version = STATE_VERSION;
+    header.prgRomSize = m_cart->prgRomSize();
+    header.chrSize = m_cart->chrSize();
+    header.mapperNumber = m_cart->mapperNumber();
+
+    StateWriter writer(buffer);
+    writer.write(header);
+    m_cpu->saveState(writer);
+    m_ppu->saveState(writer);
+    writer.write(m_internalRam);
+    for (auto& controller: m_controllers)
+        controller.saveState(writer);
+
+    writer.write(m_scheduler.now());
+    for (int i=0; i < (int)Event::N_EVENTS; i++)
+        writer.write(m_scheduler.timestamp((Event)i));
+
+    m_mapper->saveState(writer);
+    m_cart->saveState(writer);
+
+    uint32_t stateSize = buffer.size();
+    memcpy(buffer.data() + offsetof(StateHeader, stateSize), &stateSize, sizeof(stateSize));
+}
+
+// All or nothing: the header and the size of the body are checked
+// before anything is loaded, the size against a snapshot of the current
+// state, which is put back if a value turns out invalid partway
+void Bus::loadState(const uint8_t* data, size_t size)
+{
+    if (m_cart == nullptr)
+        throw std::runtime_error("no cartridge to load the state into");
+
+    StateReader reader(data, size);
+    StateHeader header;
+    reader.read(header);
+
+    if (memcmp(header.magic, STATE_MAGIC, sizeof(header.magic)) != 0)
+        throw std::runtime_error("not a save state");
+    if (header.version != STATE_VERSION)
+        throw std::runtime_error(std::format("unsupported save state version {}; expected {}", header.version, STATE_VERSION));
+    if (header.stateSize != size)
+        throw std::runtime_error(std::format("save state of {} bytes, {} expected", size, header.stateSize));
+    if (header.prgRomSize != m_cart->prgRomSize() || header.chrSize != m_cart->chrSize() || header.mapperNumber != m_cart->mapperNumber())
+        throw std::runtime_error(std::format("save state of another cartridge; mapper {}, {} KB PRG, {} KB CHR",
+            header.mapperNumber, header.prgRomSize / 1024, header.chrSize / 1024));
+
+    saveState(m_stateBackup);
+    if (size != m_stateBackup.size())
+        throw std::runtime_error(std::format("save state of {} bytes, {} expected for this cartridge", size, m_stateBackup.size()));
+
+    try {
+        readState(reader);
+    } catch (...) {
+        StateReader backupReader(m_stateBackup.data(), m_stateBackup.size());
+        backupReader.take(sizeof(StateHeader));
+        readState(backupReader);
+        throw;
+    }
+}
+
+// the body, after the header
+void Bus::readState(StateReader& reader)
+{
+    m_cpu->loadState(reader);
+    m_ppu->loadState(reader);
+    reader.read(m_internalRam);
+    for (auto& controller: m_controllers)
+        controller.loadState(reader);
+
+    uint64_t now;
+    reader.read(now);
+    m_scheduler.reset();
+    m_scheduler.advanceTo(now);
+    for (int i=0; i < (int)Event::N_EVENTS; i++)
+    {
+        uint64_t timestamp;
+        reader.read(timestamp);
+        if (timestamp != Scheduler::NEVER)
+            m_scheduler.schedule((Event)i, timestamp);
+    }
+
+    // the banks mapped again
+    m_mapper->loadState(reader);
+    m_cart->loadState(reader);
+
+    if (!reader.isAtEnd())
+        throw std::runtime_error("save state longer than its contents");
+}
+
+
+void Bus::saveStateFile(const char* path)
+{
+    std::vector<uint8_t> buffer;
+    saveState(buffer);
+
+    FILE* file = fopen(path, "wb");
+    if (file == nullptr)
+        throw std::runtime_error(std::format("cannot open save state file [{}]", path));
+
+    size_t nWritten = fwrite(buffer.data(), sizeof(uint8_t), buffer.size(), file);
+    fclose(file);
+
+    if (nWritten != buffer.size())
+        throw std::runtime_error(std::format("cannot write save state file [{}]", path));
+}
+
+void Bus::loadStateFile(const char* path)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr)
+        throw std::runtime_error(std::format("cannot open save state file [{}]", path));
+
+    std::vector<uint8_t> buffer;
+    uint8_t chunk[0x1000];
+    size_t nRead;
+    while ((nRead = fread(chunk, sizeof(uint8_t), sizeof(chunk), file)) > 0)
+        buffer.insert(buffer.end(), chunk, chunk + nRead);
+    fclose(file);
+
+    loadState(buffer.data(), buffer.size());
+}
@@ -183,15 +183,10 @@ void loadPTableTile(Cartridge* cart, uint8_t iChrBlock, PatternTableIndex iPTabl
 {
     for (auto y=0; y < 8; y++)
     {
-        uint8_t rowDataPlane1 = cart->chrData(iChrBlock, tileOffset + y +     iPTable*PTABLE_SIZE);
-        uint8_t rowDataPlane2 = cart->chrData(iChrBlock, tileOffset + y + 8 + iPTable*PTABLE_SIZE);
+        uint64_t row = cart->chrTileRow(iChrBlock, tileOffset + y + iPTable*PTABLE_SIZE);
 
         for (auto x=0; x < 8; x++)
-        {
-            uint8_t valuePlane1 = (rowDataPlane1 >> x) & 0x1;
-            uint8_t valuePlane2 = (rowDataPlane2 >> x) & 0x1;
-            pixels[(8 - x - 1)*8 + y] = (valuePlane2 << 1) + valuePlane1;
-        }
+            pixels[x*8 + y] = (row >> (8 * x)) & 0xFF;
     }
 }
 
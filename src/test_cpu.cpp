@@ -0,0 +1,845 @@
+#include "bus.hpp"
+#include "cartridge.hpp"
+#include "mapper.hpp"
+
+#include <print>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+
+// nestest in automated mode starts at $C000 and ends at this cycle count,
+// see nestest/nestest.txt
+static const uint32_t NESTEST_CYCLES = 26554;
+
+// repeated runs on the same Bus, so that the jit compiles the hot blocks
+static const int N_STEPPED_RUNS = 10;
+// CPU cycles per frame, the batch the emulator runs
+static const uint32_t FRAME_CYCLES = 29781;
+
+// program run from RAM, waiting for VBlank to be set then cleared
+// and counting the frames at $20
+static const uint16_t IDLE_LOOP_START_ADDR = 0x0300;
+static const uint8_t IDLE_LOOP_PROGRAM[] = {
+    0xAD, 0x02, 0x20,   // LDA $2002
+    0x10, 0xFB,         // BPL $0300
+    0xE6, 0x20,         // INC $20
+    0x2C, 0x02, 0x20,   // BIT $2002
+    0x30, 0xFB,         // BMI $0307
+    0x4C, 0x00, 0x03,   // JMP $0300
+};
+static const uint32_t IDLE_LOOP_CYCLES = 150000;    // about 5 frames
+
+// program run from RAM, copying page $02 to OAM from OAMADDR $04
+static const uint16_t OAM_DMA_START_ADDR = 0x0300;
+static const uint8_t OAM_DMA_PROGRAM[] = {
+    0xA9, 0x04,         // LDA #$04
+    0x8D, 0x03, 0x20,   // STA $2003
+    0xA9, 0x02,         // LDA #$02
+    0x8D, 0x14, 0x40,   // STA $4014
+};
+
+// program run from RAM, enabling rendering and the MMC3 IRQ every
+// 11 lines, then spinning on JMP * with interrupts enabled
+static const uint16_t MMC3_START_ADDR = 0x0300;
+static const uint8_t MMC3_PROGRAM[] = {
+    0xA9, 0x18,         // LDA #$18
+    0x8D, 0x01, 0x20,   // STA $2001
+    0xA9, 0x0A,         // LDA #$0A
+    0x8D, 0x00, 0xC0,   // STA $C000
+    0x8D, 0x01, 0xC0,   // STA $C001
+    0x8D, 0x01, 0xE0,   // STA $E001
+    0x58,               // CLI
+    0x4C, 0x11, 0x03,   // JMP $0311
+};
+// IRQ handler at $E000, in the fixed last bank: counts the IRQs at $20,
+// acknowledges and enables again
+static const uint8_t MMC3_IRQ_HANDLER[] = {
+    0xE6, 0x20,         // INC $20
+    0x8D, 0x00, 0xE0,   // STA $E000
+    0x8D, 0x01, 0xE0,   // STA $E001
+    0x40,               // RTI
+};
+static const uint32_t MMC3_CYCLES = 100000;     // about 3 frames
+
+// program in the PRG ROM of an NROM image, run with the IRQ line held:
+// the IRQ is taken right after the CLI and the PLP unmasking it, the
+// handler returning with interrupts disabled. Loops counted at $20,
+// IRQs at $21
+static const uint16_t JIT_IRQ_START_ADDR = 0x8000;
+static const uint8_t JIT_IRQ_PROGRAM[] = {
+    0x78,               // SEI
+    0xE6, 0x20,         // INC $20
+    0x58,               // CLI
+    0xEA,               // NOP
+    0xEA,               // NOP
+    0xA9, 0x00,         // LDA #$00
+    0x48,               // PHA
+    0x28,               // PLP
+    0xEA,               // NOP
+    0xEA,               // NOP
+    0x4C, 0x00, 0x80,   // JMP $8000
+    // IRQ handler at $800F
+    0xE6, 0x21,         // INC $21
+    0x68,               // PLA
+    0x09, 0x04,         // ORA #$04
+    0x48,               // PHA
+    0x40,               // RTI
+};
+static const uint16_t JIT_IRQ_HANDLER_ADDR = 0x800F;
+static const uint32_t JIT_IRQ_CYCLES = 5000;     // about 70 loops, 140 IRQs
+
+// the MMC3 program saved mid-frame, then run for more than 3 frames
+static const uint32_t SAVE_STATE_CYCLES = 45000;
+static const uint32_t LOADED_STATE_CYCLES = 100000;
+
+// program run from RAM, latching controller 1 and shifting its 8
+// buttons into $20, A ending up in bit 7
+static const uint16_t CONTROLLER_START_ADDR = 0x0300;
+static const uint8_t CONTROLLER_PROGRAM[] = {
+    0xA9, 0x01,         // LDA #$01
+    0x8D, 0x16, 0x40,   // STA $4016
+    0xA9, 0x00,         // LDA #$00
+    0x8D, 0x16, 0x40,   // STA $4016
+    0xA2, 0x08,         // LDX #$08
+    0xAD, 0x16, 0x40,   // LDA $4016
+    0x4A,               // LSR A
+    0x26, 0x20,         // ROL $20
+    0xCA,               // DEX
+    0xD0, 0xF7,         // BNE $030C
+};
+
+
+bool testNestest(Cartridge* cart, CpuCore core);
+bool testCoresInLockstep(Cartridge* cart, CpuCore otherCore);
+bool testSteppedExecution(Cartridge* cart, CpuCore core);
+bool testIdleLoopSkipping(Cartridge* cart);
+std::vector<TraceRecord> traceNestest(Cartridge* cart, uint32_t nBatchCycles);
+bool testBinaryTrace(Cartridge* cart);
+bool testOamDma(Cartridge* cart);
+bool testController(Cartridge* cart);
+bool testSharedRom(Cartridge* cart, const char* romPath);
+bool testMmc3();
+bool testJitIrq();
+bool testBatteryRam();
+bool testSaveState();
+bool testProfiler(Cartridge* cart);
+
+
+int main(int argc, char* argv[])
+{
+    const char* romPath = (argc < 2 ? "nestest/nestest.nes" : argv[1]);
+
+    Cartridge* cart;
+    try {
+        cart = new Cartridge(romPath);
+    } catch (const std::exception& e)  {
+        std::println("!! Error loading cartridge: {}", e.what());
+        exit(1);
+    }
+
+    std::println("Testing CPU cores against {}", romPath);
+
+    bool ok = true;
+    ok &= testNestest(cart, CpuCore::Table);
+    ok &= testNestest(cart, CpuCore::Switch);
+    ok &= testNestest(cart, CpuCore::Cached);
+    ok &= testNestest(cart, CpuCore::Jit);
+    ok &= testCoresInLockstep(cart, CpuCore::Switch);
+    ok &= testCoresInLockstep(cart, CpuCore::Cached);
+    ok &= testSteppedExecution(cart, CpuCore::Table);
+    ok &= testSteppedExecution(cart, CpuCore::Jit);
+    ok &= testIdleLoopSkipping(cart);
+    ok &= testBinaryTrace(cart);
+    ok &= testOamDma(cart);
+    ok &= testController(cart);
+    ok &= testSharedRom(cart, romPath);
+    ok &= testMmc3();
+    ok &= testJitIrq();
+    ok &= testBatteryRam();
+    ok &= testSaveState();
+    ok &= testProfiler(cart);
+
+    if (ok)
+        std::println("All tests ok");
+    else
+        std::println("!! Some tests failed");
+
+    return (ok ? 0 : 1);
+}
+
+
+Bus* newNestestBus(Cartridge* cart, CpuCore core)
+{
+    auto bus = new Bus();
+    bus->insertCartridge(cart);
+    bus->reset(true);
+    bus->cpu()->setCore(core);
+
+    return bus;
+}
+
+const char* coreName(CpuCore core)
+{
+    switch (core)
+    {
+        case CpuCore::Switch: return "switch";
+        case CpuCore::Cached: return "cached";
+        case CpuCore::Jit:    return "jit";
+        default:              return "table";
+    }
+}
+
+
+bool testNestest(Cartridge* cart, CpuCore core)
+{
+    auto bus = newNestestBus(cart, core);
+
+    while (bus->cpu()->nTotCycles() < NESTEST_CYCLES)
+        bus->cpu()->clock();
+
+    // nestest stores its result codes at $02 (official opcodes) and $03 (illegal opcodes)
+    uint8_t resOfficial = bus->read(0x02);
+    uint8_t resIllegal  = bus->read(0x03);
+
+    std::print("nestest [{:6s}]: $02=${:02X} $03=${:02X}    ", coreName(core), resOfficial, resIllegal);
+    bool ok = (resOfficial == 0x00 && resIllegal == 0x00);
+    std::println("{}", ok ? "OK" : "!! KO !!");
+
+    delete bus;
+    return ok;
+}
+
+
+bool testCoresInLockstep(Cartridge* cart, CpuCore otherCore)
+{
+    auto busTable = newNestestBus(cart, CpuCore::Table);
+    auto busOther = newNestestBus(cart, otherCore);
+
+    bool ok = true;
+    while (busTable->cpu()->nTotCycles() < NESTEST_CYCLES)
+    {
+        busTable->cpu()->clock();
+        busOther->cpu()->clock();
+
+        auto regsTable = busTable->cpu()->registers();
+        auto regsOther = busOther->cpu()->registers();
+        if (regsTable != regsOther || busTable->cpu()->nTotCycles() != busOther->cpu()->nTotCycles())
+        {
+            std::println("!! cores diverge at CYC:{}; table PC=${:04X} P=${:02X}, {} PC=${:04X} P=${:02X}",
+                busTable->cpu()->nTotCycles(), regsTable.PC, regsTable.P, coreName(otherCore), regsOther.PC, regsOther.P);
+            ok = false;
+            break;
+        }
+    }
+
+    std::println("table vs {} core, cycle by cycle    {}", coreName(otherCore), ok ? "OK" : "!! KO !!");
+
+    delete busTable;
+    delete busOther;
+    return ok;
+}
+
+
+// the reference machine run cycle by cycle, the PPU on each of them,
+// until it reaches nTotCycles
+void catchUpPerCycle(Bus* reference, uint64_t nTotCycles)
+{
+    while (reference->cpu()->nTotCycles() < nTotCycles)
+    {
+        reference->cpu()->clock();
+        for (int i=0; i < 3; ++i)
+            reference->ppu()->clock();
+    }
+}
+
+
+// with the jit core a step runs a whole compiled block
+bool testSteppedExecution(Cartridge* cart, CpuCore core)
+{
+    auto busCycle = newNestestBus(cart, CpuCore::Table);
+    auto busStep  = newNestestBus(cart, core);
+
+    bool ok = true;
+    for (int iRun=0; iRun < N_STEPPED_RUNS && ok; iRun++)
+    {
+        busCycle->reset(true);
+        busStep->reset(true);
+
+        while (busStep->cpu()->nTotCycles() < NESTEST_CYCLES)
+        {
+            // one instruction, then the PPU catches up
+            busStep->runCycles(1);
+
+            catchUpPerCycle(busCycle, busStep->cpu()->nTotCycles());
+
+            auto regsCycle = busCycle->cpu()->registers();
+            auto regsStep  = busStep->cpu()->registers();
+            if (regsCycle != regsStep || busCycle->ppu()->dot() != busStep->ppu()->dot() 
+                || busCycle->ppu()->scanline() != busStep->ppu()->scanline())
+            {
+                std::println("!! stepped execution diverges at CYC:{}; per-cycle PC=${:04X} PPU:{},{}, stepped PC=${:04X} PPU:{},{}",
+                    busStep->cpu()->nTotCycles(), 
+                    regsCycle.PC, busCycle->ppu()->scanline(), busCycle->ppu()->dot(),
+                    regsStep.PC,  busStep->ppu()->scanline(),  busStep->ppu()->dot());
+                ok = false;
+                break;
+            }
+        }
+    }
+
+    std::println("per-cycle vs stepped execution [{:6s}], step by step    {}", coreName(core), ok ? "OK" : "!! KO !!");
+
+    delete busCycle;
+    delete busStep;
+    return ok;
+}
+
+
+// skipped iterations must leave the CPU and the PPU exactly where
+// the per-cycle execution of every instruction does
+bool testIdleLoopSkipping(Cartridge* cart)
+{
+    auto busCycle = newNestestBus(cart, CpuCore::Table);
+    auto busStep  = newNestestBus(cart, CpuCore::Table);
+    busStep->cpu()->setIdleLoopSkipping(true);
+
+    for (auto bus: { busCycle, busStep })
+    {
+        for (uint16_t i=0; i < sizeof(IDLE_LOOP_PROGRAM); i++)
+            bus->write(IDLE_LOOP_START_ADDR + i, IDLE_LOOP_PROGRAM[i]);
+        bus->write(0x20, 0x00);
+        bus->cpu()->setPC(IDLE_LOOP_START_ADDR);
+    }
+
+    bool ok = true;
+    while (busStep->cpu()->nTotCycles() < IDLE_LOOP_CYCLES)
+    {
+        busStep->runCycles(1);
+
+        catchUpPerCycle(busCycle, busStep->cpu()->nTotCycles());
+
+        auto regsCycle = busCycle->cpu()->registers();
+        auto regsStep  = busStep->cpu()->registers();
+        if (regsCycle != regsStep || busCycle->cpu()->nTotCycles() != busStep->cpu()->nTotCycles()
+            || busCycle->ppu()->dot() != busStep->ppu()->dot()
+            || busCycle->ppu()->scanline() != busStep->ppu()->scanline())
+        {
+            std::println("!! idle loop skipping diverges at CYC:{}; per-cycle PC=${:04X} PPU:{},{}, stepped PC=${:04X} PPU:{},{}",
+                busStep->cpu()->nTotCycles(),
+                regsCycle.PC, busCycle->ppu()->scanline(), busCycle->ppu()->dot(),
+                regsStep.PC,  busStep->ppu()->scanline(),  busStep->ppu()->dot());
+            ok = false;
+            break;
+        }
+    }
+
+    uint8_t nFrames = busStep->read(0x20);
+    uint64_t nSkipped = busStep->cpu()->nIdleCyclesSkipped();
+    ok &= (nFrames > 0 && nFrames == busCycle->read(0x20) && nSkipped > 0);
+
+    std::println("idle loop skipping, {} frames, {} of {} cycles skipped    {}",
+        nFrames, nSkipped, busStep->cpu()->nTotCycles(), ok ? "OK" : "!! KO !!");
+
+    delete busCycle;
+    delete busStep;
+    return ok;
+}
+
+
+// nestest traced to a binary file, running nBatchCycles at a time,
+// and read back; empty if the writer did not record every instruction
+std::vector<TraceRecord> traceNestest(Cartridge* cart, uint32_t nBatchCycles)
+{
+    auto tracePath = std::filesystem::temp_directory_path() / "test_cpu.trace";
+    auto bus = newNestestBus(cart, CpuCore::Table);
+
+    auto writer = new TraceWriter(tracePath.string().c_str());
+    bus->cpu()->setTraceWriter(writer);
+    while (bus->cpu()->nTotCycles() < NESTEST_CYCLES)
+        bus->runCycles(std::min(nBatchCycles, (uint32_t)(NESTEST_CYCLES - bus->cpu()->nTotCycles())));
+    bus->cpu()->setTraceWriter(nullptr);
+    writer->close();
+
+    std::vector<TraceRecord> records;
+    TraceReader reader(tracePath.string().c_str());
+    TraceRecord record;
+    while (reader.next(record))
+        records.push_back(record);
+
+    if (records.size() != bus->cpu()->nProcessedInstr() || records.size() != writer->nRecords())
+        records.clear();
+
+    delete writer;
+    delete bus;
+    std::filesystem::remove(tracePath);
+    return records;
+}
+
+// one record per instruction, in order, the first one being the
+// well-known nestest line; the PPU lagging behind in frame batches,
+// records show where it would be, as when syncing it after every instruction
+bool testBinaryTrace(Cartridge* cart)
+{
+    std::vector<TraceRecord> records = traceNestest(cart, 1);
+    std::vector<TraceRecord> batchRecords = traceNestest(cart, FRAME_CYCLES);
+
+    bool ok = (!records.empty() && records.size() == batchRecords.size());
+    for (size_t i=0; ok && i < records.size(); i++)
+    {
+        ok &= (i == 0 || records[i].cycle > records[i - 1].cycle);
+        ok &= (formatTraceRecord(records[i]) == formatTraceRecord(batchRecords[i]));
+    }
+
+    // D8C3  10 0B     BPL $D8D0  ...  PPU: 76, 34 CYC:8643
+    auto midFrame = std::find_if(batchRecords.begin(), batchRecords.end(), [](const TraceRecord& r) { return r.cycle == 8643; });
+    ok = ok && (midFrame != batchRecords.end() && midFrame->scanline == 76 && midFrame->dot == 34);
+    ok = ok && formatTraceRecord(records[0]).starts_with("C000  4C F5 C5  JMP $C5F5                       A:00 X:00 Y:00 P:24 SP:FD");
+
+    // past 2^32 cycles, about 40 minutes in
+    TraceRecord longRun = {};
+    longRun.cycle = 0x100000007;
+    ok &= formatTraceRecord(longRun).ends_with("CYC:4294967303");
+
+    std::println("binary trace, {} records, stepped and in frame batches    {}", records.size(), ok ? "OK" : "!! KO !!");
+    return ok;
+}
+
+
+// the buttons set when strobing are read out in order, then ones; button
+// changes after the strobe are not seen
+bool testController(Cartridge* cart)
+{
+    auto bus = newNestestBus(cart, CpuCore::Table);
+    Controller& controller = bus->controller(0);
+
+    for (uint16_t i=0; i < sizeof(CONTROLLER_PROGRAM); i++)
+        bus->write(CONTROLLER_START_ADDR + i, CONTROLLER_PROGRAM[i]);
+    bus->write(0x20, 0x00);
+    bus->cpu()->setPC(CONTROLLER_START_ADDR);
+
+    uint8_t buttons = Controller::buttonBit(Button::A) | Controller::buttonBit(Button::Start) | Controller::buttonBit(Button::Right);
+    controller.setButtons(buttons);
+
+    while (bus->cpu()->registers().PC != CONTROLLER_START_ADDR + sizeof(CONTROLLER_PROGRAM))
+    {
+        bus->runCycles(1);
+        // released right after the latch
+        if (bus->cpu()->registers().PC == CONTROLLER_START_ADDR + 10)
+            controller.setButtons(0x00);
+    }
+
+    uint8_t value = bus->read(0x20);
+    bool ok = (value == 0x91);
+    ok &= ((bus->read(0x4016) & 0x01) == 1);
+    ok &= ((bus->read(0x4017) & 0x01) == 0);
+
+    std::println("controller, buttons read ${:02X}    {}", value, ok ? "OK" : "!! KO !!");
+
+    delete bus;
+    return ok;
+}
+
+
+// the STA $4014 step includes the 513 or 514 stall cycles, the transfer
+// ending on an even cycle, and the page lands in OAM wrapping around OAMADDR
+bool testOamDma(Cartridge* cart)
+{
+    auto bus = newNestestBus(cart, CpuCore::Table);
+
+    for (uint16_t i=0; i < sizeof(OAM_DMA_PROGRAM); i++)
+        bus->write(OAM_DMA_START_ADDR + i, OAM_DMA_PROGRAM[i]);
+    for (uint16_t i=0; i < 0x100; i++)
+        bus->write(0x0200 + i, i ^ 0x5A);
+    bus->cpu()->setPC(OAM_DMA_START_ADDR);
+
+    while (bus->cpu()->registers().PC != OAM_DMA_START_ADDR + 7)
+        bus->runCycles(1);
+    uint32_t nCycles = bus->runCycles(1);
+
+    bool ok = ((nCycles == 4 + 513 || nCycles == 4 + 514) && bus->cpu()->nTotCycles() % 2 == 0);
+
+    const uint8_t* oam = bus->ppu()->oamData();
+    for (uint16_t i=0; i < 0x100; i++)
+        ok &= (oam[(0x04 + i) & 0xFF] == (i ^ 0x5A));
+
+    std::println("OAM DMA, {} cycles    {}", nCycles, ok ? "OK" : "!! KO !!");
+
+    delete bus;
+    return ok;
+}
+
+
+// a second cartridge of the same file uses the same image and decoded
+// CHR ROM tiles, not copies
+bool testSharedRom(Cartridge* cart, const char* romPath)
+{
+    auto other = new Cartridge(romPath);
+
+    bool ok = (other->prgRom() == cart->prgRom());
+    ok &= (other->prgData(0, 0x0000) == cart->prgData(0, 0x0000));
+    ok &= (other->chrTileRows(0, false) == cart->chrTileRows(0, false));
+    ok &= (other->chrTileRows(0, true) == cart->chrTileRows(0, true));
+
+    std::println("shared ROM image, {} KB PRG    {}", other->prgRomSize() / 1024, ok ? "OK" : "!! KO !!");
+
+    delete other;
+    return ok;
+}
+
+
+void writeRomFile(const std::filesystem::path& romPath, const std::vector<uint8_t>& rom)
+{
+    FILE* f = fopen(romPath.string().c_str(), "wb");
+    fwrite(rom.data(), 1, rom.size(), f);
+    fclose(f);
+}
+
+// 64KB of PRG, each 8KB bank filled with its number but for the IRQ
+// handler and the vectors in the last one, and 8KB of CHR, each 1KB
+// bank filled with its number
+std::vector<uint8_t> buildMmc3Rom()
+{
+    static const uint32_t N_PRG_BANKS = 8;
+    static const uint32_t N_CHR_BANKS = 8;
+
+    std::vector<uint8_t> rom = { 'N', 'E', 'S', 0x1A, N_PRG_BANKS / 2, N_CHR_BANKS / 8, Mapper::MMC3 << 4, 0x00 };
+    rom.resize(Cartridge::HEADER_SIZE, 0x00);
+
+    for (uint32_t iBank=0; iBank < N_PRG_BANKS; iBank++)
+        rom.insert(rom.end(), 0x2000, (uint8_t)iBank);
+
+    uint8_t* lastBank = &rom[rom.size() - 0x2000];
+    std::copy(std::begin(MMC3_IRQ_HANDLER), std::end(MMC3_IRQ_HANDLER), lastBank);
+    static const uint8_t VECTORS[] = { 0x07, 0xE0, 0x00, 0xE0, 0x00, 0xE0 };    // NMI at the RTI
+    std::copy(std::begin(VECTORS), std::end(VECTORS), lastBank + 0x1FFA);
+
+    for (uint32_t iBank=0; iBank < N_CHR_BANKS; iBank++)
+        rom.insert(rom.end(), 0x0400, (uint8_t)iBank);
+
+    return rom;
+}
+
+// Bank switches seen through the CPU and PPU buses; the scanline IRQ
+// taken at the same cycles when stepping with idle loop skipping as
+// when running cycle by cycle
+bool testMmc3()
+{
+    auto romPath = std::filesystem::temp_directory_path() / "test_mmc3.nes";
+    writeRomFile(romPath, buildMmc3Rom());
+
+    auto cart = new Cartridge(romPath.string().c_str());
+    auto busCycle = newNestestBus(cart, CpuCore::Table);
+    auto busStep  = newNestestBus(cart, CpuCore::Table);
+    busStep->cpu()->setIdleLoopSkipping(true);
+
+    // R6 = 3 at $8000, then at $C000 with PRG swapping; R2 = 5 at PPU $1000
+    busStep->write(0x8000, 0x06);
+    busStep->write(0x8001, 0x03);
+    bool ok = (busStep->read(0x8000) == 3 && busStep->read(0xC000) == 6);
+    busStep->write(0x8000, 0x46);
+    ok &= (busStep->read(0x8000) == 6 && busStep->read(0xC000) == 3 && busStep->read(0xE000) == MMC3_IRQ_HANDLER[0]);
+    busStep->write(0x8000, 0x02);
+    busStep->write(0x8001, 0x05);
+    ok &= (busStep->readChr(0x1000) == 5 && busStep->readChr(0x0000) == 0);
+    busStep->reset(true);
+
+    // switching the $8000 bank drops the code decoded there, not at $E000
+    auto busCached = newNestestBus(cart, CpuCore::Cached);
+    BlockCache& blockCache = busCached->cpu()->blockCache();
+    blockCache.fetch(0xE000);
+    ok &= (blockCache.fetch(0x8000).opcode == 0);
+    busCached->write(0x8000, 0x06);
+    busCached->write(0x8001, 0x03);
+    uint64_t nMisses = blockCache.nMisses();
+    blockCache.fetch(0xE000);
+    ok &= (blockCache.nMisses() == nMisses);
+    ok &= (blockCache.fetch(0x8000).opcode == 3 && blockCache.nMisses() == nMisses + 1);
+    delete busCached;
+
+    for (auto bus: { busCycle, busStep })
+    {
+        for (uint16_t i=0; i < sizeof(MMC3_PROGRAM); i++)
+            bus->write(MMC3_START_ADDR + i, MMC3_PROGRAM[i]);
+        bus->write(0x20, 0x00);
+        bus->cpu()->setPC(MMC3_START_ADDR);
+    }
+
+    while (ok && busStep->cpu()->nTotCycles() < MMC3_CYCLES)
+    {
+        busStep->runCycles(1);
+
+        catchUpPerCycle(busCycle, busStep->cpu()->nTotCycles());
+
+        auto regsCycle = busCycle->cpu()->registers();
+        auto regsStep  = busStep->cpu()->registers();
+        if (regsCycle != regsStep || busCycle->cpu()->nTotCycles() != busStep->cpu()->nTotCycles())
+        {
+            std::println("!! MMC3 IRQ diverges at CYC:{}; per-cycle PC=${:04X} PPU:{},{}, stepped PC=${:04X} PPU:{},{}",
+                busStep->cpu()->nTotCycles(),
+                regsCycle.PC, busCycle->ppu()->scanline(), busCycle->ppu()->dot(),
+                regsStep.PC,  busStep->ppu()->scanline(),  busStep->ppu()->dot());
+            ok = false;
+        }
+    }
+
+    // 241 counter lines per frame, an IRQ every 11
+    uint8_t nIrqs = busStep->read(0x20);
+    ok &= (nIrqs >= 60 && nIrqs == busCycle->read(0x20) && busStep->cpu()->nIdleCyclesSkipped() > 0);
+
+    std::println("MMC3 banks and scanline IRQ, {} IRQs    {}", nIrqs, ok ? "OK" : "!! KO !!");
+
+    delete busCycle;
+    delete busStep;
+    delete cart;
+    std::filesystem::remove(romPath);
+    return ok;
+}
+
+
+// compiled blocks end on a CLI or PLP, for a pending IRQ to be taken at
+// the same cycle as when running cycle by cycle
+bool testJitIrq()
+{
+    auto romPath = std::filesystem::temp_directory_path() / "test_jit_irq.nes";
+
+    // NROM, 16KB PRG, 8KB CHR
+    std::vector<uint8_t> rom = { 'N', 'E', 'S', 0x1A, 0x01, 0x01, 0x00, 0x00 };
+    rom.resize(Cartridge::HEADER_SIZE + 0x4000 + 0x2000, 0x00);
+    uint8_t* prg = &rom[Cartridge::HEADER_SIZE];
+    std::copy(std::begin(JIT_IRQ_PROGRAM), std::end(JIT_IRQ_PROGRAM), prg);
+    uint8_t vectors[] = { 0x00, 0x80, 0x00, 0x80, JIT_IRQ_HANDLER_ADDR & 0xFF, JIT_IRQ_HANDLER_ADDR >> 8 };
+    std::copy(std::begin(vectors), std::end(vectors), prg + 0x3FFA);
+    writeRomFile(romPath, rom);
+
+    auto cart = new Cartridge(romPath.string().c_str());
+    auto busCycle = newNestestBus(cart, CpuCore::Table);
+    auto busStep  = newNestestBus(cart, CpuCore::Jit);
+
+    for (auto bus: { busCycle, busStep })
+    {
+        bus->write(0x20, 0x00);
+        bus->write(0x21, 0x00);
+        bus->cpu()->setPC(JIT_IRQ_START_ADDR);
+        bus->cpu()->setIrqLine(true);
+    }
+
+    bool ok = true;
+    while (ok && busStep->cpu()->nTotCycles() < JIT_IRQ_CYCLES)
+    {
+        busStep->runCycles(1);
+
+        catchUpPerCycle(busCycle, busStep->cpu()->nTotCycles());
+
+        auto regsCycle = busCycle->cpu()->registers();
+        auto regsStep  = busStep->cpu()->registers();
+        if (regsCycle != regsStep || busCycle->cpu()->nTotCycles() != busStep->cpu()->nTotCycles())
+        {
+            std::println("!! jit IRQ diverges at CYC:{}; per-cycle PC=${:04X}, stepped PC=${:04X}",
+                busStep->cpu()->nTotCycles(), regsCycle.PC, regsStep.PC);
+            ok = false;
+        }
+    }
+
+    // two IRQs per loop
+    uint8_t nLoops = busStep->read(0x20);
+    uint8_t nIrqs = busStep->read(0x21);
+    ok &= (nLoops > 0 && nLoops == busCycle->read(0x20) && nIrqs == busCycle->read(0x21));
+    ok &= (nIrqs + 2 >= 2 * nLoops);
+    if (busStep->cpu()->jit() != nullptr)
+        ok &= (busStep->cpu()->jit()->nRuns() > 0);
+
+    std::println("IRQ after CLI and PLP in jit blocks, {} IRQs    {}", nIrqs, ok ? "OK" : "!! KO !!");
+
+    delete busCycle;
+    delete busStep;
+    delete cart;
+    std::filesystem::remove(romPath);
+    return ok;
+}
+
+
+// PRG RAM written through the bus is found again by the next cartridge
+// of the same file, in its .sav; a second instance meanwhile has its own
+// RAM, not persisted
+bool testBatteryRam()
+{
+    auto romPath = std::filesystem::temp_directory_path() / "test_battery.nes";
+    auto savePath = std::filesystem::path(romPath).replace_extension(".sav");
+    std::filesystem::remove(savePath);
+
+    // NROM, 16KB PRG, 8KB CHR, battery
+    std::vector<uint8_t> rom = { 'N', 'E', 'S', 0x1A, 0x01, 0x01, 0x02, 0x00 };
+    rom.resize(Cartridge::HEADER_SIZE + 0x4000 + 0x2000, 0x00);
+    writeRomFile(romPath, rom);
+
+    auto cart = new Cartridge(romPath.string().c_str());
+    auto bus = newNestestBus(cart, CpuCore::Table);
+    auto otherCart = new Cartridge(romPath.string().c_str());
+    auto otherBus = newNestestBus(otherCart, CpuCore::Table);
+    bool ok = (bus->read(0x6000) == 0x00 && bus->read(0x7FFF) == 0x00);
+    bus->write(0x6000, 0x5A);
+    bus->write(0x7FFF, 0xA5);
+    otherBus->write(0x6001, 0x77);
+    ok &= (otherBus->read(0x6000) == 0x00 && bus->read(0x6001) == 0x00);
+    delete bus;
+    delete cart;
+    delete otherBus;
+    delete otherCart;
+
+    ok &= (std::filesystem::file_size(savePath) == Cartridge::PRG_RAM_SIZE);
+
+    cart = new Cartridge(romPath.string().c_str());
+    bus = newNestestBus(cart, CpuCore::Table);
+    ok &= (bus->read(0x6000) == 0x5A && bus->read(0x7FFF) == 0xA5 && bus->read(0x6001) == 0x00);
+
+    // written back again from the RAM mapped from the file itself
+    delete bus;
+    delete cart;
+
+    std::vector<uint8_t> saved(Cartridge::PRG_RAM_SIZE);
+    FILE* f = fopen(savePath.string().c_str(), "rb");
+    ok &= (f != nullptr && fread(saved.data(), 1, saved.size(), f) == saved.size());
+    if (f != nullptr)
+        fclose(f);
+    ok &= (std::filesystem::file_size(savePath) == Cartridge::PRG_RAM_SIZE);
+    ok &= (saved[0x0000] == 0x5A && saved[0x1FFF] == 0xA5 && saved[0x0001] == 0x00);
+
+    std::println("battery-backed PRG RAM    {}", ok ? "OK" : "!! KO !!");
+
+    std::filesystem::remove(romPath);
+    std::filesystem::remove(savePath);
+    return ok;
+}
+
+
+// Machines loaded from a snapshot, in memory and in a file, go on
+// exactly as the one saved: same registers and cycles, same RAM, the
+// same frames once one is drawn from start to end, and the same state
+bool testSaveState()
+{
+    auto romPath = std::filesystem::temp_directory_path() / "test_state.nes";
+    auto statePath = std::filesystem::temp_directory_path() / "test_state.state";
+    writeRomFile(romPath, buildMmc3Rom());
+
+    // each its own cartridge RAM
+    Cartridge* carts[3];
+    Bus* buses[3];
+    for (int i=0; i < 3; i++)
+    {
+        carts[i] = new Cartridge(romPath.string().c_str());
+        buses[i] = newNestestBus(carts[i], CpuCore::Jit);
+        buses[i]->cpu()->setIdleLoopSkipping(true);
+    }
+
+    auto busSaved = buses[0];
+    for (uint16_t i=0; i < sizeof(MMC3_PROGRAM); i++)
+        busSaved->write(MMC3_START_ADDR + i, MMC3_PROGRAM[i]);
+    busSaved->cpu()->setPC(MMC3_START_ADDR);
+    while (busSaved->cpu()->nTotCycles() < SAVE_STATE_CYCLES)
+        busSaved->runCycles(1);
+
+    std::vector<uint8_t> state;
+    busSaved->saveState(state);
+    busSaved->saveStateFile(statePath.string().c_str());
+    buses[1]->loadState(state.data(), state.size());
+    buses[2]->loadStateFile(statePath.string().c_str());
+
+    bool ok = (busSaved->ppu()->scanline() < Ppu::SCREEN_HEIGHT);
+    uint64_t endCycles = busSaved->cpu()->nTotCycles() + LOADED_STATE_CYCLES;
+    for (auto bus: buses)
+    {
+        while (bus->cpu()->nTotCycles() < endCycles)
+            bus->runCycles(1);
+    }
+
+    std::vector<uint8_t> endState;
+    busSaved->saveState(endState);
+    for (int i=1; i < 3; i++)
+    {
+        Bus* bus = buses[i];
+        ok &= (bus->cpu()->registers() == busSaved->cpu()->registers());
+        ok &= (bus->cpu()->nTotCycles() == busSaved->cpu()->nTotCycles());
+        for (uint16_t addr=0; addr < Bus::INTERNAL_RAM_SIZE; addr++)
+            ok &= (bus->read(addr) == busSaved->read(addr));
+        ok &= (memcmp(bus->ppu()->frameBuffer(), busSaved->ppu()->frameBuffer(), Ppu::SCREEN_WIDTH * Ppu::SCREEN_HEIGHT) == 0);
+
+        std::vector<uint8_t> otherState;
+        bus->saveState(otherState);
+        ok &= (otherState == endState);
+    }
+    ok &= (busSaved->read(0x20) > 0);
+
+    // anything else is rejected, without loading any of it
+    auto isRejected = [&](const std::vector<uint8_t>& badState) {
+        std::vector<uint8_t> before, after;
+        buses[1]->saveState(before);
+        try {
+            buses[1]->loadState(badState.data(), badState.size());
+            return false;
+        } catch (const std::runtime_error&) {}
+        buses[1]->saveState(after);
+        return (after == before);
+    };
+    // the size in the header, after the magic and version
+    auto withSize = [](std::vector<uint8_t> badState, uint32_t size) {
+        badState.resize(size, 0x00);
+        memcpy(&badState[12], &size, sizeof(size));
+        return badState;
+    };
+
+    std::vector<uint8_t> badState = state;
+    badState[0] ^= 0xFF;
+    ok &= isRejected(badState);
+    ok &= isRejected(withSize(state, state.size() - 1));
+    ok &= isRejected(withSize(state, state.size() + 1));
+    // garbage over the PPU state, its position out of range
+    badState = state;
+    std::fill(badState.begin() + 0x100, badState.begin() + 0x1400, 0xFF);
+    ok &= isRejected(badState);
+
+    std::println("save state, {} bytes, continued for {} cycles    {}", endState.size(), LOADED_STATE_CYCLES, ok ? "OK" : "!! KO !!");
+
+    for (int i=0; i < 3; i++)
+    {
+        delete buses[i];
+        delete carts[i];
+    }
+    std::filesystem::remove(romPath);
+    std::filesystem::remove(statePath);
+    return ok;
+}
+
+
+// every instruction and cycle of nestest, but the reset sequence,
+// is accounted to some opcode and PC
+bool testProfiler(Cartridge* cart)
+{
+    if (!Profiler::isCompiledIn())
+    {
+        std::println("profiler, not built in    skipped");
+        return true;
+    }
+
+    auto bus = newNestestBus(cart, CpuCore::Jit);
+    auto profiler = new Profiler();
+    bus->cpu()->setProfiler(profiler);
+
+    while (bus->cpu()->nTotCycles() < NESTEST_CYCLES)
+        bus->runCycles(1);
+
+    uint64_t nPcCycles = 0;
+    for (uint32_t pc=0; pc < Profiler::ADDR_SPACE_SIZE; pc++)
+        nPcCycles += profiler->pcCycles(pc);
+
+    bool ok = (profiler->nInstr() == bus->cpu()->nProcessedInstr());
+    ok &= (profiler->nCycles() == bus->cpu()->nTotCycles() - 7 && nPcCycles == profiler->nCycles());
+    ok &= (profiler->pcCycles(0xC000) > 0 && profiler->opcodeCount(0x4C) > 0);
+
+    std::println("profiler, {} instructions, {} cycles    {}", profiler->nInstr(), profiler->nCycles(), ok ? "OK" : "!! KO !!");
+
+    delete profiler;
+    delete bus;
+    return ok;
+}
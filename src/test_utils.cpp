@@ -1,10 +1,12 @@
 #include "bit_operations.hpp"
+#include "tile_decode.hpp"
 
 #include <print>
 #include <bitset>
 
 
 void testAssignBits(uint16_t dest, uint16_t src, uint8_t destStart, uint8_t srcStart, uint8_t len, uint16_t expected);
+void testTileDecoder(TileDecoder decoder);
 
 
 int main(int argc, char* argv[])
@@ -22,6 +24,9 @@ int main(int argc, char* argv[])
     testAssignBits(0xffff, 0x00, 10, 0, 2, 0b1111001111111111);
     testAssignBits(0x0000, 0xff, 10, 0, 2, ~(0b1111001111111111));
 
+    for (int i=0; i < (int)TileDecoder::N_DECODERS; i++)
+        testTileDecoder((TileDecoder)i);
+
     std::println("All tests ok");
 }
 
@@ -42,4 +47,48 @@ void testAssignBits(uint16_t dest, uint16_t src, uint8_t destStart, uint8_t srcS
         std::print("!! KO !!  , expected: [{}", std::bitset<16>(expected).to_string());
     
     std::println();
+}
+
+// every pair of planes, with every palette offset, against the scalar loop
+void testTileDecoder(TileDecoder decoder)
+{
+    std::print("tile decoder [{}]    ", tileDecoderName(decoder));
+    if (!isTileDecoderSupported(decoder))
+    {
+        std::println("not supported");
+        return;
+    }
+
+    uint8_t tile[16];
+    uint64_t rows[8];
+    uint64_t expectedRows[8];
+    for (uint32_t plane1=0; plane1 < 256; plane1++)
+    {
+        for (uint32_t plane2Base=0; plane2Base < 256; plane2Base += 8)
+        {
+            for (int dy=0; dy < 8; dy++)
+            {
+                tile[dy] = plane1;
+                tile[dy + 8] = plane2Base + dy;
+            }
+
+            for (uint8_t attrBits=0; attrBits < 16; attrBits += 4)
+            {
+                decodeTile(decoder, tile, attrBits, rows);
+                decodeTile(TileDecoder::Scalar, tile, attrBits, expectedRows);
+
+                for (int dy=0; dy < 8; dy++)
+                {
+                    if (rows[dy] != expectedRows[dy] || rows[dy] != decodeTileRow(tile[dy], tile[dy + 8], attrBits))
+                    {
+                        std::println("!! KO !!  , planes [{:02X}] [{:02X}] attr {}: {:016X}, expected: {:016X}",
+                            tile[dy], tile[dy + 8], attrBits, rows[dy], expectedRows[dy]);
+                        return;
+                    }
+                }
+            }
+        }
+    }
+
+    std::println("OK");
 }
\ No newline at end of file
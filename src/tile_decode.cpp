@@ -0,0 +1,176 @@
+#include "tile_decode.hpp"
+
+#include <array>
+#include <bit>
+
+#ifdef TILE_DECODE_X86
+#include <immintrin.h>
+#endif
+
+
+static const uint16_t N_TILE_ROWS = 8;
+static const uint64_t LOW_BITS = 0x0101010101010101;
+
+
+static constexpr std::array<uint64_t, 256> makeSpreadTable()
+{
+    std::array<uint64_t, 256> table {};
+    for (uint32_t value=0; value < 256; value++)
+    {
+        for (int x=0; x < 8; x++)
+            table[value] |= (uint64_t)((value >> (7 - x)) & 0x1) << (8 * x);
+    }
+
+    return table;
+}
+
+// bit (7 - x) of the index in byte x
+static constexpr std::array<uint64_t, 256> SPREAD_TABLE = makeSpreadTable();
+
+
+const char* tileDecoderName(TileDecoder decoder)
+{
+    switch (decoder)
+    {
+        case TileDecoder::Lut:  return "lut";
+        case TileDecoder::Pdep: return "pdep";
+        case TileDecoder::Sse2: return "sse2";
+        default:                return "scalar";
+    }
+}
+
+bool isTileDecoderSupported(TileDecoder decoder)
+{
+    switch (decoder)
+    {
+        case TileDecoder::Scalar:
+        case TileDecoder::Lut:
+            return true;
+
+#ifdef TILE_DECODE_X86
+        case TileDecoder::Pdep:
+            // PDEP is microcoded, hence slow, on AMD before Zen 3:
+            // bestTileDecoder() never picks it
+            return __builtin_cpu_supports("bmi2");
+        case TileDecoder::Sse2:
+            return true;
+#endif
+
+        default:
+            return false;
+    }
+}
+
+TileDecoder bestTileDecoder()
+{
+    return (isTileDecoderSupported(TileDecoder::Sse2) ? TileDecoder::Sse2 : TileDecoder::Lut);
+}
+
+
+uint64_t decodeTileRow(uint8_t plane1, uint8_t plane2, uint8_t attrBits)
+{
+    return SPREAD_TABLE[plane1] | (SPREAD_TABLE[plane2] << 1) | (attrBits * LOW_BITS);
+}
+
+
+static void decodeTileScalar(const uint8_t* tile, uint8_t attrBits, uint64_t* rows)
+{
+    for (int dy=0; dy < N_TILE_ROWS; dy++)
+    {
+        uint8_t plane1 = tile[dy];
+        uint8_t plane2 = tile[dy + 8];
+
+        uint64_t row = 0;
+        for (int x=0; x < 8; x++)
+        {
+            uint64_t pixel = (((plane2 >> (7 - x)) & 0x1) << 1) | ((plane1 >> (7 - x)) & 0x1);
+            row |= (pixel | attrBits) << (8 * x);
+        }
+
+        rows[dy] = row;
+    }
+}
+
+static void decodeTileLut(const uint8_t* tile, uint8_t attrBits, uint64_t* rows)
+{
+    for (int dy=0; dy < N_TILE_ROWS; dy++)
+        rows[dy] = decodeTileRow(tile[dy], tile[dy + 8], attrBits);
+}
+
+
+#ifdef TILE_DECODE_X86
+
+// PDEP moves bit x of the plane into byte x, the byte swap then puts
+// the leftmost pixel first
+__attribute__((target("bmi2")))
+static void decodeTilePdep(const uint8_t* tile, uint8_t attrBits, uint64_t* rows)
+{
+    uint64_t attr = std::byteswap(attrBits * LOW_BITS);
+    for (int dy=0; dy < N_TILE_ROWS; dy++)
+    {
+        uint64_t row = _pdep_u64(tile[dy], LOW_BITS) | _pdep_u64(tile[dy + 8], LOW_BITS << 1);
+        rows[dy] = std::byteswap(row | attr);
+    }
+}
+
+// Two rows per register: each plane byte is broadcast over 8 lanes by
+// unpacking it with itself, then every lane tests its own bit
+static void decodeTileSse2(const uint8_t* tile, uint8_t attrBits, uint64_t* rows)
+{
+    const __m128i bitMask = _mm_set_epi8(
+        0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80,
+        0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80);
+    const __m128i attr = _mm_set1_epi8(attrBits);
+    const __m128i one = _mm_set1_epi8(0x01);
+    const __m128i two = _mm_set1_epi8(0x02);
+
+    __m128i planes = _mm_loadu_si128((const __m128i*)tile);
+    __m128i planes1 = _mm_unpacklo_epi8(planes, planes);    // rows 0-7, each twice
+    __m128i planes2 = _mm_unpackhi_epi8(planes, planes);
+
+    __m128i quads1Lo = _mm_unpacklo_epi16(planes1, planes1);    // rows 0-3, each 4 times
+    __m128i quads1Hi = _mm_unpackhi_epi16(planes1, planes1);
+    __m128i quads2Lo = _mm_unpacklo_epi16(planes2, planes2);
+    __m128i quads2Hi = _mm_unpackhi_epi16(planes2, planes2);
+
+    // rows 2i and 2i+1, each over 8 lanes
+    __m128i rowPairs1[4] = {
+        _mm_unpacklo_epi32(quads1Lo, quads1Lo), _mm_unpackhi_epi32(quads1Lo, quads1Lo),
+        _mm_unpacklo_epi32(quads1Hi, quads1Hi), _mm_unpackhi_epi32(quads1Hi, quads1Hi) };
+    __m128i rowPairs2[4] = {
+        _mm_unpacklo_epi32(quads2Lo, quads2Lo), _mm_unpackhi_epi32(quads2Lo, quads2Lo),
+        _mm_unpacklo_epi32(quads2Hi, quads2Hi), _mm_unpackhi_epi32(quads2Hi, quads2Hi) };
+
+    for (int i=0; i < 4; i++)
+    {
+        __m128i bits1 = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(rowPairs1[i], bitMask), bitMask), one);
+        __m128i bits2 = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(rowPairs2[i], bitMask), bitMask), two);
+
+        __m128i pixels = _mm_or_si128(_mm_or_si128(bits1, bits2), attr);
+        _mm_storeu_si128((__m128i*)(rows + 2*i), pixels);
+    }
+}
+
+#endif
+
+
+void decodeTile(TileDecoder decoder, const uint8_t* tile, uint8_t attrBits, uint64_t* rows)
+{
+    switch (decoder)
+    {
+#ifdef TILE_DECODE_X86
+        case TileDecoder::Pdep:
+            decodeTilePdep(tile, attrBits, rows);
+            break;
+        case TileDecoder::Sse2:
+            decodeTileSse2(tile, attrBits, rows);
+            break;
+#endif
+        case TileDecoder::Lut:
+            decodeTileLut(tile, attrBits, rows);
+            break;
+        default:
+            decodeTileScalar(tile, attrBits, rows);
+            break;
+    }
+}
@@ -0,0 +1,148 @@
+#include "trace.hpp"
+
+#include "instructions.hpp"
+
+#include <cstring>
+#include <format>
+#include <stdexcept>
+
+
+// file layout: header, then the raw records
+// version 2: 64-bit cycle counts
+static const char TRACE_MAGIC[8] = { 'N', 'E', 'S', 'T', 'R', 'A', 'C', 'E' };
+static const uint32_t TRACE_VERSION = 2;
+
+struct TraceFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+};
+
+
+TraceWriter::TraceWriter(const char* path)
+{
+    m_file = fopen(path, "wb");
+    if (m_file == nullptr)
+        throw std::runtime_error(std::format("cannot open trace file [{}]", path));
+
+    TraceFileHeader header;
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.recordSize = sizeof(TraceRecord);
+    fwrite(&header, sizeof(header), 1, m_file);
+
+    m_stopping = false;
+    m_nRecords = 0;
+    m_nStalls = 0;
+    m_thread = std::thread(&TraceWriter::drain, this);
+}
+
+TraceWriter::~TraceWriter()
+{
+    close();
+}
+
+void TraceWriter::close()
+{
+    if (m_file == nullptr)
+        return;
+
+    m_stopping = true;
+    m_thread.join();
+
+    fclose(m_file);
+    m_file = nullptr;
+}
+
+// writer thread
+void TraceWriter::drain()
+{
+    auto chunk = std::make_unique<TraceRecord[]>(WRITE_CHUNK);
+    while (true)
+    {
+        // checked before popping, so that nothing pushed before close() is lost
+        bool isLastPass = m_stopping;
+
+        size_t nPopped = m_ring.popBulk(chunk.get(), WRITE_CHUNK);
+        if (nPopped > 0)
+        {
+            fwrite(chunk.get(), sizeof(TraceRecord), nPopped, m_file);
+            m_nRecords += nPopped;
+            continue;
+        }
+
+        if (isLastPass)
+            break;
+
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+
+    fflush(m_file);
+}
+
+
+TraceReader::TraceReader(const char* path)
+{
+    m_file = fopen(path, "rb");
+    if (m_file == nullptr)
+        throw std::runtime_error(std::format("cannot open trace file [{}]", path));
+
+    TraceFileHeader header;
+    if (fread(&header, sizeof(header), 1, m_file) != 1 || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic))
+        || header.version != TRACE_VERSION || header.recordSize != sizeof(TraceRecord))
+    {
+        fclose(m_file);
+        throw std::runtime_error(std::format("[{}] is not a CPU trace of this version", path));
+    }
+}
+
+TraceReader::~TraceReader()
+{
+    fclose(m_file);
+}
+
+bool TraceReader::next(TraceRecord& record)
+{
+    return (fread(&record, sizeof(record), 1, m_file) == 1);
+}
+
+
+std::string formatTraceRecord(const TraceRecord& record)
+{
+    const Instruction& instr = instructionLookupTable[record.opcodeBytes[0]];
+    const uint8_t* bytes = record.opcodeBytes;
+    uint16_t absAddr = (bytes[2] << 8) | bytes[1];
+
+    std::string opcodeBytes;
+    uint8_t nBytes = addrModeBytes(instr.addrMode);
+    if (nBytes == 1)
+        opcodeBytes = std::format("{:02X}", bytes[0]);
+    else if (nBytes == 2)
+        opcodeBytes = std::format("{:02X} {:02X}", bytes[0], bytes[1]);
+    else
+        opcodeBytes = std::format("{:02X} {:02X} {:02X}", bytes[0], bytes[1], bytes[2]);
+
+    std::string args;
+    switch (instr.addrMode)
+    {
+        case AddrMode::ABS: args = std::format("${:04X}", absAddr); break;
+        case AddrMode::ABX: args = std::format("${:04X},X", absAddr); break;
+        case AddrMode::ABY: args = std::format("${:04X},Y", absAddr); break;
+        case AddrMode::IND: args = std::format("(${:04X})", absAddr); break;
+        case AddrMode::ZP0: args = std::format("${:02X}", bytes[1]); break;
+        case AddrMode::ZPX: args = std::format("${:02X},X", bytes[1]); break;
+        case AddrMode::ZPY: args = std::format("${:02X},Y", bytes[1]); break;
+        case AddrMode::IZX: args = std::format("(${:02X},X)", bytes[1]); break;
+        case AddrMode::IZY: args = std::format("(${:02X}),Y", bytes[1]); break;
+        case AddrMode::IMM: args = std::format("#${:02X}", bytes[1]); break;
+        case AddrMode::ACC: args = "A"; break;
+        case AddrMode::REL: args = std::format("${:04X}", (uint16_t)(record.pc + 2 + (int8_t)bytes[1])); break;
+        default: break;
+    }
+
+    return std::format("{:04X}  {:9s} {} {:27s} A:{:02X} X:{:02X} Y:{:02X} P:{:02X} SP:{:02X} PPU:{:3d},{:3d} CYC:{:d}",
+        record.pc, opcodeBytes, operationName(instr.operation), args,
+        record.A, record.X, record.Y, record.P, record.SP,
+        record.scanline, record.dot, record.cycle);
+}
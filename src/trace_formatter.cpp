@@ -0,0 +1,32 @@
+#include "trace.hpp"
+
+#include <print>
+
+
+// Renders a binary CPU trace (see trace.hpp) as nestest-style text
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        std::println("usage: {} <trace file> [first record] [n records]", argv[0]);
+        return 1;
+    }
+
+    uint64_t iFirst = (argc > 2 ? std::stoull(argv[2]) : 0);
+    uint64_t nRecords = (argc > 3 ? std::stoull(argv[3]) : UINT64_MAX);
+
+    try {
+        TraceReader reader(argv[1]);
+
+        TraceRecord record;
+        for (uint64_t i=0; i < iFirst + nRecords && reader.next(record); i++)
+        {
+            if (i >= iFirst)
+                std::println("{}", formatTraceRecord(record));
+        }
+    } catch (const std::exception& e) {
+        std::println("!! {}", e.what());
+        return 1;
+    }
+
+    return 0;
+}
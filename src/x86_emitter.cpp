@@ -0,0 +1,322 @@
+#include "x86_emitter.hpp"
+
+#include <cassert>
+#include <cstring>
+
+
+static const size_t UNBOUND_LABEL = SIZE_MAX;
+
+
+X86Label X86Emitter::newLabel()
+{
+    m_labels.push_back(UNBOUND_LABEL);
+    return m_labels.size() - 1;
+}
+
+void X86Emitter::bind(X86Label label)
+{
+    m_labels[label] = m_code.size();
+}
+
+void X86Emitter::finish()
+{
+    for (auto& fixup: m_fixups)
+    {
+        assert(m_labels[fixup.target] != UNBOUND_LABEL);
+        int32_t rel = m_labels[fixup.target] - (fixup.pos + 4);
+        memcpy(&m_code[fixup.pos], &rel, sizeof(rel));
+    }
+    m_fixups.clear();
+}
+
+
+void X86Emitter::mov(X86Reg dst, X86Reg src)
+{
+    emitReg(Size::Dword, { 0x8B }, dst, src);
+}
+
+void X86Emitter::mov64(X86Reg dst, X86Reg src)
+{
+    emitReg(Size::Qword, { 0x8B }, dst, src);
+}
+
+void X86Emitter::movImm(X86Reg dst, uint32_t imm)
+{
+    if (dst >= R8)
+        emitBytes({ 0x41 });
+    emitBytes({ (uint8_t)(0xB8 + (dst & 7)) });
+    emitImm32(imm);
+}
+
+void X86Emitter::movImm64(X86Reg dst, uint64_t imm)
+{
+    emitBytes({ (uint8_t)(dst >= R8 ? 0x49 : 0x48), (uint8_t)(0xB8 + (dst & 7)) });
+    emitImm32(imm & 0xFFFFFFFF);
+    emitImm32(imm >> 32);
+}
+
+void X86Emitter::movzx8(X86Reg dst, X86Mem src)
+{
+    emitMem(Size::Dword, { 0x0F, 0xB6 }, dst, src);
+}
+
+void X86Emitter::movzx8(X86Reg dst, X86Reg src)
+{
+    // the REX of a byte operation, for the source
+    emitReg(Size::Byte, { 0x0F, 0xB6 }, dst, src);
+}
+
+void X86Emitter::movzx16(X86Reg dst, X86Reg src)
+{
+    emitReg(Size::Dword, { 0x0F, 0xB7 }, dst, src);
+}
+
+void X86Emitter::load64(X86Reg dst, X86Mem src)
+{
+    emitMem(Size::Qword, { 0x8B }, dst, src);
+}
+
+void X86Emitter::store8(X86Mem dst, X86Reg src)
+{
+    emitMem(Size::Byte, { 0x88 }, src, dst);
+}
+
+void X86Emitter::store16Imm(X86Mem dst, uint16_t imm)
+{
+    emitBytes({ 0x66 });
+    emitMem(Size::Dword, { 0xC7 }, 0, dst);
+    emitImm16(imm);
+}
+
+void X86Emitter::lea(X86Reg dst, X86Mem src)
+{
+    emitMem(Size::Dword, { 0x8D }, dst, src);
+}
+
+
+void X86Emitter::alu(X86Alu op, X86Reg dst, X86Reg src)
+{
+    emitReg(Size::Dword, { (uint8_t)(((uint8_t)op << 3) | 0x01) }, src, dst);
+}
+
+void X86Emitter::alu8(X86Alu op, X86Reg dst, X86Reg src)
+{
+    emitReg(Size::Byte, { (uint8_t)((uint8_t)op << 3) }, src, dst);
+}
+
+void X86Emitter::aluImm(X86Alu op, X86Reg dst, int32_t imm)
+{
+    if (imm >= -128 && imm <= 127)
+    {
+        emitReg(Size::Dword, { 0x83 }, (uint8_t)op, dst);
+        emitBytes({ (uint8_t)imm });
+    }
+    else
+    {
+        emitReg(Size::Dword, { 0x81 }, (uint8_t)op, dst);
+        emitImm32(imm);
+    }
+}
+
+void X86Emitter::aluImm64(X86Alu op, X86Reg dst, int8_t imm)
+{
+    emitReg(Size::Qword, { 0x83 }, (uint8_t)op, dst);
+    emitBytes({ (uint8_t)imm });
+}
+
+void X86Emitter::alu8Imm(X86Alu op, X86Reg dst, uint8_t imm)
+{
+    emitReg(Size::Byte, { 0x80 }, (uint8_t)op, dst);
+    emitBytes({ imm });
+}
+
+void X86Emitter::aluMemImm(X86Alu op, X86Mem dst, int32_t imm)
+{
+    if (imm >= -128 && imm <= 127)
+    {
+        emitMem(Size::Dword, { 0x83 }, (uint8_t)op, dst);
+        emitBytes({ (uint8_t)imm });
+    }
+    else
+    {
+        emitMem(Size::Dword, { 0x81 }, (uint8_t)op, dst);
+        emitImm32(imm);
+    }
+}
+
+void X86Emitter::aluMem(X86Alu op, X86Mem dst, X86Reg src)
+{
+    emitMem(Size::Dword, { (uint8_t)(((uint8_t)op << 3) | 0x01) }, src, dst);
+}
+
+void X86Emitter::cmp64(X86Reg a, X86Reg b)
+{
+    emitReg(Size::Qword, { 0x39 }, b, a);
+}
+
+void X86Emitter::test(X86Reg a, X86Reg b)
+{
+    emitReg(Size::Dword, { 0x85 }, b, a);
+}
+
+void X86Emitter::test64(X86Reg a, X86Reg b)
+{
+    emitReg(Size::Qword, { 0x85 }, b, a);
+}
+
+void X86Emitter::testImm(X86Reg reg, uint32_t imm)
+{
+    emitReg(Size::Dword, { 0xF7 }, 0, reg);
+    emitImm32(imm);
+}
+
+
+void X86Emitter::shift8(X86Shift op, X86Reg reg)
+{
+    emitReg(Size::Byte, { 0xD0 }, (uint8_t)op, reg);
+}
+
+void X86Emitter::shiftImm(X86Shift op, X86Reg reg, uint8_t count)
+{
+    emitReg(Size::Dword, { 0xC1 }, (uint8_t)op, reg);
+    emitBytes({ count });
+}
+
+void X86Emitter::btImm(X86Reg reg, uint8_t bit)
+{
+    emitReg(Size::Dword, { 0x0F, 0xBA }, 4, reg);
+    emitBytes({ bit });
+}
+
+void X86Emitter::cmc()
+{
+    emitBytes({ 0xF5 });
+}
+
+void X86Emitter::setcc(X86Cond cond, X86Reg dst)
+{
+    emitReg(Size::Byte, { 0x0F, (uint8_t)(0x90 + (uint8_t)cond) }, 0, dst);
+}
+
+
+void X86Emitter::push(X86Reg reg)
+{
+    if (reg >= R8)
+        emitBytes({ 0x41 });
+    emitBytes({ (uint8_t)(0x50 + (reg & 7)) });
+}
+
+void X86Emitter::pop(X86Reg reg)
+{
+    if (reg >= R8)
+        emitBytes({ 0x41 });
+    emitBytes({ (uint8_t)(0x58 + (reg & 7)) });
+}
+
+void X86Emitter::call(X86Reg target)
+{
+    emitReg(Size::Dword, { 0xFF }, 2, target);
+}
+
+void X86Emitter::ret()
+{
+    emitBytes({ 0xC3 });
+}
+
+void X86Emitter::jmp(X86Label target)
+{
+    emitBytes({ 0xE9 });
+    emitRel32(target);
+}
+
+void X86Emitter::jcc(X86Cond cond, X86Label target)
+{
+    emitBytes({ 0x0F, (uint8_t)(0x80 + (uint8_t)cond) });
+    emitRel32(target);
+}
+
+
+void X86Emitter::emitBytes(std::initializer_list<uint8_t> bytes)
+{
+    m_code.insert(m_code.end(), bytes);
+}
+
+void X86Emitter::emitImm16(uint16_t value)
+{
+    m_code.push_back(value & 0xFF);
+    m_code.push_back(value >> 8);
+}
+
+void X86Emitter::emitImm32(uint32_t value)
+{
+    for (int i=0; i < 4; i++)
+        m_code.push_back((value >> (8*i)) & 0xFF);
+}
+
+void X86Emitter::emitRex(Size size, uint8_t reg, uint8_t index, uint8_t base)
+{
+    uint8_t rex = 0x40;
+    if (size == Size::Qword)
+        rex |= 0x08;
+    if (reg & 0x08)
+        rex |= 0x04;
+    if (index != NO_REG && (index & 0x08))
+        rex |= 0x02;
+    if (base & 0x08)
+        rex |= 0x01;
+
+    if (rex != 0x40 || size == Size::Byte)
+        m_code.push_back(rex);
+}
+
+void X86Emitter::emitMem(Size size, std::initializer_list<uint8_t> opcode, uint8_t reg, X86Mem mem)
+{
+    emitRex(size, reg, mem.index, mem.base);
+    emitBytes(opcode);
+
+    // [rbp]/[r13] only exist with a displacement
+    uint8_t mod;
+    if (mem.disp == 0 && (mem.base & 7) != RBP)
+        mod = 0x00;
+    else if (mem.disp >= -128 && mem.disp <= 127)
+        mod = 0x40;
+    else
+        mod = 0x80;
+
+    // [rsp]/[r12] and indexed operands need a SIB byte
+    if (mem.index != NO_REG || (mem.base & 7) == RSP)
+    {
+        uint8_t scaleBits = (mem.scale == 8 ? 3 : mem.scale == 4 ? 2 : mem.scale == 2 ? 1 : 0);
+        uint8_t index = (mem.index == NO_REG ? RSP : mem.index & 7);
+        m_code.push_back(mod | ((reg & 7) << 3) | 0x04);
+        m_code.push_back((scaleBits << 6) | (index << 3) | (mem.base & 7));
+    }
+    else
+        m_code.push_back(mod | ((reg & 7) << 3) | (mem.base & 7));
+
+    if (mod == 0x40)
+        m_code.push_back((uint8_t)mem.disp);
+    else if (mod == 0x80)
+        emitImm32(mem.disp);
+}
+
+void X86Emitter::emitReg(Size size, std::initializer_list<uint8_t> opcode, uint8_t reg, uint8_t rm)
+{
+    emitRex(size, reg, NO_REG, rm);
+    emitBytes(opcode);
+    m_code.push_back(0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+void X86Emitter::emitRel32(X86Label target)
+{
+    size_t pos = m_code.size();
+    emitImm32(0);
+
+    if (m_labels[target] != UNBOUND_LABEL)
+    {
+        int32_t rel = m_labels[target] - (pos + 4);
+        memcpy(&m_code[pos], &rel, sizeof(rel));
+    }
+    else
+        m_fixups.push_back({ pos, target });
+}